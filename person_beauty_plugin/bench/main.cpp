@@ -0,0 +1,554 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <opencv2/opencv.hpp>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "AI/FaceDetector.h"
+#include "AI/FaceLandmarkModel.h"
+#include "AI/ParsingModel.h"
+#include "AI/SegmentationModel.h"
+#include "Core/CpuFeatures.h"
+#include "Core/ImageBuffer.h"
+#include "Core/ImageIO.h"
+#include "Core/StripProcessor.h"
+#include "Core/TaskScheduler.h"
+#include "Network/HttpBody.h"
+#include "Processing/ColorEngine.h"
+#include "Processing/LiquifyEngine.h"
+#include "Processing/MaskProcessor.h"
+
+using namespace PersonBeauty;
+using Clock = std::chrono::steady_clock;
+
+// Benchmark suite for every model wrapper and Processing operation.
+// Each case runs `warmup` untimed and `reps` timed iterations on synthetic
+// and (if available) real images at several resolutions, for 1 and N faces.
+// Results are printed as a table and optionally written as JSON so runs can
+// be compared across releases.
+
+struct BenchOptions {
+  std::string imagePath = "../../test.jpg";
+  std::string modelDir = "../models/";
+  std::string jsonPath;
+  std::string filter;
+  int warmup = 2;
+  int reps = 10;
+  int manyFaces = 4;
+  size_t threads = 0;
+  bool halfLayers = false; // LayerPrecision::Float16 for the gray layers
+  std::vector<std::string> resolutions = {"720p", "1080p", "4k", "24mp"};
+};
+
+struct BenchResult {
+  std::string name;
+  std::string source;
+  std::string resolution;
+  int width = 0;
+  int height = 0;
+  int faces = 0;
+  int reps = 0;
+  double minMs = 0, medianMs = 0, meanMs = 0, p95Ms = 0, maxMs = 0,
+         stddevMs = 0;
+};
+
+// A scene is one input image plus face geometry at a given resolution
+struct BenchScene {
+  std::string source;
+  std::string resolution;
+  cv::Mat image;
+  cv::Mat skinMask;
+  std::vector<AI::FaceBox> faces;
+  std::vector<std::vector<cv::Point2f>> landmarks;
+};
+
+static cv::Size resolutionSize(const std::string &name) {
+  if (name == "720p")
+    return cv::Size(1280, 720);
+  if (name == "1080p")
+    return cv::Size(1920, 1080);
+  if (name == "4k")
+    return cv::Size(3840, 2160);
+  if (name == "24mp")
+    return cv::Size(6000, 4000);
+  return cv::Size();
+}
+
+// Rough 68-point (iBUG) layout inside a face box, good enough to drive the
+// landmark-based Processing paths with realistic geometry
+static std::vector<cv::Point2f> syntheticLandmarks(const AI::FaceBox &box) {
+  float w = box.x2 - box.x1, h = box.y2 - box.y1;
+  auto at = [&](float u, float v) {
+    return cv::Point2f(box.x1 + u * w, box.y1 + v * h);
+  };
+  std::vector<cv::Point2f> pts;
+  for (int i = 0; i <= 16; ++i) { // Jaw
+    float t = static_cast<float>(CV_PI) * i / 16.0f;
+    pts.push_back(at(0.5f - 0.45f * std::cos(t), 0.35f + 0.6f * std::sin(t)));
+  }
+  for (int i = 0; i < 5; ++i) // Brows
+    pts.push_back(at(0.15f + 0.07f * i, 0.28f - 0.02f * (i % 4 != 0)));
+  for (int i = 0; i < 5; ++i)
+    pts.push_back(at(0.57f + 0.07f * i, 0.28f - 0.02f * (i % 4 != 0)));
+  for (int i = 0; i < 4; ++i) // Nose bridge
+    pts.push_back(at(0.5f, 0.35f + 0.06f * i));
+  for (int i = 0; i < 5; ++i) // Nostrils
+    pts.push_back(at(0.42f + 0.04f * i, 0.6f));
+  for (float cx : {0.32f, 0.68f}) { // Eyes
+    for (int i = 0; i < 6; ++i) {
+      float t = 2.0f * static_cast<float>(CV_PI) * i / 6.0f;
+      pts.push_back(at(cx + 0.08f * std::cos(t), 0.4f + 0.03f * std::sin(t)));
+    }
+  }
+  for (int i = 0; i < 20; ++i) { // Mouth
+    float t = 2.0f * static_cast<float>(CV_PI) * i / (i < 12 ? 12.0f : 8.0f);
+    float r = i < 12 ? 1.0f : 0.6f;
+    pts.push_back(
+        at(0.5f + 0.15f * r * std::cos(t), 0.75f + 0.05f * r * std::sin(t)));
+  }
+  return pts;
+}
+
+static BenchScene makeScene(const std::string &source, const cv::Mat &base,
+                            const std::string &resolution, int numFaces) {
+  BenchScene scene;
+  scene.source = source;
+  scene.resolution = resolution;
+  cv::Size size = resolutionSize(resolution);
+
+  if (base.empty()) {
+    // Synthetic: blurred noise so filters and codecs do real work
+    scene.image.create(size, CV_8UC3);
+    cv::randu(scene.image, cv::Scalar::all(0), cv::Scalar::all(255));
+    cv::GaussianBlur(scene.image, scene.image, cv::Size(0, 0), 3.0);
+  } else {
+    cv::resize(base, scene.image, size, 0, 0, cv::INTER_AREA);
+  }
+
+  // Faces on a grid, each about a third of the cell
+  int cols = static_cast<int>(std::ceil(std::sqrt(numFaces)));
+  int rows = (numFaces + cols - 1) / cols;
+  float cellW = static_cast<float>(size.width) / cols;
+  float cellH = static_cast<float>(size.height) / rows;
+  scene.skinMask = cv::Mat::zeros(size, CV_8UC1);
+  for (int i = 0; i < numFaces; ++i) {
+    float cx = (i % cols + 0.5f) * cellW, cy = (i / cols + 0.5f) * cellH;
+    float fs = std::min(cellW, cellH) * 0.35f;
+    AI::FaceBox box{cx - fs, cy - fs, cx + fs, cy + fs, 0.99f};
+    scene.faces.push_back(box);
+    scene.landmarks.push_back(syntheticLandmarks(box));
+    if (base.empty()) {
+      cv::ellipse(scene.image, cv::Point((int)cx, (int)cy),
+                  cv::Size((int)(fs * 0.9f), (int)fs), 0, 0, 360,
+                  cv::Scalar(150, 170, 210), cv::FILLED);
+    }
+    cv::ellipse(scene.skinMask, cv::Point((int)cx, (int)cy),
+                cv::Size((int)(fs * 0.9f), (int)fs), 0, 0, 360,
+                cv::Scalar(255), cv::FILLED);
+  }
+  cv::GaussianBlur(scene.skinMask, scene.skinMask, cv::Size(21, 21), 0);
+  return scene;
+}
+
+class BenchRunner {
+public:
+  explicit BenchRunner(const BenchOptions &options) : options_(options) {}
+
+  // setup() runs before every iteration, untimed, so in-place operations
+  // always start from the same input
+  void run(const std::string &name, const BenchScene &scene,
+           const std::function<void()> &setup,
+           const std::function<void()> &body) {
+    if (!options_.filter.empty() &&
+        name.find(options_.filter) == std::string::npos)
+      return;
+
+    for (int i = 0; i < options_.warmup; ++i) {
+      setup();
+      body();
+    }
+    std::vector<double> samples;
+    for (int i = 0; i < options_.reps; ++i) {
+      setup();
+      auto t0 = Clock::now();
+      body();
+      samples.push_back(
+          std::chrono::duration<double, std::milli>(Clock::now() - t0)
+              .count());
+    }
+
+    BenchResult r;
+    r.name = name;
+    r.source = scene.source;
+    r.resolution = scene.resolution;
+    r.width = scene.image.cols;
+    r.height = scene.image.rows;
+    r.faces = static_cast<int>(scene.faces.size());
+    r.reps = options_.reps;
+    summarize(samples, r);
+    print(r);
+    results_.push_back(r);
+  }
+
+  const std::vector<BenchResult> &results() const { return results_; }
+
+private:
+  static void summarize(std::vector<double> samples, BenchResult &r) {
+    if (samples.empty())
+      return;
+    std::sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+    double sum = 0.0;
+    for (double s : samples)
+      sum += s;
+    r.meanMs = sum / n;
+    double var = 0.0;
+    for (double s : samples)
+      var += (s - r.meanMs) * (s - r.meanMs);
+    r.minMs = samples.front();
+    r.maxMs = samples.back();
+    r.medianMs = n % 2 ? samples[n / 2]
+                       : 0.5 * (samples[n / 2 - 1] + samples[n / 2]);
+    r.p95Ms = samples[std::min(n - 1, static_cast<size_t>(
+                                          std::ceil(0.95 * n)) - 1)];
+    r.stddevMs = n > 1 ? std::sqrt(var / (n - 1)) : 0.0;
+  }
+
+  static void print(const BenchResult &r) {
+    std::printf("%-28s %-9s %-6s faces=%-2d median %9.2f ms  mean %9.2f  "
+                "p95 %9.2f  sd %7.2f\n",
+                r.name.c_str(), r.source.c_str(), r.resolution.c_str(),
+                r.faces, r.medianMs, r.meanMs, r.p95Ms, r.stddevMs);
+  }
+
+  const BenchOptions &options_;
+  std::vector<BenchResult> results_;
+};
+
+static void benchProcessing(BenchRunner &bench, const BenchScene &scene) {
+  ImageBuffer image;
+  ImageBuffer mask;
+  const ImageBuffer skin(scene.skinMask);
+  auto resetImage = [&]() { scene.image.copyTo(image.getMat()); };
+  auto resetMask = [&]() { scene.skinMask.copyTo(mask.getMat()); };
+  auto none = []() {};
+
+  // Face-independent operations only need one face configuration
+  if (scene.faces.size() == 1) {
+    bench.run("ColorEngine::adjust", scene, resetImage, [&]() {
+      Processing::ColorEngine::adjust(image, skin, 0.1f, 1.05f, 1.1f, 5.0f);
+    });
+    ImageBuffer layer(scene.image);
+    bench.run("ColorEngine::blend", scene, resetImage, [&]() {
+      Processing::ColorEngine::blend(image, layer, skin,
+                                     Processing::BlendMode::SoftLight, 0.8f);
+    });
+    bench.run("ColorEngine::retouch", scene, resetImage, [&]() {
+      Processing::ColorEngine::applyNeutralGrayRetouch(image, skin, 0.7f);
+    });
+
+    bench.run("MaskProcessor::feather", scene, resetMask,
+              [&]() { Processing::MaskProcessor::feather(mask, 10); });
+    ImageBuffer coarse(256, 256, 1);
+    cv::resize(scene.skinMask, coarse.getMat(), coarse.getMat().size(), 0, 0,
+               cv::INTER_AREA);
+    const ImageBuffer guide(scene.image);
+    bench.run("MaskProcessor::guidedUpsample", scene, none, [&]() {
+      Processing::MaskProcessor::guidedUpsample(coarse, guide, mask, 4, 1e-3f);
+    });
+    bench.run("MaskProcessor::expand", scene, resetMask,
+              [&]() { Processing::MaskProcessor::expand(mask, 5); });
+    bench.run("MaskProcessor::shrink", scene, resetMask,
+              [&]() { Processing::MaskProcessor::shrink(mask, 5); });
+    bench.run("MaskProcessor::add", scene, resetMask,
+              [&]() { Processing::MaskProcessor::add(mask, skin); });
+    bench.run("MaskProcessor::subtract", scene, resetMask,
+              [&]() { Processing::MaskProcessor::subtract(mask, skin); });
+
+    // Every stroke starts from an identity mesh and an empty history, so
+    // iterations neither compound the warp nor grow the undo stack
+    Processing::LiquifyEngine liquify(scene.image.cols, scene.image.rows);
+    auto resetLiquify = [&]() { liquify.reset(); };
+    bench.run("LiquifyEngine::push", scene, resetLiquify, [&]() {
+      liquify.push(0.4f, 0.4f, 0.45f, 0.42f, 0.1f, 0.5f);
+    });
+    bench.run("LiquifyEngine::expand", scene, resetLiquify,
+              [&]() { liquify.expand(0.5f, 0.5f, 0.1f, 0.3f); });
+    ImageBuffer warped(scene.image.cols, scene.image.rows, 3);
+    // Rebuild the maps every iteration: that is what an edit costs
+    bench.run(
+        "LiquifyEngine::process", scene,
+        [&]() {
+          liquify.reset();
+          liquify.expand(0.5f, 0.5f, 0.05f, 0.01f);
+        },
+        [&]() { liquify.process(ImageBuffer(scene.image), warped); });
+  }
+
+  bench.run("ColorEngine::stereo", scene, resetImage, [&]() {
+    for (const auto &pts : scene.landmarks)
+      Processing::ColorEngine::applyNeutralGrayStereo(image, pts, 0.7f);
+  });
+
+  ImageBuffer warped(scene.image.cols, scene.image.rows, 3);
+  bench.run("LiquifyEngine::slimFace", scene, none, [&]() {
+    Processing::LiquifyEngine liquify(scene.image.cols, scene.image.rows);
+    for (const auto &pts : scene.landmarks)
+      liquify.slimFace(pts, 0.45f);
+    liquify.process(ImageBuffer(scene.image), warped);
+  });
+
+  // The whole edit chain on full frames, then streamed in bands under a
+  // 64 MB working-set ceiling (same output)
+  Processing::LiquifyEngine slim(scene.image.cols, scene.image.rows);
+  for (const auto &pts : scene.landmarks)
+    slim.slimFace(pts, 0.45f);
+  const ImageBuffer source(scene.image);
+  ImageBuffer rendered(scene.image.cols, scene.image.rows, 3);
+  bench.run("Render::wholeFrame", scene, none, [&]() {
+    Processing::ColorEngine::adjust(source, rendered, skin, 0.1f, 1.05f, 1.0f,
+                                    0.0f);
+    Processing::ColorEngine::applyNeutralGrayRetouch(rendered, skin, 0.7f);
+    for (const auto &pts : scene.landmarks)
+      Processing::ColorEngine::applyNeutralGrayStereo(rendered, pts, 0.7f);
+    slim.process(rendered, rendered);
+  });
+
+  StripProcessor tiler(size_t(64) << 20);
+  tiler.addStage(Processing::ColorEngine::adjustStage(skin, 0.1f, 1.05f, 1.0f,
+                                                      0.0f));
+  tiler.addStage(Processing::ColorEngine::retouchStage(skin, 0.7f));
+  tiler.addStage(Processing::ColorEngine::stereoStage(scene.landmarks, 0.7f));
+  tiler.addStage(slim.stripStage());
+  bench.run("Render::tiled64MB", scene, none,
+            [&]() { tiler.run(source, rendered); });
+
+  // Upload body of GenAPIClient: JPEG into a reused buffer, then base64
+  // streamed through curl-sized chunks (no encoded copy is ever held)
+  auto jpeg = std::make_shared<std::vector<uint8_t>>();
+  std::vector<char> chunk(64 * 1024);
+  bench.run("Network::uploadBody", scene, none, [&]() {
+    cv::imencode(".jpg", scene.image, *jpeg);
+    Network::SegmentedBody body;
+    body.addText("{\"image\": \"");
+    body.addBytes(jpeg, true);
+    body.addText("\"}");
+    for (size_t offset = 0; offset < body.size();)
+      offset += body.read(offset, chunk.data(), chunk.size());
+  });
+
+  // Image input: the full decode against the DCT-scaled one the analysis
+  // models read (same JPEG, orientation handling included)
+  std::vector<uint8_t> file;
+  cv::imencode(".jpg", scene.image, file);
+  const int scale = ImageIO::reducedScale(file, 640);
+  bench.run("ImageIO::decode", scene, none,
+            [&]() { ImageIO::decode(file); });
+  bench.run("ImageIO::decodeReduced", scene, none,
+            [&]() { ImageIO::decodeReduced(file, scale); });
+}
+
+struct BenchModels {
+  AI::FaceDetector detector;
+  AI::FaceLandmarkModel landmarks;
+  AI::ParsingModel parsing;
+  AI::SegmentationModel segmentation;
+  bool hasDetector = false, hasLandmarks = false, hasParsing = false,
+       hasSegmentation = false;
+};
+
+static void benchModels(BenchRunner &bench, BenchModels &models,
+                        const BenchScene &scene) {
+  ImageBuffer input(scene.image);
+  auto none = []() {};
+
+  if (scene.faces.size() == 1) {
+    if (models.hasDetector)
+      bench.run("FaceDetector::detect", scene, none,
+                [&]() { models.detector.detect(input); });
+    if (models.hasParsing)
+      bench.run("ParsingModel::process", scene, none,
+                [&]() { models.parsing.process(input); });
+    if (models.hasSegmentation) {
+      bench.run("SegmentationModel::process", scene, none,
+                [&]() { models.segmentation.process(input); });
+      // Soft alpha upsampled along the image edges, instead of hard mask
+      // plus a full-resolution feather
+      AI::SegmentationOptions matte;
+      matte.output = AI::SegmentationOutput::Matte;
+      models.segmentation.setOptions(matte);
+      bench.run("SegmentationModel::matte", scene, none,
+                [&]() { models.segmentation.process(input); });
+      models.segmentation.setOptions(AI::SegmentationOptions());
+    }
+  }
+  if (models.hasDetector && scene.faces.size() > 1) {
+    // Tile pyramid (or one resized pass) against the single fixed pass
+    AI::DetectionOptions tiled;
+    tiled.mode = AI::DetectionMode::Tiled;
+    models.detector.setOptions(tiled);
+    bench.run("FaceDetector::detectTiled", scene, none,
+              [&]() { models.detector.detect(input); });
+    models.detector.setOptions(AI::DetectionOptions());
+  }
+  if (models.hasLandmarks) {
+    bench.run("FaceLandmarkModel::getLandmarks", scene, none, [&]() {
+      for (const auto &face : scene.faces)
+        models.landmarks.getLandmarks(input, face);
+    });
+  }
+}
+
+static std::string jsonEscape(const std::string &s) {
+  std::string out;
+  for (char c : s) {
+    if (c == '"' || c == '\\')
+      out += '\\';
+    out += c;
+  }
+  return out;
+}
+
+static bool writeJson(const std::string &path, const BenchOptions &options,
+                      const std::vector<BenchResult> &results) {
+  std::ofstream out(path);
+  if (!out)
+    return false;
+  out << "{\n  \"warmup\": " << options.warmup
+      << ",\n  \"reps\": " << options.reps
+      << ",\n  \"threads\": " << TaskScheduler::instance().concurrency()
+      << ",\n  \"cpu\": \"" << CpuFeatures::name(CpuFeatures::active())
+      << "\""
+      << ",\n  \"results\": [\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const auto &r = results[i];
+    out << "    {\"name\": \"" << jsonEscape(r.name) << "\", \"source\": \""
+        << r.source << "\", \"resolution\": \"" << r.resolution
+        << "\", \"width\": " << r.width << ", \"height\": " << r.height
+        << ", \"faces\": " << r.faces << ", \"reps\": " << r.reps
+        << ", \"min_ms\": " << r.minMs << ", \"median_ms\": " << r.medianMs
+        << ", \"mean_ms\": " << r.meanMs << ", \"p95_ms\": " << r.p95Ms
+        << ", \"max_ms\": " << r.maxMs << ", \"stddev_ms\": " << r.stddevMs
+        << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  out << "  ]\n}\n";
+  return true;
+}
+
+static std::vector<std::string> splitList(const std::string &s) {
+  std::vector<std::string> items;
+  std::stringstream ss(s);
+  std::string item;
+  while (std::getline(ss, item, ','))
+    if (!item.empty())
+      items.push_back(item);
+  return items;
+}
+
+static void printUsage(const char *argv0) {
+  std::cout << "Usage: " << argv0
+            << " [--image PATH] [--models DIR] [--warmup N] [--reps N]\n"
+               "       [--faces N] [--threads N] [--fp16]\n"
+               "       [--resolutions 720p,1080p,4k,24mp]\n"
+               "       [--filter SUBSTR] [--json PATH]"
+            << std::endl;
+}
+
+int main(int argc, char **argv) {
+  BenchOptions options;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--image" && hasValue)
+      options.imagePath = argv[++i];
+    else if (arg == "--models" && hasValue)
+      options.modelDir = std::string(argv[++i]) + "/";
+    else if (arg == "--warmup" && hasValue)
+      options.warmup = std::atoi(argv[++i]);
+    else if (arg == "--reps" && hasValue)
+      options.reps = std::max(1, std::atoi(argv[++i]));
+    else if (arg == "--faces" && hasValue)
+      options.manyFaces = std::max(2, std::atoi(argv[++i]));
+    else if (arg == "--resolutions" && hasValue)
+      options.resolutions = splitList(argv[++i]);
+    else if (arg == "--threads" && hasValue)
+      options.threads = std::strtoul(argv[++i], nullptr, 10);
+    else if (arg == "--fp16")
+      options.halfLayers = true;
+    else if (arg == "--filter" && hasValue)
+      options.filter = argv[++i];
+    else if (arg == "--json" && hasValue)
+      options.jsonPath = argv[++i];
+    else {
+      printUsage(argv[0]);
+      return arg == "--help" || arg == "-h" ? 0 : 1;
+    }
+  }
+
+  // Same CPU budget mechanism as the app, so numbers are comparable
+  SchedulerConfig schedulerConfig;
+  schedulerConfig.maxThreads = options.threads;
+  TaskScheduler::configure(schedulerConfig);
+  std::cout << "Threads: " << TaskScheduler::instance().concurrency()
+            << " (" << TaskScheduler::instance().inferenceThreads()
+            << " for inference)" << std::endl;
+  // Kernel variant in use (PERSON_BEAUTY_CPU_LEVEL caps it for comparisons)
+  std::cout << "CPU: " << CpuFeatures::name(CpuFeatures::active())
+            << std::endl;
+  if (options.halfLayers) {
+    Processing::ColorEngine::setLayerPrecision(
+        Processing::LayerPrecision::Float16);
+    std::cout << "Layer precision: fp16" << std::endl;
+  }
+
+  BenchModels models;
+  models.hasDetector =
+      models.detector.load(options.modelDir + "face_detector.onnx");
+  models.hasLandmarks =
+      models.landmarks.load(options.modelDir + "face_landmark.onnx");
+  models.hasParsing =
+      models.parsing.load(options.modelDir + "face_parsing.onnx");
+  models.hasSegmentation =
+      models.segmentation.load(options.modelDir + "segmentation.onnx");
+
+  std::vector<std::pair<std::string, cv::Mat>> sources = {
+      {"synthetic", cv::Mat()}};
+  cv::Mat real = cv::imread(options.imagePath);
+  if (!real.empty())
+    sources.push_back({"real", real});
+  else
+    std::cerr << "[Warning] Real image not found, synthetic only: "
+              << options.imagePath << std::endl;
+
+  BenchRunner bench(options);
+  for (const auto &resolution : options.resolutions) {
+    if (resolutionSize(resolution).area() == 0) {
+      std::cerr << "[Warning] Unknown resolution " << resolution << std::endl;
+      continue;
+    }
+    for (const auto &source : sources) {
+      for (int faces : {1, options.manyFaces}) {
+        BenchScene scene =
+            makeScene(source.first, source.second, resolution, faces);
+        benchModels(bench, models, scene);
+        benchProcessing(bench, scene);
+      }
+    }
+  }
+
+  if (!options.jsonPath.empty()) {
+    if (!writeJson(options.jsonPath, options, bench.results())) {
+      std::cerr << "[Error] Cannot write " << options.jsonPath << std::endl;
+      return 1;
+    }
+    std::cout << "Results written to " << options.jsonPath << std::endl;
+  }
+  return 0;
+}
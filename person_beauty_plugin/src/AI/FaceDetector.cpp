@@ -1,83 +1,225 @@
 #include "FaceDetector.h"
+#include "../Core/Kernels.h"
 #include <algorithm>
 #include <cmath>
-#include <cstring>
 #include <iostream>
 #include <opencv2/opencv.hpp>
 
 namespace PersonBeauty {
 namespace AI {
 
-FaceDetector::FaceDetector() { generateAnchors(); }
+// Tiles of one pyramid level overlap by this fraction of their size, so a
+// face up to that size lies whole inside at least one of them
+constexpr float kTileOverlap = 0.25f;
+// Pyramid levels are this factor apart; a level finds faces from its
+// smallest anchor up to about the overlap, so the ranges of levels meet
+constexpr float kLevelStep = 4.0f;
+// Cells per side of the NMS grid at most
+constexpr float kMaxGridSide = 64.0f;
+
+FaceDetector::FaceDetector() = default;
 
 bool FaceDetector::load(const std::string &modelPath) {
-  return engine_.loadModel(modelPath);
+  if (!engine_.loadModel(modelPath))
+    return false;
+  // NCHW; -1 marks a dimension the model leaves open
+  auto shape = engine_.getSession()
+                   .GetInputTypeInfo(0)
+                   .GetTensorTypeAndShapeInfo()
+                   .GetShape();
+  if (shape.size() == 4) {
+    dynamicBatch_ = shape[0] < 0;
+    dynamicSize_ = shape[2] < 0 || shape[3] < 0;
+    if (shape[2] > 0 && shape[3] > 0) {
+      inputHeight_ = static_cast<int>(shape[2]);
+      inputWidth_ = static_cast<int>(shape[3]);
+    }
+  }
+  return true;
 }
 
-void FaceDetector::generateAnchors() {
-  anchors_.clear();
+FaceDetector::Anchors FaceDetector::generateAnchors(cv::Size inputSize) const {
+  Anchors anchors;
   // Feature map sizes for 320x240:
   // 320/8=40, 240/8=30
   // 320/16=20, 240/16=15
   // 320/32=10, 240/32=8
   // Usually 240/32 is 7.5 -> 8 (ceil)
-
-  // Let's calculate dynamically
   for (size_t i = 0; i < strides_.size(); ++i) {
     float stride = strides_[i];
-    int feature_w = (int)std::ceil(inputWidth_ / stride);
-    int feature_h = (int)std::ceil(inputHeight_ / stride);
+    int feature_w = (int)std::ceil(inputSize.width / stride);
+    int feature_h = (int)std::ceil(inputSize.height / stride);
 
     for (int y = 0; y < feature_h; ++y) {
       for (int x = 0; x < feature_w; ++x) {
         for (float min_size : min_boxes_[i]) {
-          // cx, cy, w, h (normalized later?)
           // UltraFace anchors are normalized to [0,1]
-          float cx = (x * stride + stride / 2.0f) / inputWidth_;
-          float cy = (y * stride + stride / 2.0f) / inputHeight_;
-          float w = min_size / inputWidth_;
-          float h = min_size / inputHeight_;
-          anchors_.push_back({cx, cy, w, h});
+          anchors.cx.push_back((x * stride + stride / 2.0f) / inputSize.width);
+          anchors.cy.push_back((y * stride + stride / 2.0f) /
+                               inputSize.height);
+          anchors.w.push_back(min_size / inputSize.width);
+          anchors.h.push_back(min_size / inputSize.height);
+        }
+      }
+    }
+  }
+  return anchors;
+}
+
+std::shared_ptr<const FaceDetector::Anchors>
+FaceDetector::anchorsFor(cv::Size inputSize) {
+  std::lock_guard<std::mutex> lock(anchorsMutex_);
+  auto &anchors = anchors_[{inputSize.width, inputSize.height}];
+  if (!anchors)
+    anchors = std::make_shared<const Anchors>(generateAnchors(inputSize));
+  return anchors;
+}
+
+std::vector<cv::Rect>
+FaceDetector::planTiles(const DetectionOptions &options, cv::Size image,
+                        cv::Size &inputSize) const {
+  const cv::Rect whole(0, 0, image.width, image.height);
+  inputSize = cv::Size(inputWidth_, inputHeight_);
+  if (options.mode == DetectionMode::Fixed || whole.empty())
+    return {whole};
+
+  // Input pixels per image pixel that bring the smallest face to the
+  // smallest anchor; never upsample
+  const int longSide = std::max(image.width, image.height);
+  const int minFace = options.minFaceSize > 0
+                          ? options.minFaceSize
+                          : std::max(1, longSide / 100);
+  float scale = std::min(1.0f, min_boxes_[0][0] / minFace);
+
+  if (options.mode == DetectionMode::Adaptive && dynamicSize_) {
+    // One pass keeping the aspect ratio, sides a multiple of the largest
+    // stride so every feature map cell is whole
+    scale = std::min(scale, static_cast<float>(options.maxInputSide) /
+                                longSide);
+    const int align = static_cast<int>(strides_.back());
+    auto side = [&](int pixels) {
+      const int scaled = static_cast<int>(std::ceil(pixels * scale / align));
+      return std::max(1, scaled) * align;
+    };
+    inputSize = cv::Size(side(image.width), side(image.height));
+    return {whole};
+  }
+
+  // Pyramid of base-size tiles. The whole-image pass covers scales down to
+  // about twice its own; finer levels are kLevelStep apart, from `scale`
+  // upwards.
+  const float wholeScale =
+      std::min(static_cast<float>(inputWidth_) / image.width,
+               static_cast<float>(inputHeight_) / image.height);
+  auto levelTiles = [&](float s, std::vector<cv::Rect> *out) {
+    const int tileW = std::min(image.width, cvRound(inputWidth_ / s));
+    const int tileH = std::min(image.height, cvRound(inputHeight_ / s));
+    auto count = [](int size, int tile) {
+      if (tile >= size)
+        return 1;
+      const float step = tile * (1.0f - kTileOverlap);
+      return static_cast<int>(std::ceil((size - tile) / step)) + 1;
+    };
+    const int nx = count(image.width, tileW);
+    const int ny = count(image.height, tileH);
+    if (out) {
+      for (int iy = 0; iy < ny; ++iy) {
+        for (int ix = 0; ix < nx; ++ix) {
+          const int x = nx == 1 ? 0 : (image.width - tileW) * ix / (nx - 1);
+          const int y = ny == 1 ? 0 : (image.height - tileH) * iy / (ny - 1);
+          out->push_back(cv::Rect(x, y, tileW, tileH));
         }
       }
     }
+    return nx * ny;
+  };
+  // Coarsen the finest level until everything fits in maxTiles
+  std::vector<float> levels;
+  for (float finest = scale; finest > 2.0f * wholeScale; finest /= 2.0f) {
+    levels.clear();
+    int total = 1;
+    for (float s = finest; s > 2.0f * wholeScale; s /= kLevelStep) {
+      levels.push_back(s);
+      total += levelTiles(s, nullptr);
+    }
+    if (total <= std::max(1, options.maxTiles))
+      break;
+    levels.clear();
   }
+
+  std::vector<cv::Rect> tiles = {whole};
+  for (float s : levels)
+    levelTiles(s, &tiles);
+  return tiles;
 }
 
 std::vector<FaceBox> FaceDetector::detect(const ImageBuffer &input) {
   if (!engine_.isLoaded())
     return {};
 
-  // 1. Preprocess
-  cv::Mat img = input.getMat();
-  cv::Mat inputImg;
-  cv::resize(img, inputImg, cv::Size(inputWidth_, inputHeight_));
-  cv::cvtColor(inputImg, inputImg,
-               cv::COLOR_BGR2RGB); // UltraFace likely expects RGB
+  // One consistent set for the whole call, whatever setOptions() does
+  // meanwhile
+  const DetectionOptions options = this->options();
+  cv::Size inputSize;
+  const std::vector<cv::Rect> tiles =
+      planTiles(options, input.getMat().size(), inputSize);
 
-  cv::Mat floatImg;
-  inputImg.convertTo(floatImg, CV_32F);
+  // All tiles share one input shape: a model with an open batch dimension
+  // runs them in a single inference
+  std::vector<FaceBox> faces;
+  if (dynamicBatch_) {
+    detectTiles(options, input, tiles, 0, tiles.size(), inputSize, faces);
+  } else {
+    for (size_t i = 0; i < tiles.size(); ++i)
+      detectTiles(options, input, tiles, i, 1, inputSize, faces);
+  }
 
-  // (x - 127) / 128
-  floatImg = (floatImg - 127.0f) / 128.0f;
+  // Faces in the overlap of tiles and pyramid levels are found more than
+  // once: one suppression over all of them
+  std::vector<FaceBox> finalFaces;
+  const size_t topK = static_cast<size_t>(std::max(0, options.maxCandidates));
+  nonMaximumSuppression(faces, finalFaces, options.iouThreshold, topK);
+
+  return finalFaces;
+}
+
+void FaceDetector::detectTiles(const DetectionOptions &options,
+                               const ImageBuffer &input,
+                               const std::vector<cv::Rect> &tiles,
+                               size_t first, size_t count, cv::Size inputSize,
+                               std::vector<FaceBox> &candidates) {
+  // 1. Preprocess
+  PB_TRACE_PHASE(phase, "FaceDetector::preprocess");
+  const cv::Mat &img = input.getMat();
+  const int batch = static_cast<int>(count);
 
   // HWC -> CHW
-  // 1, 3, 240, 320
-  std::vector<int64_t> inputDims = {1, 3, inputHeight_, inputWidth_};
-  size_t inputSize = 1 * 3 * inputHeight_ * inputWidth_;
-  std::vector<float> inputData(inputSize);
-
-  std::vector<cv::Mat> chans;
-  cv::split(floatImg, chans);
-  // Copy to vector
-  std::memcpy(inputData.data(), chans[0].data,
-              chans[0].total() * sizeof(float));
-  std::memcpy(inputData.data() + chans[0].total(), chans[1].data,
-              chans[1].total() * sizeof(float));
-  std::memcpy(inputData.data() + 2 * chans[0].total(), chans[2].data,
-              chans[2].total() * sizeof(float));
+  // N, 3, 240, 320
+  std::vector<int64_t> inputDims = {batch, 3, inputSize.height,
+                                    inputSize.width};
+  const size_t area = static_cast<size_t>(inputSize.area());
+  size_t inputSize3 = 3 * area;
+  std::vector<float> inputData(inputSize3 * count);
+  PB_TRACE_BYTES(inputData.size() * sizeof(float));
+
+  // UltraFace likely expects RGB, (x - 127) / 128; one pass from the
+  // resized pixels whatever the host format
+  int order[3];
+  planeOrder(input.format(), true, order);
+  const float scale[3] = {1.0f / 128.0f, 1.0f / 128.0f, 1.0f / 128.0f};
+  const float offset[3] = {-127.0f / 128.0f, -127.0f / 128.0f,
+                           -127.0f / 128.0f};
+  cv::Mat inputImg;
+  for (size_t b = 0; b < count; ++b) {
+    // resize reads the tile's ROI directly
+    cv::resize(img(tiles[first + b]), inputImg, inputSize);
+    Kernels::packPlanar(inputImg.ptr<uint8_t>(), area, inputImg.channels(),
+                        order, scale, offset,
+                        inputData.data() + b * inputSize3, area);
+  }
 
   // 2. Inference
+  PB_TRACE_NEXT(phase, "FaceDetector::run");
   std::vector<const char *> inputNames = {"input"};
   // Note: Some models name it "input", "input0", or "image".
   // Since we don't know for sure, let's verify names if possible, but
@@ -92,11 +234,12 @@ std::vector<FaceBox> FaceDetector::detect(const ImageBuffer &input) {
 
   auto outputs = engine_.run(inputNames, inputTensors, outputNames);
   if (outputs.empty())
-    return {};
+    return;
 
   // 3. Post-process
-  // scores: [1, N, 2]
-  // boxes: [1, N, 4]
+  PB_TRACE_NEXT(phase, "FaceDetector::postprocess");
+  // scores: [N, A, 2]
+  // boxes: [N, A, 4]
 
   float *scoresPtr = outputs[0].GetTensorMutableData<float>();
   float *boxesPtr = outputs[1].GetTensorMutableData<float>();
@@ -104,92 +247,148 @@ std::vector<FaceBox> FaceDetector::detect(const ImageBuffer &input) {
   // Get Shapes
   auto scoreShape = outputs[0].GetTensorTypeAndShapeInfo().GetShape();
   int numAnchors = scoreShape[1];
+  const auto anchorsPtr = anchorsFor(inputSize);
+  const Anchors &anchors = *anchorsPtr;
+  if (static_cast<size_t>(numAnchors) != anchors.size()) {
+    std::cerr << "[Error] FaceDetector: model returned " << numAnchors
+              << " anchors for " << inputSize.width << "x"
+              << inputSize.height << ", expected " << anchors.size()
+              << std::endl;
+    return;
+  }
 
-  float confThreshold = 0.7f;
-  std::vector<FaceBox> faces;
+  // Only the few anchors above the threshold are decoded, from the
+  // kernel's compacted index list
+  const float *anchorPlanes[4] = {anchors.cx.data(), anchors.cy.data(),
+                                  anchors.w.data(), anchors.h.data()};
+  const float variance[2] = {center_variance_, size_variance_};
+  std::vector<uint32_t> selected(numAnchors);
+  std::vector<float> decoded;
+
+  for (size_t b = 0; b < count; ++b) {
+    const cv::Rect &tile = tiles[first + b];
+    const float *scores = scoresPtr + b * numAnchors * 2;
+    const float *boxes = boxesPtr + b * numAnchors * 4;
+    // Index 1 is face class usually
+    const size_t numSelected =
+        Kernels::selectAbove(scores + 1, numAnchors, 2,
+                             options.scoreThreshold, selected.data());
+    decoded.resize(numSelected * 4);
+    Kernels::decodeBoxes(boxes, anchorPlanes, selected.data(), numSelected,
+                         variance, decoded.data());
+
+    // A box reaching a tile edge inside the image is a cut face; the
+    // overlap puts it whole into a neighbouring tile or a coarser level
+    const float marginX = 2.0f * tile.width / inputSize.width;
+    const float marginY = 2.0f * tile.height / inputSize.height;
+    const bool cutLeft = tile.x > 0;
+    const bool cutTop = tile.y > 0;
+    const bool cutRight = tile.x + tile.width < img.cols;
+    const bool cutBottom = tile.y + tile.height < img.rows;
+
+    for (size_t k = 0; k < numSelected; ++k) {
+      const float *box = decoded.data() + k * 4;
+      float x1 = tile.x + box[0] * tile.width;
+      float y1 = tile.y + box[1] * tile.height;
+      float x2 = tile.x + box[2] * tile.width;
+      float y2 = tile.y + box[3] * tile.height;
+
+      if ((cutLeft && x1 < tile.x + marginX) ||
+          (cutTop && y1 < tile.y + marginY) ||
+          (cutRight && x2 > tile.x + tile.width - marginX) ||
+          (cutBottom && y2 > tile.y + tile.height - marginY))
+        continue;
 
-  for (int i = 0; i < numAnchors; ++i) {
-    float score = scoresPtr[i * 2 + 1]; // Index 1 is face class usually
-    if (score > confThreshold) {
+      // Clip
       FaceBox face;
-      // Decode box
-      // boxesPtr usually: dx, dy, dw, dh
-      float dx = boxesPtr[i * 4 + 0];
-      float dy = boxesPtr[i * 4 + 1];
-      float dw = boxesPtr[i * 4 + 2];
-      float dh = boxesPtr[i * 4 + 3]; // Correct index is +3
-
-      float cx = anchors_[i][0] + dx * center_variance_ * anchors_[i][2];
-      float cy = anchors_[i][1] + dy * center_variance_ * anchors_[i][3];
-      float w = anchors_[i][2] * std::exp(dw * size_variance_);
-      float h = anchors_[i][3] * std::exp(dh * size_variance_);
-
-      float x1 = (cx - w / 2.0f) * img.cols;
-      float y1 = (cy - h / 2.0f) * img.rows;
-      float x2 = (cx + w / 2.0f) * img.cols;
-      float y2 = (cy + h / 2.0f) * img.rows;
+      face.x1 = std::max(0.0f, x1);
+      face.y1 = std::max(0.0f, y1);
+      face.x2 = std::min((float)img.cols, x2);
+      face.y2 = std::min((float)img.rows, y2);
+      face.score = scores[selected[k] * 2 + 1];
 
-      // Clip
-      x1 = std::max(0.0f, x1);
-      y1 = std::max(0.0f, y1);
-      x2 = std::min((float)img.cols, x2);
-      y2 = std::min((float)img.rows, y2);
-
-      face.x1 = x1;
-      face.y1 = y1;
-      face.x2 = x2;
-      face.y2 = y2;
-      face.score = score;
-
-      faces.push_back(face);
+      candidates.push_back(face);
     }
   }
-
-  std::vector<FaceBox> finalFaces;
-  nonMaximumSuppression(faces, finalFaces, 0.3f);
-
-  return finalFaces;
 }
 
 void FaceDetector::nonMaximumSuppression(std::vector<FaceBox> &input,
                                          std::vector<FaceBox> &result,
-                                         float iouThreshold) {
+                                         float iouThreshold, size_t topK) {
   if (input.empty())
     return;
 
-  // Sort by score
-  std::sort(input.begin(), input.end(), [](const FaceBox &a, const FaceBox &b) {
+  // Sort by score; past topK the candidates of a crowded scene are mostly
+  // duplicates of better ones anyway
+  auto byScore = [](const FaceBox &a, const FaceBox &b) {
     return a.score > b.score;
-  });
-
-  std::vector<bool> suppressed(input.size(), false);
-  for (size_t i = 0; i < input.size(); ++i) {
-    if (suppressed[i])
+  };
+  if (topK > 0 && input.size() > topK) {
+    std::nth_element(input.begin(), input.begin() + topK, input.end(),
+                     byScore);
+    input.resize(topK);
+  }
+  std::sort(input.begin(), input.end(), byScore);
+
+  // Cells about the size of a typical box: a box touches few cells, and
+  // two boxes that overlap share at least one
+  float minX = input[0].x1, minY = input[0].y1;
+  float maxX = input[0].x2, maxY = input[0].y2;
+  std::vector<float> sides;
+  sides.reserve(input.size());
+  for (const FaceBox &box : input) {
+    minX = std::min(minX, box.x1);
+    minY = std::min(minY, box.y1);
+    maxX = std::max(maxX, box.x2);
+    maxY = std::max(maxY, box.y2);
+    sides.push_back(std::max(box.x2 - box.x1, box.y2 - box.y1));
+  }
+  std::nth_element(sides.begin(), sides.begin() + sides.size() / 2,
+                   sides.end());
+  const float extent = std::max(maxX - minX, maxY - minY);
+  const float cell =
+      std::max({sides[sides.size() / 2], extent / kMaxGridSide, 1.0f});
+  const int cols = static_cast<int>((maxX - minX) / cell) + 1;
+  const int rows = static_cast<int>((maxY - minY) / cell) + 1;
+  // Indices into `result` of the kept boxes touching each cell
+  std::vector<std::vector<size_t>> grid(static_cast<size_t>(cols) * rows);
+
+  auto iou = [](const FaceBox &a, const FaceBox &b) {
+    float xx1 = std::max(a.x1, b.x1);
+    float yy1 = std::max(a.y1, b.y1);
+    float xx2 = std::min(a.x2, b.x2);
+    float yy2 = std::min(a.y2, b.y2);
+
+    float w = std::max(0.0f, xx2 - xx1);
+    float h = std::max(0.0f, yy2 - yy1);
+    float inter = w * h;
+
+    float area1 = (a.x2 - a.x1) * (a.y2 - a.y1);
+    float area2 = (b.x2 - b.x1) * (b.y2 - b.y1);
+    return inter / (area1 + area2 - inter);
+  };
+
+  for (const FaceBox &box : input) {
+    const int c0 = static_cast<int>((box.x1 - minX) / cell);
+    const int c1 = std::min(cols - 1, static_cast<int>((box.x2 - minX) / cell));
+    const int r0 = static_cast<int>((box.y1 - minY) / cell);
+    const int r1 = std::min(rows - 1, static_cast<int>((box.y2 - minY) / cell));
+
+    auto suppressed = [&]() {
+      for (int r = r0; r <= r1; ++r)
+        for (int c = c0; c <= c1; ++c)
+          for (size_t kept : grid[r * cols + c])
+            if (iou(result[kept], box) > iouThreshold)
+              return true;
+      return false;
+    };
+    if (suppressed())
       continue;
 
-    result.push_back(input[i]);
-    float area1 = (input[i].x2 - input[i].x1) * (input[i].y2 - input[i].y1);
-
-    for (size_t j = i + 1; j < input.size(); ++j) {
-      if (suppressed[j])
-        continue;
-
-      float xx1 = std::max(input[i].x1, input[j].x1);
-      float yy1 = std::max(input[i].y1, input[j].y1);
-      float xx2 = std::min(input[i].x2, input[j].x2);
-      float yy2 = std::min(input[i].y2, input[j].y2);
-
-      float w = std::max(0.0f, xx2 - xx1);
-      float h = std::max(0.0f, yy2 - yy1);
-      float inter = w * h;
-
-      float area2 = (input[j].x2 - input[j].x1) * (input[j].y2 - input[j].y1);
-      float iou = inter / (area1 + area2 - inter);
-
-      if (iou > iouThreshold) {
-        suppressed[j] = true;
-      }
-    }
+    for (int r = r0; r <= r1; ++r)
+      for (int c = c0; c <= c1; ++c)
+        grid[r * cols + c].push_back(result.size());
+    result.push_back(box);
   }
 }
 
@@ -1,6 +1,10 @@
 #pragma once
 #include "../Core/ImageBuffer.h"
 #include "InferenceEngine.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
 #include <vector>
 
 namespace PersonBeauty {
@@ -11,25 +15,93 @@ struct FaceBox {
   float score;
 };
 
+// How detect() covers the image
+enum class DetectionMode {
+  Fixed,    // One pass over the whole image at the model's base size
+  Adaptive, // One pass sized so that minFaceSize reaches the smallest
+            // anchor, if the model takes any input size; else Tiled
+  Tiled     // The whole-image pass plus overlapping base-size tiles at finer
+            // scales down to minFaceSize, all in one batch
+};
+
+struct DetectionOptions {
+  DetectionMode mode = DetectionMode::Fixed;
+  // Smallest face side to find, in image pixels (Adaptive, Tiled);
+  // 0 = 1% of the longer image side
+  int minFaceSize = 0;
+  // Longest input side of an Adaptive single pass
+  int maxInputSide = 1280;
+  // Inputs per image, whole-image pass included; minFaceSize is raised
+  // until the tiles fit
+  int maxTiles = 16;
+  // Face score a box needs
+  float scoreThreshold = 0.7f;
+  // A box overlapping a higher-scoring one by more than this IoU is dropped
+  float iouThreshold = 0.3f;
+  // Highest-scoring boxes that enter NMS, over all tiles; 0 = all
+  int maxCandidates = 1000;
+};
+
 class FaceDetector {
 public:
   FaceDetector();
   bool load(const std::string &modelPath);
 
-  // Returns list of detected faces
+  // May be called while detect() runs; a call in progress keeps the
+  // options it started with
+  void setOptions(const DetectionOptions &options) {
+    std::lock_guard<std::mutex> lock(optionsMutex_);
+    options_ = options;
+  }
+  DetectionOptions options() const {
+    std::lock_guard<std::mutex> lock(optionsMutex_);
+    return options_;
+  }
+
+  // Returns list of detected faces. Safe to call concurrently.
   std::vector<FaceBox> detect(const ImageBuffer &input);
 
+  // Greedy NMS over the `topK` best of `input` (0 = all), appending the
+  // kept boxes to `result` by descending score. Kept boxes are bucketed in
+  // a grid, so a box is only tested against the kept ones near it.
+  static void nonMaximumSuppression(std::vector<FaceBox> &input,
+                                    std::vector<FaceBox> &result,
+                                    float iouThreshold, size_t topK);
+
 private:
-  void generateAnchors();
-  void nonMaximumSuppression(std::vector<FaceBox> &input,
-                             std::vector<FaceBox> &result, float iouThreshold);
+  // Anchor centers and sizes, normalized to the input, one plane each so
+  // the decode kernel reads them directly
+  struct Anchors {
+    std::vector<float> cx, cy, w, h;
+    size_t size() const { return cx.size(); }
+  };
+
+  Anchors generateAnchors(cv::Size inputSize) const;
+  // Generated once per input shape
+  std::shared_ptr<const Anchors> anchorsFor(cv::Size inputSize);
+  // Image regions to run, each resized to `inputSize`; the first is the
+  // whole image
+  std::vector<cv::Rect> planTiles(const DetectionOptions &options,
+                                  cv::Size image, cv::Size &inputSize) const;
+  // Run tiles [first, first + count) as one batch, appending their boxes in
+  // image coordinates
+  void detectTiles(const DetectionOptions &options, const ImageBuffer &input,
+                   const std::vector<cv::Rect> &tiles, size_t first,
+                   size_t count, cv::Size inputSize,
+                   std::vector<FaceBox> &candidates);
 
   InferenceEngine engine_;
+  mutable std::mutex optionsMutex_;
+  DetectionOptions options_;
   // UltraFace-RFB-320 usually uses 320x240 input
   int inputWidth_ = 320;
   int inputHeight_ = 240;
+  // Dimensions the model leaves open
+  bool dynamicBatch_ = false;
+  bool dynamicSize_ = false;
 
-  std::vector<std::vector<float>> anchors_;
+  std::mutex anchorsMutex_;
+  std::map<std::pair<int, int>, std::shared_ptr<const Anchors>> anchors_;
 
   // Config for RFB-320
   const float center_variance_ = 0.1f;
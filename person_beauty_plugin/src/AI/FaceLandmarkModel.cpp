@@ -1,5 +1,5 @@
 #include "FaceLandmarkModel.h"
-#include <cstring>
+#include "../Core/Kernels.h"
 #include <iostream>
 #include <opencv2/opencv.hpp>
 
@@ -17,6 +17,7 @@ FaceLandmarkModel::getLandmarks(const ImageBuffer &input, const FaceBox &face) {
   if (!engine_.isLoaded())
     return {};
 
+  PB_TRACE_PHASE(phase, "FaceLandmarkModel::preprocess");
   cv::Mat img = input.getMat();
 
   // 1. Tight Crop (No padding, direct stretching)
@@ -31,28 +32,27 @@ FaceLandmarkModel::getLandmarks(const ImageBuffer &input, const FaceBox &face) {
     return {};
 
   cv::Rect faceRect(ix1, iy1, ix2 - ix1, iy2 - iy1);
-  cv::Mat faceImg = img(faceRect).clone();
+  cv::Mat faceImg = img(faceRect); // resize reads the ROI directly
 
   // 2. Preprocess
   cv::Mat resized;
   cv::resize(faceImg, resized, cv::Size(inputSize_, inputSize_));
-  cv::cvtColor(resized, resized, cv::COLOR_BGR2RGB);
 
-  cv::Mat floatImg;
+  // HWC -> CHW, RGB order
   // Normalization: Many PFLD models use (x - 127.5) / 128.0
-  resized.convertTo(floatImg, CV_32F, 1.0f / 128.0f, -127.5f / 128.0f);
-
-  // HWC -> CHW
   std::vector<int64_t> inputDims = {1, 3, inputSize_, inputSize_};
-  std::vector<float> inputData(1 * 3 * inputSize_ * inputSize_);
-  std::vector<cv::Mat> chans;
-  cv::split(floatImg, chans);
-  for (int i = 0; i < 3; ++i) {
-    std::memcpy(inputData.data() + i * 112 * 112, chans[i].data,
-                112 * 112 * sizeof(float));
-  }
+  const size_t area = static_cast<size_t>(inputSize_) * inputSize_;
+  std::vector<float> inputData(3 * area);
+  int order[3];
+  planeOrder(input.format(), true, order);
+  const float scale[3] = {1.0f / 128.0f, 1.0f / 128.0f, 1.0f / 128.0f};
+  const float offset[3] = {-127.5f / 128.0f, -127.5f / 128.0f,
+                           -127.5f / 128.0f};
+  Kernels::packPlanar(resized.ptr<uint8_t>(), area, resized.channels(), order,
+                      scale, offset, inputData.data(), area);
 
   // 3. Inference
+  PB_TRACE_NEXT(phase, "FaceLandmarkModel::run");
   std::vector<const char *> inputNames = {"input"};
   std::vector<Ort::Value> inputTensors;
   inputTensors.push_back(Ort::Value::CreateTensor<float>(
@@ -65,6 +65,7 @@ FaceLandmarkModel::getLandmarks(const ImageBuffer &input, const FaceBox &face) {
     return {};
 
   // 4. Decode
+  PB_TRACE_NEXT(phase, "FaceLandmarkModel::postprocess");
   float *ptr = outputs[0].GetTensorMutableData<float>();
   std::vector<cv::Point2f> points;
 
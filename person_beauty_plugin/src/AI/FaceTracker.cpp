@@ -0,0 +1,272 @@
+#include "FaceTracker.h"
+#include <algorithm>
+#include <cmath>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/video.hpp>
+#include <utility>
+
+namespace PersonBeauty {
+namespace AI {
+
+static float smoothingFactor(float cutoff, float dt) {
+  float r = 2.0f * static_cast<float>(CV_PI) * cutoff * dt;
+  return r / (r + 1.0f);
+}
+
+float OneEuroFilter::filter(float value, float dt) {
+  if (!initialized_) {
+    prevValue_ = value;
+    prevDeriv_ = 0.0f;
+    initialized_ = true;
+    return value;
+  }
+
+  float deriv = (value - prevValue_) / dt;
+  float aD = smoothingFactor(derivCutoff_, dt);
+  prevDeriv_ = aD * deriv + (1.0f - aD) * prevDeriv_;
+
+  float cutoff = minCutoff_ + beta_ * std::abs(prevDeriv_);
+  float a = smoothingFactor(cutoff, dt);
+  prevValue_ = a * value + (1.0f - a) * prevValue_;
+  return prevValue_;
+}
+
+static float boxIoU(const FaceBox &a, const FaceBox &b) {
+  float w = std::max(0.0f, std::min(a.x2, b.x2) - std::max(a.x1, b.x1));
+  float h = std::max(0.0f, std::min(a.y2, b.y2) - std::max(a.y1, b.y1));
+  float inter = w * h;
+  float areaA = (a.x2 - a.x1) * (a.y2 - a.y1);
+  float areaB = (b.x2 - b.x1) * (b.y2 - b.y1);
+  float denom = areaA + areaB - inter;
+  return denom > 0.0f ? inter / denom : 0.0f;
+}
+
+static cv::Rect2f pointsBounds(const std::vector<cv::Point2f> &points) {
+  float minX = points[0].x, maxX = points[0].x;
+  float minY = points[0].y, maxY = points[0].y;
+  for (const auto &p : points) {
+    minX = std::min(minX, p.x);
+    maxX = std::max(maxX, p.x);
+    minY = std::min(minY, p.y);
+    maxY = std::max(maxY, p.y);
+  }
+  return cv::Rect2f(minX, minY, maxX - minX, maxY - minY);
+}
+
+FaceTracker::FaceTracker(FaceDetector &detector,
+                         FaceLandmarkModel &landmarkModel)
+    : FaceTracker(
+          [&detector](const ImageBuffer &frame) {
+            return detector.detect(frame);
+          },
+          [&landmarkModel](const ImageBuffer &frame, const FaceBox &box) {
+            return landmarkModel.getLandmarks(frame, box);
+          }) {}
+
+FaceTracker::FaceTracker(DetectFn detect, LandmarkFn landmarks)
+    : detect_(std::move(detect)), landmarks_(std::move(landmarks)) {}
+
+void FaceTracker::setSmoothing(float minCutoff, float beta) {
+  minCutoff_ = minCutoff;
+  beta_ = beta;
+  // Filters are rebuilt with the new parameters on the next frame
+  for (auto &track : tracks_)
+    track.filters.clear();
+}
+
+void FaceTracker::reset() {
+  tracks_.clear();
+  prevGray_.release();
+  prevTimestamp_ = -1.0;
+  framesSinceDetection_ = 0;
+}
+
+std::vector<TrackedFace> FaceTracker::track(const ImageBuffer &frame,
+                                            double timestamp) {
+  const cv::Mat &img = frame.getMat();
+  if (img.empty())
+    return {};
+
+  float dt = 1.0f / 30.0f;
+  if (timestamp >= 0.0 && prevTimestamp_ >= 0.0)
+    dt = std::max(1e-3f, static_cast<float>(timestamp - prevTimestamp_));
+  prevTimestamp_ = timestamp;
+
+  cv::Mat gray;
+  if (useOpticalFlow_) {
+    int toGray = toGrayCode(frame.format());
+    if (toGray >= 0)
+      cv::cvtColor(img, gray, toGray);
+    else
+      gray = img;
+  }
+
+  bool needDetection = tracks_.empty() ||
+                       ++framesSinceDetection_ >= detectionInterval_;
+
+  if (!needDetection) {
+    for (auto &t : tracks_) {
+      if (!propagate(t, frame, gray)) {
+        // One lost face is enough to re-run the detector; surviving tracks
+        // are matched back to the new detections and keep their state
+        needDetection = true;
+        break;
+      }
+    }
+  }
+
+  if (needDetection) {
+    redetect(frame);
+    framesSinceDetection_ = 0;
+  }
+  lastFrameDetected_ = needDetection;
+
+  std::vector<TrackedFace> result;
+  for (auto &t : tracks_) {
+    smooth(t, dt);
+    result.push_back(t.face);
+  }
+
+  // A Gray8 frame is used as is, and its pixels are the host's: keep a
+  // copy, the host may refill the buffer before the next call
+  if (gray.data == img.data)
+    gray.copyTo(prevGray_);
+  else
+    prevGray_ = gray;
+  return result;
+}
+
+bool FaceTracker::propagate(Track &track, const ImageBuffer &frame,
+                            const cv::Mat &gray) {
+  std::vector<cv::Point2f> points = track.rawLandmarks;
+
+  if (useOpticalFlow_ && !prevGray_.empty() &&
+      prevGray_.size() == gray.size()) {
+    std::vector<cv::Point2f> next;
+    std::vector<uchar> status;
+    std::vector<float> err;
+    cv::calcOpticalFlowPyrLK(prevGray_, gray, track.rawLandmarks, next, status,
+                             err, cv::Size(21, 21), 3);
+
+    // Shift by the median displacement: single LK points on low-texture
+    // skin are noisy, the face as a whole moves rigidly enough
+    std::vector<float> dxs, dys;
+    for (size_t i = 0; i < status.size(); ++i) {
+      if (status[i]) {
+        dxs.push_back(next[i].x - track.rawLandmarks[i].x);
+        dys.push_back(next[i].y - track.rawLandmarks[i].y);
+      }
+    }
+    if (dxs.size() < minFlowInliers_ * track.rawLandmarks.size())
+      return false;
+
+    size_t mid = dxs.size() / 2;
+    std::nth_element(dxs.begin(), dxs.begin() + mid, dxs.end());
+    std::nth_element(dys.begin(), dys.begin() + mid, dys.end());
+    cv::Point2f shift(dxs[mid], dys[mid]);
+    for (auto &p : points)
+      p += shift;
+  }
+
+  FaceBox predicted = boxFromLandmarks(track, points);
+  if (predicted.x2 - predicted.x1 < 2.0f || predicted.y2 - predicted.y1 < 2.0f)
+    return false;
+
+  auto landmarks = landmarks_(frame, predicted);
+  if (landmarks.empty())
+    return false;
+
+  // Landmarks that drifted off the face no longer agree with the box they
+  // were predicted from
+  FaceBox implied = boxFromLandmarks(track, landmarks);
+  if (boxIoU(implied, predicted) < minTrackIoU_)
+    return false;
+
+  track.face.box = predicted;
+  track.rawLandmarks = std::move(landmarks);
+  return true;
+}
+
+void FaceTracker::redetect(const ImageBuffer &frame) {
+  auto boxes = detect_(frame);
+
+  std::vector<Track> next;
+  std::vector<bool> matched(tracks_.size(), false);
+  for (const auto &box : boxes) {
+    // Greedy IoU matching keeps ids and filter state across detections
+    int best = -1;
+    float bestIoU = minTrackIoU_;
+    for (size_t i = 0; i < tracks_.size(); ++i) {
+      if (matched[i])
+        continue;
+      float iou = boxIoU(box, tracks_[i].face.box);
+      if (iou > bestIoU) {
+        bestIoU = iou;
+        best = static_cast<int>(i);
+      }
+    }
+
+    Track t;
+    if (best >= 0) {
+      matched[best] = true;
+      t = std::move(tracks_[best]);
+    } else {
+      t.face.id = nextId_++;
+    }
+
+    auto landmarks = landmarks_(frame, box);
+    if (landmarks.empty())
+      continue;
+
+    t.face.box = box;
+    t.rawLandmarks = std::move(landmarks);
+    anchorBox(t);
+    next.push_back(std::move(t));
+  }
+
+  tracks_ = std::move(next);
+}
+
+void FaceTracker::anchorBox(Track &track) {
+  cv::Rect2f r = pointsBounds(track.rawLandmarks);
+  float w = std::max(r.width, 1.0f);
+  float h = std::max(r.height, 1.0f);
+  const FaceBox &box = track.face.box;
+  track.boxLeft = (box.x1 - r.x) / w;
+  track.boxTop = (box.y1 - r.y) / h;
+  track.boxRight = (box.x2 - (r.x + r.width)) / w;
+  track.boxBottom = (box.y2 - (r.y + r.height)) / h;
+}
+
+FaceBox
+FaceTracker::boxFromLandmarks(const Track &track,
+                              const std::vector<cv::Point2f> &points) const {
+  cv::Rect2f r = pointsBounds(points);
+  float w = std::max(r.width, 1.0f);
+  float h = std::max(r.height, 1.0f);
+
+  FaceBox box;
+  box.x1 = r.x + track.boxLeft * w;
+  box.y1 = r.y + track.boxTop * h;
+  box.x2 = r.x + r.width + track.boxRight * w;
+  box.y2 = r.y + r.height + track.boxBottom * h;
+  box.score = track.face.box.score;
+  return box;
+}
+
+void FaceTracker::smooth(Track &track, float dt) {
+  const size_t n = track.rawLandmarks.size();
+  if (track.filters.size() != n * 2)
+    track.filters.assign(n * 2, OneEuroFilter(minCutoff_, beta_));
+
+  track.face.landmarks.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    track.face.landmarks[i].x =
+        track.filters[i * 2].filter(track.rawLandmarks[i].x, dt);
+    track.face.landmarks[i].y =
+        track.filters[i * 2 + 1].filter(track.rawLandmarks[i].y, dt);
+  }
+}
+
+} // namespace AI
+} // namespace PersonBeauty
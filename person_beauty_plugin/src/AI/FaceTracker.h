@@ -0,0 +1,105 @@
+#pragma once
+#include "../Core/ImageBuffer.h"
+#include "FaceDetector.h"
+#include "FaceLandmarkModel.h"
+#include <functional>
+#include <vector>
+
+namespace PersonBeauty {
+namespace AI {
+
+// One-Euro filter (Casiez et al.): a low-pass filter whose cutoff rises with
+// speed, so slow jitter is removed while fast motion keeps little lag.
+class OneEuroFilter {
+public:
+  OneEuroFilter(float minCutoff = 1.0f, float beta = 0.05f,
+                float derivCutoff = 1.0f)
+      : minCutoff_(minCutoff), beta_(beta), derivCutoff_(derivCutoff) {}
+
+  float filter(float value, float dt);
+  void reset() { initialized_ = false; }
+
+private:
+  float minCutoff_, beta_, derivCutoff_;
+  float prevValue_ = 0.0f;
+  float prevDeriv_ = 0.0f;
+  bool initialized_ = false;
+};
+
+struct TrackedFace {
+  int id = 0;
+  FaceBox box;                         // Box used for the landmark crop
+  std::vector<cv::Point2f> landmarks; // Temporally smoothed landmarks
+};
+
+// Streaming face tracker for video / webcam input.
+// The detector runs only every N frames or when a track is lost. In between,
+// each face box is propagated from the previous frame's landmarks (optionally
+// moved by sparse optical flow) and only the landmark model runs.
+class FaceTracker {
+public:
+  using DetectFn = std::function<std::vector<FaceBox>(const ImageBuffer &)>;
+  using LandmarkFn = std::function<std::vector<cv::Point2f>(
+      const ImageBuffer &, const FaceBox &)>;
+
+  FaceTracker(FaceDetector &detector, FaceLandmarkModel &landmarkModel);
+  // Any detector / landmark source, e.g. another model or a scripted one
+  FaceTracker(DetectFn detect, LandmarkFn landmarks);
+
+  // Run the detector at least every `frames` frames (1 = every frame)
+  void setDetectionInterval(int frames) { detectionInterval_ = frames; }
+  // Move boxes with pyramidal Lucas-Kanade flow before re-running landmarks
+  void setUseOpticalFlow(bool enabled) { useOpticalFlow_ = enabled; }
+  // One-Euro parameters applied to every landmark coordinate
+  void setSmoothing(float minCutoff, float beta);
+
+  // timestamp in seconds; a negative value assumes a 30 fps stream
+  std::vector<TrackedFace> track(const ImageBuffer &frame,
+                                 double timestamp = -1.0);
+
+  // Drop all tracks; the next frame runs the detector
+  void reset();
+
+  // Whether the last track() call ran the face detector
+  bool lastFrameDetected() const { return lastFrameDetected_; }
+
+private:
+  struct Track {
+    TrackedFace face;
+    std::vector<cv::Point2f> rawLandmarks;
+    std::vector<OneEuroFilter> filters; // x, y per landmark
+    // Detector box expressed relative to the landmark bounding rect, so a
+    // box can be re-derived from landmarks with the detector's framing
+    float boxLeft = 0, boxTop = 0, boxRight = 0, boxBottom = 0;
+  };
+
+  bool propagate(Track &track, const ImageBuffer &frame, const cv::Mat &gray);
+  void redetect(const ImageBuffer &frame);
+  void anchorBox(Track &track);
+  FaceBox boxFromLandmarks(const Track &track,
+                           const std::vector<cv::Point2f> &points) const;
+  void smooth(Track &track, float dt);
+
+  DetectFn detect_;
+  LandmarkFn landmarks_;
+
+  int detectionInterval_ = 10;
+  bool useOpticalFlow_ = true;
+  float minCutoff_ = 1.0f;
+  float beta_ = 0.05f;
+  // Tracks whose landmark box overlaps the propagated box less than this
+  // are considered lost
+  float minTrackIoU_ = 0.3f;
+  // Fraction of landmarks optical flow must follow for a track to survive
+  float minFlowInliers_ = 0.6f;
+
+  std::vector<Track> tracks_;
+  cv::Mat prevGray_;
+  double prevTimestamp_ = -1.0;
+  int framesSinceDetection_ = 0;
+  int nextId_ = 1;
+  bool lastFrameDetected_ = false;
+};
+
+} // namespace AI
+} // namespace PersonBeauty
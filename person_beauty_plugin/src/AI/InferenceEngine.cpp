@@ -1,18 +1,51 @@
 #include "InferenceEngine.h"
+#include "../Core/TaskScheduler.h"
+#include "../Core/Trace.h"
 #include <filesystem>
 #include <iostream>
+#include <thread>
 
 namespace PersonBeauty {
 namespace AI {
 
-InferenceEngine::InferenceEngine() {
-  // Initialize ONNX Runtime Environment
-  env_ = std::make_unique<Ort::Env>(ORT_LOGGING_LEVEL_WARNING,
-                                    "PersonBeautyPlugin");
+// ORT creates its global pool threads through these hooks, so they run
+// inside the TaskScheduler CPU budget
+static OrtCustomThreadHandle createBudgetThread(void *, OrtThreadWorkerFn fn,
+                                                void *param) {
+  auto thread = TaskScheduler::instance().spawnBudgetThread(
+      [fn, param]() { fn(param); });
+  return reinterpret_cast<OrtCustomThreadHandle>(thread.release());
 }
 
+static void joinBudgetThread(OrtCustomThreadHandle handle) {
+  std::unique_ptr<std::thread> thread(reinterpret_cast<std::thread *>(
+      const_cast<OrtCustomHandleType *>(handle)));
+  thread->join();
+}
+
+// One environment for all models: sessions share a single global intra-op
+// pool instead of one pool per session. It holds the scheduler's
+// inferenceThreads(); the thread calling Run() works too, so a run issued
+// from a pool worker adds no thread beyond the budget.
+static Ort::Env &sharedEnv() {
+  static Ort::Env env = []() {
+    Ort::ThreadingOptions options;
+    options.SetGlobalIntraOpNumThreads(
+        static_cast<int>(TaskScheduler::instance().inferenceThreads()) + 1);
+    options.SetGlobalInterOpNumThreads(1);
+    // Idle ORT workers must not spin on cores the scheduler pool needs
+    options.SetGlobalSpinControl(0);
+    options.SetGlobalCustomCreateThreadFn(createBudgetThread);
+    options.SetGlobalCustomJoinThreadFn(joinBudgetThread);
+    return Ort::Env(options, ORT_LOGGING_LEVEL_WARNING, "PersonBeautyPlugin");
+  }();
+  return env;
+}
+
+InferenceEngine::InferenceEngine() {}
+
 InferenceEngine::~InferenceEngine() {
-  // Session and Env will be automatically destroyed
+  // Session will be automatically destroyed; the Env is shared
 }
 
 bool InferenceEngine::loadModel(const std::string &modelPath) {
@@ -29,11 +62,11 @@ bool InferenceEngine::loadModel(const std::string &modelPath) {
 
   try {
     Ort::SessionOptions sessionOptions;
-    sessionOptions.SetIntraOpNumThreads(1);
+    sessionOptions.DisablePerSessionThreads();
     sessionOptions.SetGraphOptimizationLevel(
         GraphOptimizationLevel::ORT_ENABLE_BASIC);
 
-    session_ = std::make_unique<Ort::Session>(*env_, modelPath.c_str(),
+    session_ = std::make_unique<Ort::Session>(sharedEnv(), modelPath.c_str(),
                                               sessionOptions);
     return true;
   } catch (const Ort::Exception &e) {
@@ -47,6 +80,7 @@ std::vector<Ort::Value>
 InferenceEngine::run(const std::vector<const char *> &inputNames,
                      const std::vector<Ort::Value> &inputValues,
                      const std::vector<const char *> &outputNames) {
+  PB_TRACE_SCOPE("InferenceEngine::run");
   if (!session_) {
     std::cerr << "Session not initialized!" << std::endl;
     return {};
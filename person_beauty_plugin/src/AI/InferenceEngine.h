@@ -27,7 +27,6 @@ public:
   Ort::MemoryInfo &getMemoryInfo() { return memoryInfo_; }
 
 private:
-  std::unique_ptr<Ort::Env> env_;
   std::unique_ptr<Ort::Session> session_;
   Ort::MemoryInfo memoryInfo_ =
       Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
@@ -1,6 +1,6 @@
 #include "ParsingModel.h"
+#include "../Core/Kernels.h"
 #include <algorithm>
-#include <cstring>
 #include <opencv2/imgproc.hpp>
 
 namespace PersonBeauty {
@@ -17,25 +17,30 @@ std::shared_ptr<ImageBuffer> ParsingModel::process(const ImageBuffer &input) {
     return nullptr;
 
   // 1. Preprocess
+  PB_TRACE_PHASE(phase, "ParsingModel::preprocess");
   cv::Mat resized;
   cv::resize(input.getMat(), resized, cv::Size(inputWidth_, inputHeight_));
 
-  // Normalization (Mean/Std often needed for parsing models like BiSeNet)
-  // Here using a generic placeholder normalization
-  resized.convertTo(resized, CV_32F, 1.0f / 255.0f);
-  cv::subtract(resized, cv::Scalar(0.485, 0.456, 0.406), resized);
-  cv::divide(resized, cv::Scalar(0.229, 0.224, 0.225), resized);
-
   // Prepare Tensor
   const int area = inputHeight_ * inputWidth_;
   std::vector<float> inputTensorValues(3 * area);
+  PB_TRACE_BYTES(inputTensorValues.size() * sizeof(float));
 
-  std::vector<cv::Mat> channels(3);
-  cv::split(resized, channels);
+  // Normalization (Mean/Std often needed for parsing models like BiSeNet)
+  // Here using a generic placeholder normalization. The model takes BGR
+  // planes whatever the host's pixel format; (x / 255 - mean) / std is
+  // folded into one scale and offset per plane.
+  const float mean[3] = {0.485f, 0.456f, 0.406f};
+  const float stdDev[3] = {0.229f, 0.224f, 0.225f};
+  float scale[3], offset[3];
   for (int c = 0; c < 3; ++c) {
-    std::memcpy(inputTensorValues.data() + c * area, channels[c].ptr<float>(),
-                area * sizeof(float));
+    scale[c] = 1.0f / (255.0f * stdDev[c]);
+    offset[c] = -mean[c] / stdDev[c];
   }
+  int order[3];
+  planeOrder(input.format(), false, order);
+  Kernels::packPlanar(resized.ptr<uint8_t>(), area, resized.channels(), order,
+                      scale, offset, inputTensorValues.data(), area);
 
   std::vector<int64_t> inputShape = {1, 3, inputHeight_, inputWidth_};
   Ort::Value inputTensor = Ort::Value::CreateTensor<float>(
@@ -43,6 +48,7 @@ std::shared_ptr<ImageBuffer> ParsingModel::process(const ImageBuffer &input) {
       inputTensorValues.size(), inputShape.data(), inputShape.size());
 
   // 2. Run Inference
+  PB_TRACE_NEXT(phase, "ParsingModel::run");
   const char *inputNames[] = {"input"};
   const char *outputNames[] = {"output"};
 
@@ -56,6 +62,7 @@ std::shared_ptr<ImageBuffer> ParsingModel::process(const ImageBuffer &input) {
     return nullptr;
 
   // 3. Postprocess (ArgMax)
+  PB_TRACE_NEXT(phase, "ParsingModel::postprocess");
   // Output is usually [1, NumClasses, H, W] -> We want [H, W] with class
   // indices
 
@@ -67,29 +74,14 @@ std::shared_ptr<ImageBuffer> ParsingModel::process(const ImageBuffer &input) {
 
   cv::Mat parsingMap(inputHeight_, inputWidth_, CV_8UC1);
 
-  // Efficient ArgMax (this is slow in CPU loop, but standard for C++ demo)
-  for (int i = 0; i < area; ++i) {
-    int maxClass = 0;
-    float maxVal = floatOutput[i]; // Class 0
-
-    for (int c = 1; c < numClasses; ++c) {
-      float val = floatOutput[c * area + i];
-      if (val > maxVal) {
-        maxVal = val;
-        maxClass = c;
-      }
-    }
-    parsingMap.data[i] = static_cast<unsigned char>(maxClass);
-  }
-
-  // Resize back to original size (Nearest Neighbor to keep class IDs)
-  cv::Mat finalMask;
-  cv::resize(parsingMap, finalMask, input.getMat().size(), 0, 0,
-             cv::INTER_NEAREST);
+  Kernels::argmaxPlanes(floatOutput, numClasses, area, parsingMap.data);
 
+  // Resize back to original size (Nearest Neighbor to keep class IDs),
+  // straight into the (pooled) result buffer
   auto result = std::make_shared<ImageBuffer>(input.getMat().cols,
                                               input.getMat().rows, 1);
-  finalMask.copyTo(result->getMat());
+  cv::resize(parsingMap, result->getMat(), input.getMat().size(), 0, 0,
+             cv::INTER_NEAREST);
 
   return result;
 }
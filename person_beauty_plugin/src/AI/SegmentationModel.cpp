@@ -1,6 +1,8 @@
 #include "SegmentationModel.h"
+#include "../Core/Kernels.h"
+#include "../Processing/MaskProcessor.h"
 #include <algorithm>
-#include <cstring>
+#include <cmath>
 #include <opencv2/imgproc.hpp>
 #include <vector>
 
@@ -20,26 +22,25 @@ SegmentationModel::process(const ImageBuffer &input) {
   }
 
   // 1. Preprocess
+  PB_TRACE_PHASE(phase, "SegmentationModel::preprocess");
   cv::Mat resized;
   cv::resize(input.getMat(), resized, cv::Size(inputWidth_, inputHeight_));
 
-  // Normalize and convert to float CHW (Planar)
-  // This is a simplified example. Real models might need specific normalization
-  // (mean/std)
-  resized.convertTo(resized, CV_32F, 1.0f / 255.0f);
-
   // Prepare input tensor
   // ONNX Runtime expects NCHW float array
   const int area = inputHeight_ * inputWidth_;
   std::vector<float> inputTensorValues(3 * area);
-
-  // HWC to CHW
-  std::vector<cv::Mat> channels(3);
-  cv::split(resized, channels);
-  for (int c = 0; c < 3; ++c) {
-    std::memcpy(inputTensorValues.data() + c * area, channels[c].ptr<float>(),
-                area * sizeof(float));
-  }
+  PB_TRACE_BYTES(inputTensorValues.size() * sizeof(float));
+
+  // Normalize and convert to float CHW (Planar), BGR whatever the host's
+  // pixel format. This is a simplified example. Real models might need
+  // specific normalization (mean/std)
+  int order[3];
+  planeOrder(input.format(), false, order);
+  const float scale[3] = {1.0f / 255.0f, 1.0f / 255.0f, 1.0f / 255.0f};
+  const float offset[3] = {0.0f, 0.0f, 0.0f};
+  Kernels::packPlanar(resized.ptr<uint8_t>(), area, resized.channels(), order,
+                      scale, offset, inputTensorValues.data(), area);
 
   std::vector<int64_t> inputShape = {1, 3, inputHeight_, inputWidth_};
   Ort::Value inputTensor = Ort::Value::CreateTensor<float>(
@@ -47,6 +48,7 @@ SegmentationModel::process(const ImageBuffer &input) {
       inputTensorValues.size(), inputShape.data(), inputShape.size());
 
   // 2. Run Inference
+  PB_TRACE_NEXT(phase, "SegmentationModel::run");
   // Assuming 1 input and 1 output for now.
   // In production, get names from session metadata
   const char *inputNames[] = {"input"};
@@ -62,6 +64,7 @@ SegmentationModel::process(const ImageBuffer &input) {
     return nullptr;
 
   // 3. Postprocess
+  PB_TRACE_NEXT(phase, "SegmentationModel::postprocess");
   const auto &tensor = outputTensors[0];
   auto typeInfo = tensor.GetTensorTypeAndShapeInfo();
   auto shape = typeInfo.GetShape();
@@ -79,40 +82,74 @@ SegmentationModel::process(const ImageBuffer &input) {
 
   const size_t outArea = static_cast<size_t>(h * w);
   const float *floatOutput = tensor.GetTensorData<float>();
+  const SegmentationOptions options = this->options();
+  if (options.output != SegmentationOutput::Binary)
+    return softMask(options, input, floatOutput, c, h, w);
+
   std::vector<uint8_t> maskData(outArea, 0);
+  cv::Mat coarseMask(h, w, CV_8UC1, maskData.data());
 
   if (c > 1) {
     // 多通道语义分割，取 argmax 后认为非背景(>0)即前景
-    for (size_t idx = 0; idx < outArea; ++idx) {
-      int bestClass = 0;
-      float bestVal = floatOutput[idx];
-      for (int cls = 1; cls < c; ++cls) {
-        float val = floatOutput[cls * outArea + idx];
-        if (val > bestVal) {
-          bestVal = val;
-          bestClass = cls;
-        }
-      }
-      maskData[idx] = bestClass > 0 ? 255 : 0;
-    }
+    Kernels::argmaxPlanes(floatOutput, static_cast<int>(c), outArea,
+                          maskData.data());
+    cv::threshold(coarseMask, coarseMask, 0, 255, cv::THRESH_BINARY);
   } else {
     // 单通道概率，0.5 阈值
-    for (size_t idx = 0; idx < outArea; ++idx) {
-      maskData[idx] = floatOutput[idx] >= 0.5f ? 255 : 0;
-    }
+    Kernels::thresholdToMask(floatOutput, outArea, 0.5f, maskData.data());
   }
 
-  cv::Mat coarseMask(h, w, CV_8UC1, maskData.data());
-  cv::Mat finalMask;
-  cv::resize(coarseMask, finalMask, input.getMat().size(), 0, 0,
-             cv::INTER_NEAREST);
-
+  // Resize straight into the (pooled) result buffer
   auto result =
       std::make_shared<ImageBuffer>(input.getMat().cols, input.getMat().rows, 1);
-  finalMask.copyTo(result->getMat());
+  cv::resize(coarseMask, result->getMat(), input.getMat().size(), 0, 0,
+             cv::INTER_NEAREST);
 
   return result;
 }
 
+std::shared_ptr<ImageBuffer>
+SegmentationModel::softMask(const SegmentationOptions &options,
+                            const ImageBuffer &input, const float *output,
+                            int64_t c, int64_t h, int64_t w) {
+  // Foreground probability at model resolution
+  auto probability = std::make_shared<ImageBuffer>(static_cast<int>(w),
+                                                   static_cast<int>(h), 1);
+  cv::Mat &prob = probability->getMat();
+  if (c > 1) {
+    // 多通道：前景概率 = 1 - softmax 背景(通道 0)
+    const size_t area = static_cast<size_t>(h * w);
+    for (int y = 0; y < prob.rows; ++y) {
+      uint8_t *row = prob.ptr<uint8_t>(y);
+      for (int x = 0; x < prob.cols; ++x) {
+        const size_t i = static_cast<size_t>(y) * prob.cols + x;
+        // Shifted by the largest logit, so exp() neither overflows nor
+        // underflows every term
+        float top = output[i];
+        for (int64_t k = 1; k < c; ++k)
+          top = std::max(top, output[k * area + i]);
+        float sum = 0.0f;
+        for (int64_t k = 0; k < c; ++k)
+          sum += std::exp(output[k * area + i] - top);
+        const float background = std::exp(output[i] - top) / sum;
+        row[x] = cv::saturate_cast<uint8_t>(255.0f * (1.0f - background));
+      }
+    }
+  } else {
+    cv::Mat(prob.size(), CV_32FC1, const_cast<float *>(output))
+        .convertTo(prob, CV_8U, 255.0);
+  }
+  if (options.output == SegmentationOutput::Probability)
+    return probability;
+
+  PB_TRACE_SCOPE("SegmentationModel::matte");
+  const cv::Mat &img = input.getMat();
+  auto result = std::make_shared<ImageBuffer>(img.cols, img.rows, 1);
+  Processing::MaskProcessor::guidedUpsample(*probability, input, *result,
+                                            options.guidedRadius,
+                                            options.guidedEps);
+  return result;
+}
+
 } // namespace AI
 } // namespace PersonBeauty
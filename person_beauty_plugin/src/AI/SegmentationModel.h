@@ -1,10 +1,26 @@
 #pragma once
 #include "../Core/ImageBuffer.h"
 #include "InferenceEngine.h"
+#include <mutex>
 
 namespace PersonBeauty {
 namespace AI {
 
+// What process() returns, always single channel 0-255
+enum class SegmentationOutput {
+  Binary,      // Hard mask at the input size (nearest-neighbour upsample)
+  Probability, // Soft foreground probability at the model's output size
+  Matte        // Probability upsampled along the input's edges (guided
+               // filter): an alpha matte that needs no feathering
+};
+
+struct SegmentationOptions {
+  SegmentationOutput output = SegmentationOutput::Binary;
+  // Guided filter of Matte, see MaskProcessor::guidedUpsample
+  int guidedRadius = 4;
+  float guidedEps = 1e-3f;
+};
+
 class SegmentationModel {
 public:
   SegmentationModel();
@@ -12,13 +28,32 @@ public:
 
   bool load(const std::string &modelPath);
 
+  // May be called while process() runs; a call in progress keeps the
+  // options it started with
+  void setOptions(const SegmentationOptions &options) {
+    std::lock_guard<std::mutex> lock(optionsMutex_);
+    options_ = options;
+  }
+  SegmentationOptions options() const {
+    std::lock_guard<std::mutex> lock(optionsMutex_);
+    return options_;
+  }
+
   // Process input image and return memory buffer with mask
   // Input is assumed to be BGR (OpenCV default)
-  // Output is single channel 0-255 mask
+  // Output is single channel 0-255 mask, see SegmentationOutput
   std::shared_ptr<ImageBuffer> process(const ImageBuffer &input);
 
 private:
+  // Probability / Matte output from the raw [1, c, h, w] or [1, h, w] output
+  std::shared_ptr<ImageBuffer> softMask(const SegmentationOptions &options,
+                                        const ImageBuffer &input,
+                                        const float *output, int64_t c,
+                                        int64_t h, int64_t w);
+
   InferenceEngine engine_;
+  mutable std::mutex optionsMutex_;
+  SegmentationOptions options_;
   int inputWidth_ = 256; // Default, should be read from model
   int inputHeight_ = 256;
 };
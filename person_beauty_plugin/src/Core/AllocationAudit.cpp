@@ -0,0 +1,108 @@
+#include "AllocationAudit.h"
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <opencv2/core.hpp>
+
+namespace PersonBeauty {
+
+namespace {
+
+// Plain integers only: these are touched from inside operator new
+thread_local int tlsDepth = 0;
+thread_local uint64_t tlsCount = 0;
+thread_local uint64_t tlsBytes = 0;
+
+std::atomic<bool> gInstalled{false};
+
+class CountingMatAllocator : public cv::MatAllocator {
+public:
+  explicit CountingMatAllocator(cv::MatAllocator *base) : base_(base) {}
+
+  cv::UMatData *allocate(int dims, const int *sizes, int type, void *data,
+                         size_t *step, cv::AccessFlag flags,
+                         cv::UMatUsageFlags usageFlags) const override {
+    cv::UMatData *u =
+        base_->allocate(dims, sizes, type, data, step, flags, usageFlags);
+    if (u && !data)
+      AllocationAudit::record(u->size);
+    return u;
+  }
+
+  bool allocate(cv::UMatData *u, cv::AccessFlag accessFlags,
+                cv::UMatUsageFlags usageFlags) const override {
+    return base_->allocate(u, accessFlags, usageFlags);
+  }
+
+  void deallocate(cv::UMatData *u) const override { base_->deallocate(u); }
+
+private:
+  cv::MatAllocator *base_;
+};
+
+} // namespace
+
+void AllocationAudit::install() {
+  static std::once_flag once;
+  std::call_once(once, []() {
+    // Never destroyed: Mats may outlive static destruction
+    auto *allocator = new CountingMatAllocator(cv::Mat::getDefaultAllocator());
+    cv::Mat::setDefaultAllocator(allocator);
+    gInstalled = true;
+  });
+}
+
+bool AllocationAudit::isInstalled() { return gInstalled; }
+
+void AllocationAudit::record(size_t bytes) {
+  if (tlsDepth == 0)
+    return;
+  tlsCount += 1;
+  tlsBytes += bytes;
+}
+
+AllocationAudit::Scope::Scope(const char *label) : label_(label) {
+  start_.count = tlsCount;
+  start_.bytes = tlsBytes;
+  ++tlsDepth;
+}
+
+AllocationAudit::Scope::~Scope() {
+  --tlsDepth;
+  AllocationStats s = stats();
+  if (s.count > 0) {
+    std::cerr << "[Audit] " << label_ << ": " << s.count
+              << " heap allocations (" << s.bytes / 1024 << " KB)"
+              << std::endl;
+  }
+}
+
+AllocationStats AllocationAudit::Scope::stats() const {
+  AllocationStats s;
+  s.count = tlsCount - start_.count;
+  s.bytes = tlsBytes - start_.bytes;
+  return s;
+}
+
+} // namespace PersonBeauty
+
+#ifdef PERSON_BEAUTY_ALLOC_AUDIT
+// Replaces the global allocation function for the whole program. The other
+// forms (array, nothrow) and the default operator delete forward to
+// malloc/free in the standard library, so they stay consistent with this.
+void *operator new(std::size_t size) {
+  PersonBeauty::AllocationAudit::record(size);
+  if (size == 0)
+    size = 1;
+  for (;;) {
+    if (void *p = std::malloc(size))
+      return p;
+    std::new_handler handler = std::get_new_handler();
+    if (!handler)
+      throw std::bad_alloc();
+    handler();
+  }
+}
+#endif
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace PersonBeauty {
+
+struct AllocationStats {
+  uint64_t count = 0;
+  uint64_t bytes = 0;
+};
+
+// Audit mode for the steady-state hot path: counts heap allocations made on
+// the current thread while a Scope is open and reports them when it closes.
+// cv::Mat buffers are counted once install() has routed them through a
+// counting allocator; plain operator new is counted as well when built with
+// PERSON_BEAUTY_ALLOC_AUDIT. Work that OpenCV hands to other threads is not
+// attributed to the scope.
+class AllocationAudit {
+public:
+  // Wrap OpenCV's default Mat allocator. Call once at startup.
+  static void install();
+  static bool isInstalled();
+
+  // Called by the allocation hooks; counts only inside a Scope
+  static void record(size_t bytes);
+
+  class Scope {
+  public:
+    // `label` must outlive the scope; it is printed if anything allocated
+    explicit Scope(const char *label);
+    ~Scope();
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+    AllocationStats stats() const;
+
+  private:
+    const char *label_;
+    AllocationStats start_;
+  };
+};
+
+} // namespace PersonBeauty
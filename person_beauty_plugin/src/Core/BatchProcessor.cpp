@@ -0,0 +1,198 @@
+#include "BatchProcessor.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace PersonBeauty {
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+static bool isImageFile(const fs::path &path) {
+  std::string ext = path.extension().string();
+  std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+  return ext == ".jpg" || ext == ".jpeg" || ext == ".png" || ext == ".bmp" ||
+         ext == ".tif" || ext == ".tiff" || ext == ".webp";
+}
+
+// Deepest directory containing every path
+static fs::path commonParent(const std::vector<fs::path> &paths) {
+  fs::path common = paths.front().parent_path();
+  for (const auto &path : paths) {
+    const fs::path dir = path.parent_path();
+    fs::path shared;
+    for (auto a = common.begin(), b = dir.begin();
+         a != common.end() && b != dir.end() && *a == *b; ++a, ++b)
+      shared /= *a;
+    common = shared;
+  }
+  return common;
+}
+
+static double percentile(const std::vector<double> &sorted, double p) {
+  if (sorted.empty())
+    return 0.0;
+  // Nearest-rank
+  size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+  return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+BatchProcessor::BatchProcessor(ThreadPool &pool, ProcessFn process)
+    : pool_(pool), process_(std::move(process)) {
+  decode_ = [](const BatchJob &job, ImageBuffer &image) {
+    image = ImageIO::read(job.inputPath);
+    return !image.getMat().empty();
+  };
+  setEncodeOptions(EncodeOptions());
+}
+
+void BatchProcessor::setEncodeOptions(const EncodeOptions &options) {
+  encode_ = [options](const BatchJob &job, const ImageBuffer &image) {
+    return ImageIO::save(job.outputPath, image, options);
+  };
+}
+
+BatchStats BatchProcessor::run(const std::vector<BatchJob> &jobs) {
+  struct State {
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t inFlight = 0;
+    std::vector<double> latenciesMs;
+    size_t failed = 0;
+  };
+  auto state = std::make_shared<State>();
+  state->latenciesMs.reserve(jobs.size());
+
+  auto finish = [state](const BatchJob &job, bool ok, Clock::time_point t0) {
+    double ms =
+        std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+    if (!ok)
+      std::cerr << "[Error] Batch: failed to process " << job.inputPath
+                << std::endl;
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (ok)
+      state->latenciesMs.push_back(ms);
+    else
+      ++state->failed;
+    --state->inFlight;
+    state->cv.notify_all();
+  };
+
+  const size_t maxInFlight =
+      maxInFlight_ > 0 ? maxInFlight_ : std::max<size_t>(2, pool_.size() * 2);
+  auto start = Clock::now();
+
+  for (const auto &job : jobs) {
+    {
+      std::unique_lock<std::mutex> lock(state->mutex);
+      state->cv.wait(lock, [&]() { return state->inFlight < maxInFlight; });
+      ++state->inFlight;
+    }
+
+    pool_.enqueue([this, job, finish]() {
+      auto t0 = Clock::now();
+      auto image = std::make_shared<ImageBuffer>();
+      if (!decode_(job, *image)) {
+        finish(job, false, t0);
+        return;
+      }
+      pool_.enqueue([this, job, finish, t0, image]() {
+        if (!process_(*image)) {
+          finish(job, false, t0);
+          return;
+        }
+        pool_.enqueue([this, job, finish, t0, image]() {
+          finish(job, encode_(job, *image), t0);
+        });
+      });
+    });
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cv.wait(lock, [&]() { return state->inFlight == 0; });
+  }
+
+  BatchStats stats;
+  stats.seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  stats.succeeded = state->latenciesMs.size();
+  stats.failed = state->failed;
+  if (stats.seconds > 0.0)
+    stats.imagesPerSecond = stats.succeeded / stats.seconds;
+
+  std::vector<double> sorted = state->latenciesMs;
+  std::sort(sorted.begin(), sorted.end());
+  stats.p50Ms = percentile(sorted, 0.50);
+  stats.p95Ms = percentile(sorted, 0.95);
+  stats.p99Ms = percentile(sorted, 0.99);
+  return stats;
+}
+
+std::vector<BatchJob>
+BatchProcessor::jobsFromDirectory(const std::string &inputDir,
+                                  const std::string &outputDir) {
+  std::vector<BatchJob> jobs;
+  std::error_code ec;
+  fs::create_directories(outputDir, ec);
+  for (const auto &entry : fs::directory_iterator(inputDir, ec)) {
+    if (!entry.is_regular_file() || !isImageFile(entry.path()))
+      continue;
+    jobs.push_back({entry.path().string(),
+                    (fs::path(outputDir) / entry.path().filename()).string()});
+  }
+  if (ec)
+    std::cerr << "[Error] Batch: cannot read " << inputDir << ": "
+              << ec.message() << std::endl;
+  // Deterministic order regardless of the file system
+  std::sort(jobs.begin(), jobs.end(), [](const BatchJob &a, const BatchJob &b) {
+    return a.inputPath < b.inputPath;
+  });
+  return jobs;
+}
+
+std::vector<BatchJob>
+BatchProcessor::jobsFromList(const std::string &listFile,
+                             const std::string &outputDir) {
+  std::vector<BatchJob> jobs;
+  std::ifstream in(listFile);
+  if (!in) {
+    std::cerr << "[Error] Batch: cannot open " << listFile << std::endl;
+    return jobs;
+  }
+  std::vector<std::string> inputs;
+  std::vector<fs::path> paths;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    if (line.empty() || line[0] == '#')
+      continue;
+    std::error_code ec;
+    fs::path path = fs::absolute(line, ec).lexically_normal();
+    if (std::find(paths.begin(), paths.end(), path) != paths.end()) {
+      std::cerr << "[Error] Batch: " << line << " is listed twice" << std::endl;
+      continue;
+    }
+    inputs.push_back(line);
+    paths.push_back(std::move(path));
+  }
+  if (paths.empty())
+    return jobs;
+
+  // Outputs mirror the inputs' paths below their common directory, so equal
+  // file names from different directories do not overwrite each other
+  const fs::path root = commonParent(paths);
+  for (size_t i = 0; i < paths.size(); ++i) {
+    fs::path output = fs::path(outputDir) / paths[i].lexically_relative(root);
+    std::error_code ec;
+    fs::create_directories(output.parent_path(), ec);
+    jobs.push_back({inputs[i], output.string()});
+  }
+  return jobs;
+}
+
+} // namespace PersonBeauty
@@ -0,0 +1,71 @@
+#pragma once
+#include "ImageBuffer.h"
+#include "ImageIO.h"
+#include "ThreadPool.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace PersonBeauty {
+
+struct BatchJob {
+  std::string inputPath;
+  std::string outputPath;
+};
+
+struct BatchStats {
+  size_t succeeded = 0;
+  size_t failed = 0;
+  double seconds = 0.0;
+  double imagesPerSecond = 0.0;
+  // Per-image latency (decode start to encode end) in milliseconds
+  double p50Ms = 0.0;
+  double p95Ms = 0.0;
+  double p99Ms = 0.0;
+};
+
+// Offline batch processing on a work-stealing ThreadPool.
+// Every image is split into decode -> process -> encode tasks. A finished
+// stage enqueues the next one on the same worker, while idle workers steal
+// decodes of later images, so I/O and processing of different images
+// overlap. The number of images held in memory is bounded by maxInFlight.
+// The process function is shared by all workers (and with it any loaded
+// models), so it must be safe to call concurrently.
+class BatchProcessor {
+public:
+  using DecodeFn = std::function<bool(const BatchJob &, ImageBuffer &)>;
+  using ProcessFn = std::function<bool(ImageBuffer &)>;
+  using EncodeFn = std::function<bool(const BatchJob &, const ImageBuffer &)>;
+
+  BatchProcessor(ThreadPool &pool, ProcessFn process);
+
+  // Defaults are ImageIO::read / ImageIO::save
+  void setDecoder(DecodeFn decode) { decode_ = std::move(decode); }
+  void setEncoder(EncodeFn encode) { encode_ = std::move(encode); }
+  // Use the default encoder with these quality/format options
+  void setEncodeOptions(const EncodeOptions &options);
+  // 0 means twice the pool size
+  void setMaxInFlight(size_t images) { maxInFlight_ = images; }
+
+  BatchStats run(const std::vector<BatchJob> &jobs);
+
+  // All images directly inside inputDir, written under the same file name
+  // into outputDir
+  static std::vector<BatchJob> jobsFromDirectory(const std::string &inputDir,
+                                                 const std::string &outputDir);
+  // One input path per line. Outputs keep the inputs' paths relative to the
+  // deepest directory they all share, e.g. a/x.jpg and b/x.jpg are written
+  // to outputDir/a/x.jpg and outputDir/b/x.jpg; inputs listed twice are
+  // skipped.
+  static std::vector<BatchJob> jobsFromList(const std::string &listFile,
+                                            const std::string &outputDir);
+
+private:
+  ThreadPool &pool_;
+  DecodeFn decode_;
+  ProcessFn process_;
+  EncodeFn encode_;
+  size_t maxInFlight_ = 0;
+};
+
+} // namespace PersonBeauty
@@ -0,0 +1,129 @@
+#include "BufferPool.h"
+#include "Trace.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace PersonBeauty {
+
+namespace {
+thread_local BufferPool *tlsCurrent = nullptr;
+
+// Idle bytes all per-thread default pools may keep together, so batches of
+// mixed sizes do not grow without bound. Each thread gets an equal share.
+constexpr size_t kDefaultPoolsBudget = size_t(2) << 30;
+
+std::atomic<size_t> gDefaultPoolThreads{
+    std::max(1u, std::thread::hardware_concurrency()) + size_t(1)};
+
+size_t threadPoolCapacity() {
+  return kDefaultPoolsBudget / gDefaultPoolThreads.load();
+}
+} // namespace
+
+bool BufferPool::isIdle(const cv::Mat &mat) {
+  // The pool's own header is the only reference left. Other threads may
+  // drop references concurrently, so read the count atomically.
+  return mat.u && CV_XADD(&mat.u->refcount, 0) == 1;
+}
+
+cv::Mat BufferPool::acquire(cv::Size size, int type) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++clock_;
+  for (auto &entry : entries_) {
+    const cv::Mat &m = entry.mat;
+    if (m.cols == size.width && m.rows == size.height && m.type() == type &&
+        isIdle(m)) {
+      entry.lastUse = clock_;
+      ++hits_;
+      return m;
+    }
+  }
+
+  ++misses_;
+  size_t bytes = static_cast<size_t>(size.area()) * CV_ELEM_SIZE(type);
+  if (capacity_ > 0)
+    evictIdle(capacity_ > bytes ? capacity_ - bytes : 0);
+
+  Entry entry;
+  entry.mat.create(size, type);
+  entry.lastUse = clock_;
+  PB_TRACE_BYTES(bytes);
+  entries_.push_back(entry);
+  return entries_.back().mat;
+}
+
+void BufferPool::evictIdle(size_t targetBytes) {
+  size_t held = 0;
+  for (const auto &entry : entries_)
+    held += entry.mat.total() * entry.mat.elemSize();
+  if (held <= targetBytes)
+    return;
+
+  // Least recently used idle buffers go first
+  std::vector<size_t> order(entries_.size());
+  for (size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return entries_[a].lastUse < entries_[b].lastUse;
+  });
+
+  std::vector<bool> drop(entries_.size(), false);
+  for (size_t i : order) {
+    if (held <= targetBytes)
+      break;
+    if (!isIdle(entries_[i].mat))
+      continue;
+    held -= entries_[i].mat.total() * entries_[i].mat.elemSize();
+    drop[i] = true;
+  }
+
+  size_t out = 0;
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    if (!drop[i])
+      entries_[out++] = std::move(entries_[i]);
+  }
+  entries_.resize(out);
+}
+
+void BufferPool::trim() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  evictIdle(0);
+}
+
+size_t BufferPool::bytesHeld() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t held = 0;
+  for (const auto &entry : entries_)
+    held += entry.mat.total() * entry.mat.elemSize();
+  return held;
+}
+
+size_t BufferPool::hits() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return hits_;
+}
+
+size_t BufferPool::misses() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return misses_;
+}
+
+void BufferPool::setDefaultPoolThreads(size_t threads) {
+  gDefaultPoolThreads = std::max<size_t>(threads, 1);
+}
+
+BufferPool &BufferPool::current() {
+  if (tlsCurrent)
+    return *tlsCurrent;
+  thread_local BufferPool threadPool(threadPoolCapacity());
+  return threadPool;
+}
+
+BufferPool::Scope::Scope(BufferPool &pool) : previous_(tlsCurrent) {
+  tlsCurrent = &pool;
+}
+
+BufferPool::Scope::~Scope() { tlsCurrent = previous_; }
+
+} // namespace PersonBeauty
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <opencv2/core.hpp>
+#include <vector>
+
+namespace PersonBeauty {
+
+// Recycles full-frame scratch buffers so steady-state processing does not
+// allocate. acquire() hands out a cv::Mat that shares data with a buffer the
+// pool keeps; the buffer becomes reusable as soon as every handed-out header
+// (including copies stored in ImageBuffers) is released, so callers simply
+// let their Mats go out of scope.
+class BufferPool {
+public:
+  // `capacity`: see setCapacity()
+  explicit BufferPool(size_t capacity = 0) : capacity_(capacity) {}
+  ~BufferPool() = default;
+  BufferPool(const BufferPool &) = delete;
+  BufferPool &operator=(const BufferPool &) = delete;
+
+  // Uninitialized buffer of exactly this size and type
+  cv::Mat acquire(cv::Size size, int type);
+  cv::Mat acquire(int rows, int cols, int type) {
+    return acquire(cv::Size(cols, rows), type);
+  }
+
+  // Idle buffers beyond this many bytes are freed on the next miss
+  // (0 = unlimited)
+  void setCapacity(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    capacity_ = bytes;
+  }
+  // Free every idle buffer
+  void trim();
+
+  size_t bytesHeld() const;
+  size_t hits() const;
+  size_t misses() const;
+
+  // Pool used by ImageBuffer and the Processing engines on this thread:
+  // the innermost active Scope's pool, otherwise a per-thread default. The
+  // defaults share a 2 GB budget of idle buffers, split evenly over
+  // setDefaultPoolThreads() threads.
+  static BufferPool &current();
+
+  // Threads the default pools' budget is split over; the TaskScheduler
+  // sets its workers plus one when it starts. Defaults created before keep
+  // their share (hardware threads plus one).
+  static void setDefaultPoolThreads(size_t threads);
+
+  // Makes `pool` current on this thread for the lifetime of the scope,
+  // e.g. one pool per frame / per worker
+  class Scope {
+  public:
+    explicit Scope(BufferPool &pool);
+    ~Scope();
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    BufferPool *previous_;
+  };
+
+private:
+  struct Entry {
+    cv::Mat mat;
+    uint64_t lastUse = 0;
+  };
+
+  static bool isIdle(const cv::Mat &mat);
+  void evictIdle(size_t targetBytes);
+
+  mutable std::mutex mutex_;
+  std::vector<Entry> entries_;
+  size_t capacity_ = 0;
+  size_t hits_ = 0;
+  size_t misses_ = 0;
+  uint64_t clock_ = 0;
+};
+
+} // namespace PersonBeauty
@@ -0,0 +1,129 @@
+#include "CpuFeatures.h"
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) ||            \
+    defined(_M_IX86)
+#define PERSON_BEAUTY_X86 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace PersonBeauty {
+
+namespace {
+
+#ifdef PERSON_BEAUTY_X86
+void cpuid(unsigned leaf, unsigned subleaf, unsigned regs[4]) {
+#ifdef _MSC_VER
+  int r[4];
+  __cpuidex(r, static_cast<int>(leaf), static_cast<int>(subleaf));
+  for (int i = 0; i < 4; ++i)
+    regs[i] = static_cast<unsigned>(r[i]);
+#else
+  __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+uint64_t xgetbv0() {
+#ifdef _MSC_VER
+  return _xgetbv(0);
+#else
+  uint32_t lo, hi;
+  __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+  return (static_cast<uint64_t>(hi) << 32) | lo;
+#endif
+}
+#endif
+
+CpuLevel detect() {
+#ifdef PERSON_BEAUTY_X86
+  unsigned regs[4];
+  cpuid(0, 0, regs);
+  const unsigned maxLeaf = regs[0];
+  if (maxLeaf < 7)
+    return CpuLevel::Baseline;
+
+  cpuid(1, 0, regs);
+  const bool osxsave = regs[2] & (1u << 27);
+  const bool avx = regs[2] & (1u << 28);
+  const bool fma = regs[2] & (1u << 12);
+  const bool f16c = regs[2] & (1u << 29);
+  if (!osxsave || !avx)
+    return CpuLevel::Baseline;
+
+  // The OS must save the YMM (and for AVX-512 the ZMM / opmask) state
+  const uint64_t xcr0 = xgetbv0();
+  const bool ymmState = (xcr0 & 0x6) == 0x6;
+  const bool zmmState = (xcr0 & 0xe6) == 0xe6;
+
+  cpuid(7, 0, regs);
+  const bool avx2 = regs[1] & (1u << 5);
+  const bool avx512f = regs[1] & (1u << 16);
+  const bool avx512bw = regs[1] & (1u << 30);
+  const bool avx512vl = regs[1] & (1u << 31);
+
+  if (!ymmState || !avx2 || !fma || !f16c)
+    return CpuLevel::Baseline;
+  if (zmmState && avx512f && avx512bw && avx512vl)
+    return CpuLevel::AVX512;
+  return CpuLevel::AVX2;
+#else
+  return CpuLevel::Baseline;
+#endif
+}
+
+} // namespace
+
+CpuLevel CpuFeatures::detected() {
+  static const CpuLevel level = detect();
+  return level;
+}
+
+CpuLevel CpuFeatures::active() {
+  static const CpuLevel level = []() {
+    CpuLevel best = detected();
+    const char *env = std::getenv("PERSON_BEAUTY_CPU_LEVEL");
+    if (!env || !*env)
+      return best;
+
+    std::string value = env;
+    CpuLevel requested;
+    if (value == "baseline" || value == "scalar")
+      requested = CpuLevel::Baseline;
+    else if (value == "avx2")
+      requested = CpuLevel::AVX2;
+    else if (value == "avx512")
+      requested = CpuLevel::AVX512;
+    else {
+      std::cerr << "[Warning] Unknown PERSON_BEAUTY_CPU_LEVEL: " << value
+                << std::endl;
+      return best;
+    }
+    if (requested > best) {
+      std::cerr << "[Warning] PERSON_BEAUTY_CPU_LEVEL=" << value
+                << " not supported here, using " << name(best) << std::endl;
+      return best;
+    }
+    return requested;
+  }();
+  return level;
+}
+
+const char *CpuFeatures::name(CpuLevel level) {
+  switch (level) {
+  case CpuLevel::AVX2:
+    return "avx2";
+  case CpuLevel::AVX512:
+    return "avx512";
+  default:
+    return "baseline";
+  }
+}
+
+} // namespace PersonBeauty
@@ -0,0 +1,25 @@
+#pragma once
+
+namespace PersonBeauty {
+
+// Instruction-set levels our multi-versioned kernels are built for
+enum class CpuLevel {
+  Baseline = 0, // Whatever the compiler targets by default (SSE2 on x86-64)
+  AVX2 = 1,     // AVX2 + FMA + F16C
+  AVX512 = 2    // AVX-512 F/BW/VL
+};
+
+class CpuFeatures {
+public:
+  // Best level supported by both the CPU (CPUID) and the OS (XSAVE state)
+  static CpuLevel detected();
+
+  // Level the kernels dispatch to: detected(), capped by the
+  // PERSON_BEAUTY_CPU_LEVEL environment variable (baseline|avx2|avx512)
+  // for testing the slower paths on a fast machine
+  static CpuLevel active();
+
+  static const char *name(CpuLevel level);
+};
+
+} // namespace PersonBeauty
@@ -1,27 +1,158 @@
 #pragma once
+#include "BufferPool.h"
+#include "Trace.h"
+#include <cstddef>
+#include <functional>
 #include <memory>
 #include <opencv2/opencv.hpp>
 
 namespace PersonBeauty {
 
+// 8-bit pixel layouts exchanged with host applications
+enum class PixelFormat { Gray8, BGR8, RGB8, BGRA8, RGBA8 };
+
+inline int channelCount(PixelFormat format) {
+  switch (format) {
+  case PixelFormat::Gray8:
+    return 1;
+  case PixelFormat::BGR8:
+  case PixelFormat::RGB8:
+    return 3;
+  default:
+    return 4;
+  }
+}
+
+// cv::cvtColor codes from `format` to 3-channel BGR / RGB and to gray;
+// -1 when the pixels are already in that layout
+inline int toBGRCode(PixelFormat format) {
+  switch (format) {
+  case PixelFormat::Gray8:
+    return cv::COLOR_GRAY2BGR;
+  case PixelFormat::RGB8:
+    return cv::COLOR_RGB2BGR;
+  case PixelFormat::BGRA8:
+    return cv::COLOR_BGRA2BGR;
+  case PixelFormat::RGBA8:
+    return cv::COLOR_RGBA2BGR;
+  default:
+    return -1;
+  }
+}
+
+inline int toRGBCode(PixelFormat format) {
+  switch (format) {
+  case PixelFormat::Gray8:
+    return cv::COLOR_GRAY2RGB;
+  case PixelFormat::BGR8:
+    return cv::COLOR_BGR2RGB;
+  case PixelFormat::BGRA8:
+    return cv::COLOR_BGRA2RGB;
+  case PixelFormat::RGBA8:
+    return cv::COLOR_RGBA2RGB;
+  default:
+    return -1;
+  }
+}
+
+inline int toGrayCode(PixelFormat format) {
+  switch (format) {
+  case PixelFormat::BGR8:
+    return cv::COLOR_BGR2GRAY;
+  case PixelFormat::RGB8:
+    return cv::COLOR_RGB2GRAY;
+  case PixelFormat::BGRA8:
+    return cv::COLOR_BGRA2GRAY;
+  case PixelFormat::RGBA8:
+    return cv::COLOR_RGBA2GRAY;
+  default:
+    return -1;
+  }
+}
+
+// cv::cvtColor code from 3-channel BGR (what imdecode returns) to `format`;
+// -1 for BGR8
+inline int fromBGRCode(PixelFormat format) {
+  switch (format) {
+  case PixelFormat::Gray8:
+    return cv::COLOR_BGR2GRAY;
+  case PixelFormat::RGB8:
+    return cv::COLOR_BGR2RGB;
+  case PixelFormat::BGRA8:
+    return cv::COLOR_BGR2BGRA;
+  case PixelFormat::RGBA8:
+    return cv::COLOR_BGR2RGBA;
+  default:
+    return -1;
+  }
+}
+
+// Source channel of each output plane, in B,G,R or (rgb) R,G,B order, as
+// taken by Kernels::packPlanar
+inline void planeOrder(PixelFormat format, bool rgb, int order[3]) {
+  if (format == PixelFormat::Gray8) {
+    order[0] = order[1] = order[2] = 0;
+    return;
+  }
+  bool swap =
+      rgb != (format == PixelFormat::RGB8 || format == PixelFormat::RGBA8);
+  order[0] = swap ? 2 : 0;
+  order[1] = 1;
+  order[2] = swap ? 0 : 2;
+}
+
 class ImageBuffer {
 public:
   ImageBuffer() {}
-  ImageBuffer(const cv::Mat &mat) : data(mat) {}
-  ImageBuffer(int width, int height, int channels = 3) {
-    int type = CV_8UC3;
-    if (channels == 1)
-      type = CV_8UC1;
-    else if (channels == 4)
-      type = CV_8UC4;
-    data = cv::Mat(height, width, type);
+  // Shares the Mat's pixels; 3/4-channel Mats are taken as BGR/BGRA
+  ImageBuffer(const cv::Mat &mat)
+      : data(mat), format_(formatFor(mat.channels())) {}
+  ImageBuffer(const cv::Mat &mat, PixelFormat format)
+      : data(mat), format_(format) {}
+  // Storage comes from the thread's current BufferPool and returns to it
+  // once the last copy of this buffer is released
+  ImageBuffer(int width, int height, int channels = 3)
+      : ImageBuffer(width, height, formatFor(channels)) {}
+  ImageBuffer(int width, int height, PixelFormat format) : format_(format) {
+    data = BufferPool::current().acquire(height, width,
+                                         CV_8UC(channelCount(format)));
+  }
+
+  // Wrap host-owned pixels without copying. `stride` is the row pitch in
+  // bytes (0 = tightly packed). `release`, if set, runs when the last
+  // ImageBuffer sharing these pixels is destroyed; cv::Mat headers taken
+  // from getMat() do not keep the memory alive on their own.
+  static ImageBuffer wrap(void *pixels, int width, int height, size_t stride,
+                          PixelFormat format,
+                          std::function<void()> release = {}) {
+    ImageBuffer buffer;
+    const size_t step =
+        stride > 0 ? stride : static_cast<size_t>(cv::Mat::AUTO_STEP);
+    buffer.data = cv::Mat(height, width, CV_8UC(channelCount(format)), pixels,
+                          step);
+    buffer.format_ = format;
+    if (release) {
+      buffer.owner_ = std::shared_ptr<void>(
+          nullptr, [release = std::move(release)](void *) { release(); });
+    }
+    return buffer;
   }
 
   cv::Mat &getMat() { return data; }
   const cv::Mat &getMat() const { return data; }
 
+  PixelFormat format() const { return format_; }
+
 private:
+  static PixelFormat formatFor(int channels) {
+    if (channels == 1)
+      return PixelFormat::Gray8;
+    return channels == 4 ? PixelFormat::BGRA8 : PixelFormat::BGR8;
+  }
+
   cv::Mat data;
+  PixelFormat format_ = PixelFormat::BGR8;
+  std::shared_ptr<void> owner_; // Keeps wrapped host memory alive
 };
 
 } // namespace PersonBeauty
@@ -0,0 +1,231 @@
+#include "ImageIO.h"
+#include "TaskScheduler.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <opencv2/opencv.hpp>
+
+namespace PersonBeauty {
+
+namespace {
+
+struct JpegHeader {
+  int width = 0;
+  int height = 0;
+  int orientation = 1; // EXIF, 1-8
+};
+
+uint16_t read16(const uint8_t *p, bool bigEndian) {
+  return bigEndian ? static_cast<uint16_t>(p[0] << 8 | p[1])
+                   : static_cast<uint16_t>(p[1] << 8 | p[0]);
+}
+
+uint32_t read32(const uint8_t *p, bool bigEndian) {
+  return bigEndian ? static_cast<uint32_t>(read16(p, true)) << 16 |
+                         read16(p + 2, true)
+                   : static_cast<uint32_t>(read16(p + 2, false)) << 16 |
+                         read16(p, false);
+}
+
+// Orientation tag of IFD0 in an APP1 "Exif" payload
+int exifOrientation(const uint8_t *data, size_t size) {
+  if (size < 14 || std::memcmp(data, "Exif\0\0", 6) != 0)
+    return 1;
+  const uint8_t *tiff = data + 6;
+  const size_t tiffSize = size - 6;
+  const bool bigEndian = tiff[0] == 'M';
+  const uint32_t ifd = read32(tiff + 4, bigEndian);
+  if (ifd + 2 > tiffSize)
+    return 1;
+  const uint16_t count = read16(tiff + ifd, bigEndian);
+  for (uint16_t i = 0; i < count; ++i) {
+    const size_t entry = ifd + 2 + size_t(12) * i;
+    if (entry + 12 > tiffSize)
+      break;
+    if (read16(tiff + entry, bigEndian) == 0x0112) {
+      const int value = read16(tiff + entry + 8, bigEndian);
+      return value >= 1 && value <= 8 ? value : 1;
+    }
+  }
+  return 1;
+}
+
+// Walk the markers up to the first scan: frame size from SOFn, orientation
+// from APP1
+bool readJpegHeader(const std::vector<uint8_t> &bytes, JpegHeader &header) {
+  const uint8_t *data = bytes.data();
+  const size_t size = bytes.size();
+  if (size < 4 || data[0] != 0xFF || data[1] != 0xD8)
+    return false;
+  size_t pos = 2;
+  while (pos + 4 <= size) {
+    if (data[pos] != 0xFF)
+      return false;
+    const uint8_t marker = data[pos + 1];
+    if (marker == 0xFF) { // Fill byte
+      ++pos;
+      continue;
+    }
+    if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+      pos += 2; // No length
+      continue;
+    }
+    if (marker == 0xDA || marker == 0xD9)
+      break;
+    const size_t length = read16(data + pos + 2, true);
+    if (length < 2 || pos + 2 + length > size)
+      return false;
+    const uint8_t *segment = data + pos + 4;
+    const bool isSof = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 &&
+                       marker != 0xC8 && marker != 0xCC;
+    if (isSof && length >= 7) {
+      header.height = read16(segment + 1, true);
+      header.width = read16(segment + 3, true);
+    } else if (marker == 0xE1) {
+      const int orientation = exifOrientation(segment, length - 2);
+      if (orientation != 1)
+        header.orientation = orientation;
+    }
+    pos += 2 + length;
+  }
+  return header.width > 0 && header.height > 0;
+}
+
+int decodeFlags(int color, const DecodeOptions &options) {
+  return options.applyOrientation ? color
+                                  : color | cv::IMREAD_IGNORE_ORIENTATION;
+}
+
+cv::Mat wrapBytes(const std::vector<uint8_t> &bytes) {
+  return cv::Mat(1, static_cast<int>(bytes.size()), CV_8UC1,
+                 const_cast<uint8_t *>(bytes.data()));
+}
+
+} // namespace
+
+std::shared_ptr<const std::vector<uint8_t>>
+ImageIO::readFile(const std::string &path) {
+  PB_TRACE_SCOPE("ImageIO::readFile");
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file) {
+    std::cerr << "[Error] ImageIO: cannot open " << path << std::endl;
+    return nullptr;
+  }
+  auto bytes = std::make_shared<std::vector<uint8_t>>(
+      static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  if (!file.read(reinterpret_cast<char *>(bytes->data()),
+                 static_cast<std::streamsize>(bytes->size()))) {
+    std::cerr << "[Error] ImageIO: cannot read " << path << std::endl;
+    return nullptr;
+  }
+  return bytes;
+}
+
+cv::Size ImageIO::imageSize(const std::vector<uint8_t> &bytes,
+                            const DecodeOptions &options) {
+  JpegHeader header;
+  if (!readJpegHeader(bytes, header))
+    return cv::Size();
+  // Orientations 5-8 transpose the image
+  if (options.applyOrientation && header.orientation >= 5)
+    return cv::Size(header.height, header.width);
+  return cv::Size(header.width, header.height);
+}
+
+int ImageIO::reducedScale(const std::vector<uint8_t> &bytes, int minSide) {
+  const cv::Size size = imageSize(bytes);
+  const int longSide = std::max(size.width, size.height);
+  int scale = 1;
+  while (scale < 8 && longSide / (scale * 2) >= minSide)
+    scale *= 2;
+  return scale;
+}
+
+ImageBuffer ImageIO::decode(const std::vector<uint8_t> &bytes,
+                            const DecodeOptions &options) {
+  PB_TRACE_SCOPE("ImageIO::decode");
+  // Known size: decode into a pooled buffer instead of a fresh allocation.
+  // The decoder fills the stored size; orientations that transpose the
+  // image still allocate once more.
+  DecodeOptions stored;
+  stored.applyOrientation = false;
+  const cv::Size size = imageSize(bytes, stored);
+  ImageBuffer image;
+  if (!size.empty())
+    image = ImageBuffer(size.width, size.height, PixelFormat::BGR8);
+  cv::imdecode(wrapBytes(bytes), decodeFlags(cv::IMREAD_COLOR, options),
+               &image.getMat());
+  if (image.getMat().empty()) {
+    std::cerr << "[Error] ImageIO: cannot decode image" << std::endl;
+    return ImageBuffer();
+  }
+  return image;
+}
+
+AnalysisImage ImageIO::decodeReduced(const std::vector<uint8_t> &bytes,
+                                     int scale,
+                                     const DecodeOptions &options) {
+  PB_TRACE_SCOPE("ImageIO::decodeReduced");
+  const int color = scale >= 8   ? cv::IMREAD_REDUCED_COLOR_8
+                    : scale >= 4 ? cv::IMREAD_REDUCED_COLOR_4
+                    : scale >= 2 ? cv::IMREAD_REDUCED_COLOR_2
+                                 : cv::IMREAD_COLOR;
+  AnalysisImage result;
+  result.image = ImageBuffer(
+      cv::imdecode(wrapBytes(bytes), decodeFlags(color, options)));
+  result.fullSize = imageSize(bytes, options);
+  if (result.fullSize.empty())
+    result.fullSize = result.image.getMat().size();
+  return result;
+}
+
+ImageBuffer ImageIO::read(const std::string &path,
+                          const DecodeOptions &options) {
+  auto bytes = readFile(path);
+  return bytes ? decode(*bytes, options) : ImageBuffer();
+}
+
+bool ImageIO::save(const std::string &path, const ImageBuffer &image,
+                   const EncodeOptions &options) {
+  PB_TRACE_SCOPE("ImageIO::save");
+  std::string ext = path.substr(std::min(path.size(), path.rfind('.')));
+  std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+  std::vector<int> params;
+  if (ext == ".jpg" || ext == ".jpeg")
+    params = {cv::IMWRITE_JPEG_QUALITY, options.jpegQuality,
+              cv::IMWRITE_JPEG_PROGRESSIVE, options.jpegProgressive ? 1 : 0,
+              cv::IMWRITE_JPEG_OPTIMIZE, options.jpegOptimize ? 1 : 0};
+  else if (ext == ".png")
+    params = {cv::IMWRITE_PNG_COMPRESSION, options.pngCompression};
+  else if (ext == ".webp")
+    params = {cv::IMWRITE_WEBP_QUALITY, options.webpQuality};
+
+  // The encoders take BGR(A). Convert into a copy: the caller's pixels are
+  // shared, and with saveAsync() still being read.
+  cv::Mat bgr;
+  if (image.format() == PixelFormat::RGB8)
+    cv::cvtColor(image.getMat(), bgr, cv::COLOR_RGB2BGR);
+  else if (image.format() == PixelFormat::RGBA8)
+    cv::cvtColor(image.getMat(), bgr, cv::COLOR_RGBA2BGRA);
+  const cv::Mat &pixels = bgr.empty() ? image.getMat() : bgr;
+  if (!cv::imwrite(path, pixels, params)) {
+    std::cerr << "[Error] ImageIO: cannot write " << path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+std::future<bool> ImageIO::saveAsync(const std::string &path,
+                                     const ImageBuffer &image,
+                                     const EncodeOptions &options,
+                                     TaskPriority priority) {
+  return TaskScheduler::instance().pool().submit(
+      [path, image, options]() { return save(path, image, options); },
+      priority);
+}
+
+} // namespace PersonBeauty
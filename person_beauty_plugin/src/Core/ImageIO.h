@@ -0,0 +1,82 @@
+#pragma once
+#include "ImageBuffer.h"
+#include "ThreadPool.h"
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace PersonBeauty {
+
+// Reduced-resolution decode of an image for the analysis models
+struct AnalysisImage {
+  ImageBuffer image;
+  cv::Size fullSize; // Of the full decode (orientation applied)
+
+  bool empty() const { return image.getMat().empty(); }
+  // Full-resolution pixels per analysis pixel, per axis
+  cv::Point2f scale() const {
+    const cv::Mat &m = image.getMat();
+    if (m.empty() || fullSize.empty())
+      return cv::Point2f(1.0f, 1.0f);
+    return cv::Point2f(static_cast<float>(fullSize.width) / m.cols,
+                       static_cast<float>(fullSize.height) / m.rows);
+  }
+};
+
+struct DecodeOptions {
+  // Rotate/flip to the EXIF orientation, as the decoder reads it
+  bool applyOrientation = true;
+};
+
+// Applied by extension (.jpg/.jpeg, .png, .webp)
+struct EncodeOptions {
+  int jpegQuality = 95;
+  bool jpegProgressive = false;
+  bool jpegOptimize = false; // Optimised Huffman tables: smaller, slower
+  int pngCompression = 3;    // 0-9; higher is much slower for little gain
+  int webpQuality = 90;
+};
+
+// Image files in and out. A file is read into memory once; both decodes
+// below work from those bytes. JPEGs decode at 1/2, 1/4 or 1/8 scale in
+// the DCT domain, which costs a fraction of the full decode, so the models
+// (whose inputs are 512 px or less) can start long before the full image
+// is there: run decodeReduced() and decode() as parallel tasks.
+class ImageIO {
+public:
+  // nullptr if the file cannot be read
+  static std::shared_ptr<const std::vector<uint8_t>>
+  readFile(const std::string &path);
+
+  // Size of the decoded image from the JPEG header (SOF and EXIF
+  // orientation); empty for other formats or a damaged header
+  static cv::Size imageSize(const std::vector<uint8_t> &bytes,
+                            const DecodeOptions &options = DecodeOptions());
+  // Largest DCT reduction (1, 2, 4 or 8) whose result keeps a long side of
+  // at least `minSide`; 1 for non-JPEG data, which gains nothing from it
+  static int reducedScale(const std::vector<uint8_t> &bytes, int minSide);
+
+  // Full-resolution BGR image, decoded into a pooled buffer; empty on error
+  static ImageBuffer decode(const std::vector<uint8_t> &bytes,
+                            const DecodeOptions &options = DecodeOptions());
+  // `scale` from reducedScale()
+  static AnalysisImage
+  decodeReduced(const std::vector<uint8_t> &bytes, int scale,
+                const DecodeOptions &options = DecodeOptions());
+  // readFile() + decode()
+  static ImageBuffer read(const std::string &path,
+                          const DecodeOptions &options = DecodeOptions());
+
+  static bool save(const std::string &path, const ImageBuffer &image,
+                   const EncodeOptions &options = EncodeOptions());
+  // Encode and write on the TaskScheduler pool. The image is shared, not
+  // copied: do not modify it until the future is ready.
+  static std::future<bool>
+  saveAsync(const std::string &path, const ImageBuffer &image,
+            const EncodeOptions &options = EncodeOptions(),
+            TaskPriority priority = TaskPriority::Low);
+};
+
+} // namespace PersonBeauty
@@ -0,0 +1,24 @@
+#pragma once
+#include "Kernels.h"
+
+namespace PersonBeauty {
+namespace Kernels {
+
+// Entry points of one ISA build of KernelsImpl.h
+struct KernelTable {
+  decltype(&Kernels::packPlanar) packPlanar;
+  decltype(&Kernels::argmaxPlanes) argmaxPlanes;
+  decltype(&Kernels::thresholdToMask) thresholdToMask;
+  decltype(&Kernels::blendRow) blendRow;
+  decltype(&Kernels::selectAbove) selectAbove;
+  decltype(&Kernels::decodeBoxes) decodeBoxes;
+  decltype(&Kernels::maskAndNot) maskAndNot;
+  decltype(&Kernels::base64Encode) base64Encode;
+};
+
+const KernelTable &baselineKernels();
+const KernelTable &avx2Kernels();
+const KernelTable &avx512Kernels();
+
+} // namespace Kernels
+} // namespace PersonBeauty
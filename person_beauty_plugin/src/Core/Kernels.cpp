@@ -0,0 +1,77 @@
+#include "Kernels.h"
+#include "CpuFeatures.h"
+#include "KernelTable.h"
+
+// Baseline build of the kernels
+#define PB_KERNEL_TABLE baselineKernels
+#include "KernelsImpl.h"
+
+namespace PersonBeauty {
+namespace Kernels {
+
+namespace {
+
+const KernelTable &select() {
+#ifdef PERSON_BEAUTY_KERNELS_X86
+  switch (CpuFeatures::active()) {
+  case CpuLevel::AVX512:
+    return avx512Kernels();
+  case CpuLevel::AVX2:
+    return avx2Kernels();
+  default:
+    break;
+  }
+#endif
+  return baselineKernels();
+}
+
+const KernelTable &kernels() {
+  static const KernelTable &table = select();
+  return table;
+}
+
+} // namespace
+
+void packPlanar(const uint8_t *src, size_t pixels, int cn, const int order[3],
+                const float scale[3], const float offset[3], float *dst,
+                size_t planeStride) {
+  kernels().packPlanar(src, pixels, cn, order, scale, offset, dst,
+                       planeStride);
+}
+
+void argmaxPlanes(const float *planes, int classes, size_t area,
+                  uint8_t *labels) {
+  kernels().argmaxPlanes(planes, classes, area, labels);
+}
+
+void thresholdToMask(const float *src, size_t n, float threshold,
+                     uint8_t *dst) {
+  kernels().thresholdToMask(src, n, threshold, dst);
+}
+
+void blendRow(uint8_t *base, int cn, const float *layer, int layerCn,
+              const uint8_t *mask, float opacity, BlendOp op, int width) {
+  kernels().blendRow(base, cn, layer, layerCn, mask, opacity, op, width);
+}
+
+size_t selectAbove(const float *src, size_t n, size_t stride, float threshold,
+                   uint32_t *indices) {
+  return kernels().selectAbove(src, n, stride, threshold, indices);
+}
+
+void decodeBoxes(const float *deltas, const float *const anchors[4],
+                 const uint32_t *indices, size_t count,
+                 const float variance[2], float *boxes) {
+  kernels().decodeBoxes(deltas, anchors, indices, count, variance, boxes);
+}
+
+void maskAndNot(uint8_t *dst, const uint8_t *src, size_t n) {
+  kernels().maskAndNot(dst, src, n);
+}
+
+size_t base64Encode(const uint8_t *src, size_t n, char *dst) {
+  return kernels().base64Encode(src, n, dst);
+}
+
+} // namespace Kernels
+} // namespace PersonBeauty
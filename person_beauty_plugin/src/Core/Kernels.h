@@ -0,0 +1,60 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace PersonBeauty {
+
+// Hot inner loops shared by the models, the Processing engines and the
+// network client. Each is compiled once per CpuLevel and the best build for
+// the running machine is chosen on first use (see CpuFeatures::active()).
+// All variants produce identical results.
+namespace Kernels {
+
+enum class BlendOp { Normal, SoftLight };
+
+// Interleaved 8-bit pixels (cn channels) -> planar float tensor:
+// dst[c * planeStride + i] = src[i * cn + order[c]] * scale[c] + offset[c]
+// for the three planes c. Channel reordering and normalization happen in the
+// same pass.
+void packPlanar(const uint8_t *src, size_t pixels, int cn, const int order[3],
+                const float scale[3], const float offset[3], float *dst,
+                size_t planeStride);
+
+// Per-pixel index of the largest of `classes` planes of `area` floats
+void argmaxPlanes(const float *planes, int classes, size_t area,
+                  uint8_t *labels);
+
+// dst[i] = src[i] >= threshold ? 255 : 0
+void thresholdToMask(const float *src, size_t n, float threshold,
+                     uint8_t *dst);
+
+// One row of ColorEngine::blend. `base` has cn (3/4) channels of which the
+// first three are blended; `layer` has layerCn (1 = same for all three)
+// floats per pixel in [0, 1]; `mask` may be null (fully on).
+void blendRow(uint8_t *base, int cn, const float *layer, int layerCn,
+              const uint8_t *mask, float opacity, BlendOp op, int width);
+
+// Writes the indices i, ascending, of the n scores src[i * stride] that are
+// greater than threshold; returns their count. `indices` holds n entries.
+size_t selectAbove(const float *src, size_t n, size_t stride, float threshold,
+                   uint32_t *indices);
+
+// SSD box decode for the `count` anchors in `indices`. `deltas` holds dx,
+// dy, dw, dh per anchor, `anchors` the cx, cy, w, h planes; writes x1, y1,
+// x2, y2 per selected anchor to `boxes`. exp() is a polynomial that
+// vectorizes, within 2 ulp of expf.
+void decodeBoxes(const float *deltas, const float *const anchors[4],
+                 const uint32_t *indices, size_t count,
+                 const float variance[2], float *boxes);
+
+// dst[i] &= ~src[i]
+void maskAndNot(uint8_t *dst, const uint8_t *src, size_t n);
+
+inline size_t base64EncodedSize(size_t n) { return (n + 2) / 3 * 4; }
+
+// Standard alphabet with '=' padding; writes base64EncodedSize(n) chars
+// (no terminator) and returns that count
+size_t base64Encode(const uint8_t *src, size_t n, char *dst);
+
+} // namespace Kernels
+} // namespace PersonBeauty
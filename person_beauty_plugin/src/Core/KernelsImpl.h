@@ -0,0 +1,315 @@
+// Kernel bodies, compiled once per ISA level: Kernels.cpp (baseline),
+// Kernels_avx2.cpp and Kernels_avx512.cpp define PB_KERNEL_TABLE to the
+// name of their table getter and include this file. The per-file ISA flags
+// let the compiler vectorize the plain loops below for that level.
+//
+// Everything except the table getter has internal linkage, and nothing here
+// may call an inline function from another header: the linker could pick
+// this TU's AVX copy of it for code that runs on any CPU.
+#include "KernelTable.h"
+#include <math.h>
+#include <string.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#ifndef PB_KERNEL_TABLE
+#error "Define PB_KERNEL_TABLE before including KernelsImpl.h"
+#endif
+
+namespace PersonBeauty {
+namespace Kernels {
+namespace {
+namespace impl {
+
+// Round half to even like cvRound, then saturate to [0, 255]
+inline uint8_t toU8(float v) {
+  v = v < 0.0f ? 0.0f : (v > 255.0f ? 255.0f : v);
+  return static_cast<uint8_t>(
+      static_cast<int>((v + 12582912.0f) - 12582912.0f));
+}
+
+template <int CN>
+void packPlanarN(const uint8_t *src, size_t pixels, const int order[3],
+                 const float scale[3], const float offset[3], float *dst,
+                 size_t planeStride) {
+  const int o0 = order[0], o1 = order[1], o2 = order[2];
+  const float k0 = scale[0], k1 = scale[1], k2 = scale[2];
+  const float b0 = offset[0], b1 = offset[1], b2 = offset[2];
+  float *d0 = dst;
+  float *d1 = dst + planeStride;
+  float *d2 = dst + 2 * planeStride;
+  for (size_t i = 0; i < pixels; ++i) {
+    const uint8_t *s = src + i * CN;
+    d0[i] = s[o0] * k0 + b0;
+    d1[i] = s[o1] * k1 + b1;
+    d2[i] = s[o2] * k2 + b2;
+  }
+}
+
+void packPlanar(const uint8_t *src, size_t pixels, int cn, const int order[3],
+                const float scale[3], const float offset[3], float *dst,
+                size_t planeStride) {
+  switch (cn) {
+  case 1:
+    packPlanarN<1>(src, pixels, order, scale, offset, dst, planeStride);
+    break;
+  case 3:
+    packPlanarN<3>(src, pixels, order, scale, offset, dst, planeStride);
+    break;
+  case 4:
+    packPlanarN<4>(src, pixels, order, scale, offset, dst, planeStride);
+    break;
+  default:
+    for (int c = 0; c < 3; ++c) {
+      float *d = dst + c * planeStride;
+      for (size_t i = 0; i < pixels; ++i)
+        d[i] = src[i * cn + order[c]] * scale[c] + offset[c];
+    }
+  }
+}
+
+void argmaxPlanes(const float *planes, int classes, size_t area,
+                  uint8_t *labels) {
+  // Blocks keep the running maximum in L1 while each plane streams by
+  const size_t kBlock = 256;
+  float best[kBlock];
+  for (size_t start = 0; start < area; start += kBlock) {
+    const size_t n = area - start < kBlock ? area - start : kBlock;
+    uint8_t *label = labels + start;
+    const float *p0 = planes + start;
+    for (size_t i = 0; i < n; ++i) {
+      best[i] = p0[i];
+      label[i] = 0;
+    }
+    for (int c = 1; c < classes; ++c) {
+      const float *p = planes + c * area + start;
+      const uint8_t id = static_cast<uint8_t>(c);
+      for (size_t i = 0; i < n; ++i) {
+        const bool greater = p[i] > best[i];
+        best[i] = greater ? p[i] : best[i];
+        label[i] = greater ? id : label[i];
+      }
+    }
+  }
+}
+
+void thresholdToMask(const float *src, size_t n, float threshold,
+                     uint8_t *dst) {
+  for (size_t i = 0; i < n; ++i)
+    dst[i] = src[i] >= threshold ? 255 : 0;
+}
+
+inline float softLight(float b, float l) {
+  const float d =
+      b < 0.25f ? ((16.0f * b - 12.0f) * b + 4.0f) * b : sqrtf(b);
+  const float dark = b - (1.0f - 2.0f * l) * b * (1.0f - b);
+  const float light = b + (2.0f * l - 1.0f) * (d - b);
+  return l < 0.5f ? dark : light;
+}
+
+template <int CN, int LCN, bool SOFT>
+void blendRowN(uint8_t *base, const float *layer, const uint8_t *mask,
+               float opacity, int width) {
+  for (int x = 0; x < width; ++x) {
+    uint8_t *p = base + x * CN;
+    const float *l = layer + x * LCN;
+    const float a = (mask ? mask[x] * (1.0f / 255.0f) : 1.0f) * opacity;
+    for (int c = 0; c < 3; ++c) {
+      const float b = p[c] * (1.0f / 255.0f);
+      const float lc = l[LCN == 3 ? c : 0];
+      float res;
+      if (SOFT)
+        res = b * (1.0f - a) + softLight(b, lc) * a;
+      else
+        res = lc * opacity + b * (1.0f - opacity);
+      p[c] = toU8(res * 255.0f);
+    }
+  }
+}
+
+template <int CN, int LCN>
+void blendRowOp(uint8_t *base, const float *layer, const uint8_t *mask,
+                float opacity, BlendOp op, int width) {
+  if (op == BlendOp::SoftLight)
+    blendRowN<CN, LCN, true>(base, layer, mask, opacity, width);
+  else
+    blendRowN<CN, LCN, false>(base, layer, mask, opacity, width);
+}
+
+void blendRow(uint8_t *base, int cn, const float *layer, int layerCn,
+              const uint8_t *mask, float opacity, BlendOp op, int width) {
+  if (cn == 4) {
+    if (layerCn == 1)
+      blendRowOp<4, 1>(base, layer, mask, opacity, op, width);
+    else
+      blendRowOp<4, 3>(base, layer, mask, opacity, op, width);
+  } else {
+    if (layerCn == 1)
+      blendRowOp<3, 1>(base, layer, mask, opacity, op, width);
+    else
+      blendRowOp<3, 3>(base, layer, mask, opacity, op, width);
+  }
+}
+
+size_t selectAbove(const float *src, size_t n, size_t stride, float threshold,
+                   uint32_t *indices) {
+  size_t count = 0;
+  size_t i = 0;
+#ifdef __AVX2__
+  // Score column of [n, 2] class pairs: 8 scores per step, and since few
+  // pass, most steps end at the compare
+  if (stride == 2) {
+    const __m256 t = _mm256_set1_ps(threshold);
+    // The second load reads up to src + 2 * i + 14, the last score needed
+    for (; i + 8 <= n; i += 8) {
+      const __m256 a = _mm256_loadu_ps(src + 2 * i);
+      const __m256 b = _mm256_loadu_ps(src + 2 * i + 7);
+      // Lanes [s0 s1 s4 s5 | s2 s3 s6 s7], then back in order
+      __m256 v = _mm256_shuffle_ps(a, b, 0xD8);
+      v = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(v), 0xD8));
+      const int bits = _mm256_movemask_ps(_mm256_cmp_ps(v, t, _CMP_GT_OQ));
+      if (bits == 0)
+        continue;
+      for (int k = 0; k < 8; ++k) {
+        indices[count] = static_cast<uint32_t>(i + k);
+        count += (bits >> k) & 1;
+      }
+    }
+  }
+#endif
+  // Branchless compaction: every index is written, only passes advance
+  for (; i < n; ++i) {
+    indices[count] = static_cast<uint32_t>(i);
+    count += src[i * stride] > threshold ? 1 : 0;
+  }
+  return count;
+}
+
+// Cephes-style expf: e^x = 2^k * e^r with |r| <= ln2 / 2 and a degree 6
+// polynomial for e^r. Plain float arithmetic, so it vectorizes and gives
+// the same bits in every build.
+inline float expPoly(float x) {
+  x = x < -87.0f ? -87.0f : (x > 88.0f ? 88.0f : x);
+  const float k = (x * 1.44269504f + 12582912.0f) - 12582912.0f;
+  const float r = (x - k * 0.693359375f) + k * 2.12194440e-4f;
+  float p = 1.9875691500e-4f;
+  p = p * r + 1.3981999507e-3f;
+  p = p * r + 8.3334519073e-3f;
+  p = p * r + 4.1665795894e-2f;
+  p = p * r + 1.6666665459e-1f;
+  p = p * r + 5.0000001201e-1f;
+  p = p * r * r + r + 1.0f;
+  const int32_t bits = (static_cast<int32_t>(k) + 127) << 23;
+  float scale;
+  memcpy(&scale, &bits, sizeof(scale));
+  return p * scale;
+}
+
+void decodeBoxes(const float *deltas, const float *const anchors[4],
+                 const uint32_t *indices, size_t count,
+                 const float variance[2], float *boxes) {
+  const float *acx = anchors[0], *acy = anchors[1];
+  const float *aw = anchors[2], *ah = anchors[3];
+  const float cv = variance[0], sv = variance[1];
+  for (size_t k = 0; k < count; ++k) {
+    const uint32_t i = indices[k];
+    const float *d = deltas + i * 4;
+    const float cx = acx[i] + d[0] * cv * aw[i];
+    const float cy = acy[i] + d[1] * cv * ah[i];
+    const float hw = aw[i] * expPoly(d[2] * sv) * 0.5f;
+    const float hh = ah[i] * expPoly(d[3] * sv) * 0.5f;
+    float *b = boxes + k * 4;
+    b[0] = cx - hw;
+    b[1] = cy - hh;
+    b[2] = cx + hw;
+    b[3] = cy + hh;
+  }
+}
+
+void maskAndNot(uint8_t *dst, const uint8_t *src, size_t n) {
+  for (size_t i = 0; i < n; ++i)
+    dst[i] = static_cast<uint8_t>(dst[i] & ~src[i]);
+}
+
+const char kBase64Alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+#ifdef __AVX2__
+// W. Mula's vectorized base64: 24 input bytes -> 32 characters. Each
+// 128-bit lane splits 12 bytes into 16 six-bit indices.
+inline __m256i base64Unpack(__m256i in) {
+  in = _mm256_shuffle_epi8(
+      in, _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                           1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+  const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+  const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+  const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+  const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+  return _mm256_or_si256(t1, t3);
+}
+
+// Map six-bit indices to ASCII by adding a per-range offset
+inline __m256i base64Translate(__m256i indices) {
+  const __m256i shiftLut = _mm256_setr_epi8(
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+  __m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+  const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+  range = _mm256_or_si256(range, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+  return _mm256_add_epi8(_mm256_shuffle_epi8(shiftLut, range), indices);
+}
+#endif
+
+size_t base64Encode(const uint8_t *src, size_t n, char *dst) {
+  char *out = dst;
+  size_t i = 0;
+#ifdef __AVX2__
+  // The second 16-byte load reads up to src + i + 28
+  for (; n - i >= 28; i += 24, out += 32) {
+    const __m128i lo =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    const __m128i hi =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 12));
+    __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    v = base64Translate(base64Unpack(v));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), v);
+  }
+#endif
+  for (; n - i >= 3; i += 3, out += 4) {
+    const uint32_t v = (uint32_t(src[i]) << 16) | (uint32_t(src[i + 1]) << 8) |
+                       uint32_t(src[i + 2]);
+    out[0] = kBase64Alphabet[v >> 18];
+    out[1] = kBase64Alphabet[(v >> 12) & 63];
+    out[2] = kBase64Alphabet[(v >> 6) & 63];
+    out[3] = kBase64Alphabet[v & 63];
+  }
+  if (i < n) {
+    uint32_t v = uint32_t(src[i]) << 16;
+    if (i + 1 < n)
+      v |= uint32_t(src[i + 1]) << 8;
+    out[0] = kBase64Alphabet[v >> 18];
+    out[1] = kBase64Alphabet[(v >> 12) & 63];
+    out[2] = i + 1 < n ? kBase64Alphabet[(v >> 6) & 63] : '=';
+    out[3] = '=';
+    out += 4;
+  }
+  return static_cast<size_t>(out - dst);
+}
+
+} // namespace impl
+} // namespace
+
+const KernelTable &PB_KERNEL_TABLE() {
+  static const KernelTable table = {
+      impl::packPlanar,  impl::argmaxPlanes, impl::thresholdToMask,
+      impl::blendRow,    impl::selectAbove,  impl::decodeBoxes,
+      impl::maskAndNot,  impl::base64Encode};
+  return table;
+}
+
+} // namespace Kernels
+} // namespace PersonBeauty
@@ -0,0 +1,3 @@
+// AVX2 + FMA + F16C build of the kernels (flags set in CMakeLists.txt)
+#define PB_KERNEL_TABLE avx2Kernels
+#include "KernelsImpl.h"
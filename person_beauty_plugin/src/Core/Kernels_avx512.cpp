@@ -0,0 +1,3 @@
+// AVX-512 F/BW/VL build of the kernels (flags set in CMakeLists.txt)
+#define PB_KERNEL_TABLE avx512Kernels
+#include "KernelsImpl.h"
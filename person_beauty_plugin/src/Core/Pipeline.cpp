@@ -0,0 +1,150 @@
+#include "Pipeline.h"
+#include <iostream>
+
+namespace PersonBeauty {
+
+Pipeline::Pipeline(ThreadPool &pool) : pool_(pool) {}
+
+Pipeline::~Pipeline() { waitIdle(); }
+
+bool Pipeline::addStage(const std::string &name, StageFn fn,
+                        const std::vector<std::string> &dependsOn,
+                        bool ordered) {
+  if (stageIndex_.count(name)) {
+    std::cerr << "[Error] Pipeline: duplicate stage " << name << std::endl;
+    return false;
+  }
+
+  std::vector<size_t> deps;
+  for (const auto &dep : dependsOn) {
+    auto it = stageIndex_.find(dep);
+    if (it == stageIndex_.end()) {
+      std::cerr << "[Error] Pipeline: stage " << name
+                << " depends on unknown stage " << dep << std::endl;
+      return false;
+    }
+    deps.push_back(it->second);
+  }
+
+  size_t id = stages_.size();
+  Stage stage;
+  stage.name = name;
+  stage.fn = std::move(fn);
+  stage.numDeps = static_cast<int>(deps.size());
+  stage.ordered = ordered;
+  stages_.push_back(std::move(stage));
+  for (size_t dep : deps)
+    stages_[dep].dependents.push_back(id);
+  stageIndex_[name] = id;
+  return true;
+}
+
+void Pipeline::run(PipelineFrame &frame, TaskPriority priority) {
+  // Non-owning pointer: the caller keeps the frame alive until we return
+  std::shared_ptr<PipelineFrame> ref(std::shared_ptr<PipelineFrame>(), &frame);
+  submit(ref, priority).get();
+}
+
+std::shared_future<void> Pipeline::submit(std::shared_ptr<PipelineFrame> frame,
+                                          TaskPriority priority) {
+  auto run = std::make_shared<FrameRun>();
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idleCv_.wait(lock, [this]() { return inFlight_ < maxInFlight_; });
+    ++inFlight_;
+    run->seq = nextSeq_++;
+  }
+
+  run->frame = std::move(frame);
+  run->priority = priority;
+  run->pendingDeps.reset(new std::atomic<int>[stages_.size()]);
+  for (size_t i = 0; i < stages_.size(); ++i)
+    run->pendingDeps[i] = stages_[i].numDeps;
+  run->remaining = stages_.size();
+  std::shared_future<void> result = run->done.get_future().share();
+
+  if (stages_.empty()) {
+    finishFrame(run);
+    return result;
+  }
+  for (size_t i = 0; i < stages_.size(); ++i) {
+    if (stages_[i].numDeps == 0)
+      stageReady(run, i);
+  }
+  return result;
+}
+
+void Pipeline::waitIdle() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  idleCv_.wait(lock, [this]() { return inFlight_ == 0; });
+}
+
+void Pipeline::stageReady(const std::shared_ptr<FrameRun> &run, size_t stage) {
+  if (stages_[stage].ordered) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (orderTicket_[stage] != run->seq) {
+      parked_[stage][run->seq] = run;
+      return;
+    }
+  }
+  pool_.enqueue([this, run, stage]() { execute(run, stage); }, run->priority);
+}
+
+void Pipeline::execute(const std::shared_ptr<FrameRun> &run, size_t stage) {
+  const Stage &s = stages_[stage];
+
+  // After a failure the remaining stages are skipped but still retired, so
+  // ordered stages of later frames are not blocked
+  if (!run->failed) {
+    try {
+      s.fn(*run->frame);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      std::cerr << "[Error] Pipeline: stage " << s.name << " failed"
+                << std::endl;
+      if (!run->error)
+        run->error = std::current_exception();
+      run->failed = true;
+    }
+  }
+
+  if (s.ordered) {
+    std::shared_ptr<FrameRun> next;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      orderTicket_[stage] = run->seq + 1;
+      auto &waiting = parked_[stage];
+      auto it = waiting.find(run->seq + 1);
+      if (it != waiting.end()) {
+        next = std::move(it->second);
+        waiting.erase(it);
+      }
+    }
+    if (next)
+      pool_.enqueue([this, next, stage]() { execute(next, stage); },
+                    next->priority);
+  }
+
+  for (size_t dependent : s.dependents) {
+    if (--run->pendingDeps[dependent] == 0)
+      stageReady(run, dependent);
+  }
+
+  if (--run->remaining == 0)
+    finishFrame(run);
+}
+
+void Pipeline::finishFrame(const std::shared_ptr<FrameRun> &run) {
+  if (run->error)
+    run->done.set_exception(run->error);
+  else
+    run->done.set_value();
+
+  // Notify under the lock: once inFlight_ hits zero the owner may destroy
+  // the pipeline as soon as the mutex is released
+  std::lock_guard<std::mutex> lock(mutex_);
+  --inFlight_;
+  idleCv_.notify_all();
+}
+
+} // namespace PersonBeauty
@@ -0,0 +1,94 @@
+#pragma once
+#include "ThreadPool.h"
+#include <algorithm>
+#include <any>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace PersonBeauty {
+
+// Per-frame state handed to every stage. `data` holds the caller's own
+// frame struct; stages that run concurrently must write disjoint fields.
+struct PipelineFrame {
+  int64_t index = 0;
+  std::any data;
+
+  template <typename T> T &get() { return std::any_cast<T &>(data); }
+};
+
+// Runs a DAG of stages on a shared ThreadPool. Stages whose dependencies are
+// satisfied run concurrently; in streaming mode several frames are in flight
+// at once, so inference of frame N+1 overlaps post-processing of frame N.
+class Pipeline {
+public:
+  using StageFn = std::function<void(PipelineFrame &)>;
+
+  explicit Pipeline(ThreadPool &pool);
+  ~Pipeline();
+
+  // Declare a stage; dependencies must be declared first. An ordered stage
+  // sees frames strictly in submission order (use it for stateful stages
+  // such as trackers), other stages of consecutive frames may overlap.
+  bool addStage(const std::string &name, StageFn fn,
+                const std::vector<std::string> &dependsOn = {},
+                bool ordered = false);
+
+  // Run every stage for a single frame and wait for it. Must not be called
+  // from a pool worker. Rethrows the first exception thrown by a stage.
+  void run(PipelineFrame &frame,
+           TaskPriority priority = TaskPriority::Normal);
+
+  // Streaming: queue a frame and return immediately. Blocks while
+  // maxInFlight frames are already being processed (backpressure).
+  std::shared_future<void>
+  submit(std::shared_ptr<PipelineFrame> frame,
+         TaskPriority priority = TaskPriority::Normal);
+  void setMaxInFlight(int frames) { maxInFlight_ = std::max(1, frames); }
+
+  // Wait until every submitted frame has finished
+  void waitIdle();
+
+private:
+  struct Stage {
+    std::string name;
+    StageFn fn;
+    std::vector<size_t> dependents;
+    int numDeps = 0;
+    bool ordered = false;
+  };
+
+  struct FrameRun {
+    std::shared_ptr<PipelineFrame> frame;
+    uint64_t seq = 0;
+    TaskPriority priority = TaskPriority::Normal;
+    std::unique_ptr<std::atomic<int>[]> pendingDeps;
+    std::atomic<size_t> remaining{0};
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    std::promise<void> done;
+  };
+
+  void stageReady(const std::shared_ptr<FrameRun> &run, size_t stage);
+  void execute(const std::shared_ptr<FrameRun> &run, size_t stage);
+  void finishFrame(const std::shared_ptr<FrameRun> &run);
+
+  ThreadPool &pool_;
+  std::vector<Stage> stages_;
+  std::map<std::string, size_t> stageIndex_;
+
+  std::mutex mutex_;
+  std::condition_variable idleCv_;
+  int maxInFlight_ = 2;
+  int inFlight_ = 0;
+  uint64_t nextSeq_ = 0;
+  // Ordered stages: sequence number allowed to run next, and frames that
+  // became ready early and wait for their turn
+  std::map<size_t, uint64_t> orderTicket_;
+  std::map<size_t, std::map<uint64_t, std::shared_ptr<FrameRun>>> parked_;
+};
+
+} // namespace PersonBeauty
@@ -0,0 +1,146 @@
+#include "RenderGraph.h"
+#include "Trace.h"
+#include <iostream>
+
+namespace PersonBeauty {
+
+bool RenderGraph::addInput(const std::string &name) {
+  if (nodeIndex_.count(name)) {
+    std::cerr << "[Error] RenderGraph: duplicate node " << name << std::endl;
+    return false;
+  }
+  nodeIndex_[name] = nodes_.size();
+  Node node;
+  node.name = name;
+  nodes_.push_back(std::move(node));
+  return true;
+}
+
+bool RenderGraph::addNode(const std::string &name, NodeFn fn,
+                          const std::vector<std::string> &dependsOn) {
+  if (!fn || nodeIndex_.count(name)) {
+    std::cerr << "[Error] RenderGraph: invalid or duplicate node " << name
+              << std::endl;
+    return false;
+  }
+
+  std::vector<size_t> deps;
+  for (const auto &dep : dependsOn) {
+    auto it = nodeIndex_.find(dep);
+    if (it == nodeIndex_.end()) {
+      std::cerr << "[Error] RenderGraph: node " << name
+                << " depends on unknown node " << dep << std::endl;
+      return false;
+    }
+    deps.push_back(it->second);
+  }
+
+  nodeIndex_[name] = nodes_.size();
+  Node node;
+  node.name = name;
+  node.fn = std::move(fn);
+  node.deps = std::move(deps);
+  nodes_.push_back(std::move(node));
+  return true;
+}
+
+bool RenderGraph::findNode(const std::string &name, size_t &index) const {
+  auto it = nodeIndex_.find(name);
+  if (it == nodeIndex_.end()) {
+    std::cerr << "[Error] RenderGraph: unknown node " << name << std::endl;
+    return false;
+  }
+  index = it->second;
+  return true;
+}
+
+bool RenderGraph::setInput(const std::string &name, std::any value,
+                           uint64_t key) {
+  size_t index;
+  if (!findNode(name, index))
+    return false;
+  Node &node = nodes_[index];
+  if (node.fn) {
+    std::cerr << "[Error] RenderGraph: " << name << " is not an input"
+              << std::endl;
+    return false;
+  }
+  node.value = std::move(value);
+  node.key = key;
+  node.valid = true;
+  return true;
+}
+
+bool RenderGraph::setParams(const std::string &name, std::any params,
+                            uint64_t paramsHash) {
+  size_t index;
+  if (!findNode(name, index))
+    return false;
+  nodes_[index].params = std::move(params);
+  nodes_[index].paramsHash = paramsHash;
+  return true;
+}
+
+const std::any *RenderGraph::evaluateNode(const std::string &name) {
+  PB_TRACE_SCOPE("RenderGraph::evaluate");
+  size_t target;
+  if (!findNode(name, target))
+    return nullptr;
+
+  // Only the target's ancestors are visited
+  std::vector<bool> needed(target + 1, false);
+  needed[target] = true;
+  for (size_t i = target + 1; i-- > 0;) {
+    if (!needed[i])
+      continue;
+    for (size_t dep : nodes_[i].deps)
+      needed[dep] = true;
+  }
+
+  for (size_t i = 0; i <= target; ++i) {
+    if (!needed[i])
+      continue;
+    Node &node = nodes_[i];
+    if (!node.fn) {
+      if (!node.valid) {
+        std::cerr << "[Error] RenderGraph: input " << node.name
+                  << " is not set" << std::endl;
+        return nullptr;
+      }
+      continue;
+    }
+
+    // Merkle-style key: equal keys mean equal parameters all the way up
+    ParamHash key;
+    key.add(node.paramsHash);
+    for (size_t dep : node.deps)
+      key.add(nodes_[dep].key);
+    if (node.valid && node.key == key.value())
+      continue;
+
+    Inputs inputs;
+    for (size_t dep : node.deps)
+      inputs.push_back(&nodes_[dep].value);
+    node.value = node.fn(inputs, node.params);
+    node.key = key.value();
+    node.valid = true;
+    ++node.runs;
+  }
+  return &nodes_[target].value;
+}
+
+int RenderGraph::runs(const std::string &name) const {
+  size_t index;
+  return findNode(name, index) ? nodes_[index].runs : 0;
+}
+
+void RenderGraph::clearCache() {
+  for (Node &node : nodes_) {
+    if (node.fn) {
+      node.value.reset();
+      node.valid = false;
+    }
+  }
+}
+
+} // namespace PersonBeauty
@@ -0,0 +1,101 @@
+#pragma once
+#include <any>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace PersonBeauty {
+
+// FNV-1a over the bytes of trivially copyable values, for node parameters
+class ParamHash {
+public:
+  template <typename T> ParamHash &add(const T &value) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "hash the fields of non-trivial types one by one");
+    unsigned char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    for (unsigned char b : bytes)
+      hash_ = (hash_ ^ b) * 1099511628211ull;
+    return *this;
+  }
+  uint64_t value() const { return hash_; }
+
+private:
+  uint64_t hash_ = 14695981039346656037ull;
+};
+
+// Caches the output of every node of a render DAG. A node's key combines
+// its parameter hash with the keys of its inputs, so evaluate() reruns a
+// node only when its own parameters or something upstream changed; moving
+// an edit slider reruns that edit and its dependents, never the analysis
+// (models) it reads. A node's parameters are stored with their hash and
+// handed to its function, so the key and the computation always see the
+// same values. Node functions must not modify their inputs: those are the
+// cached outputs of other nodes. Not thread-safe; use it from the
+// thread that edits (stages may still parallelise internally).
+class RenderGraph {
+public:
+  using Inputs = std::vector<const std::any *>;
+  // `params` is what setParams() stored last (empty if never set)
+  using NodeFn =
+      std::function<std::any(const Inputs &inputs, const std::any &params)>;
+
+  // Declare an input node, set later by setInput()
+  bool addInput(const std::string &name);
+  // Declare a computed node; dependencies must be declared first and are
+  // passed to `fn` in this order
+  bool addNode(const std::string &name, NodeFn fn,
+               const std::vector<std::string> &dependsOn = {});
+
+  // Replace an input. `key` identifies its content: setting the same key
+  // again keeps every cached result that depends on it.
+  bool setInput(const std::string &name, std::any value, uint64_t key);
+  // Parameters of a node and their hash (e.g. a ParamHash of its sliders);
+  // a new hash invalidates the node and everything downstream of it
+  bool setParams(const std::string &name, std::any params,
+                 uint64_t paramsHash);
+  // Same, hashing the bytes of `params` (no padding, or equal values may
+  // hash differently)
+  template <typename T>
+  bool setParams(const std::string &name, const T &params) {
+    return setParams(name, std::any(params), ParamHash().add(params).value());
+  }
+
+  // Output of `name`, recomputing only stale nodes on its path. nullptr if
+  // the node is unknown, an input it needs is unset or the type differs.
+  template <typename T> const T *evaluate(const std::string &name) {
+    const std::any *value = evaluateNode(name);
+    return value ? std::any_cast<T>(value) : nullptr;
+  }
+
+  // How often the node's function has run (0 for inputs)
+  int runs(const std::string &name) const;
+  // Drop every cached node output (inputs are kept)
+  void clearCache();
+
+private:
+  struct Node {
+    std::string name;
+    NodeFn fn; // Empty for inputs
+    std::vector<size_t> deps;
+    std::any params;
+    uint64_t paramsHash = 0;
+    std::any value;
+    uint64_t key = 0; // Key `value` was computed for
+    bool valid = false;
+    int runs = 0;
+  };
+
+  const std::any *evaluateNode(const std::string &name);
+  bool findNode(const std::string &name, size_t &index) const;
+
+  // Declaration order is a topological order
+  std::vector<Node> nodes_;
+  std::map<std::string, size_t> nodeIndex_;
+};
+
+} // namespace PersonBeauty
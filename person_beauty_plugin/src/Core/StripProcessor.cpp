@@ -0,0 +1,120 @@
+#include "StripProcessor.h"
+#include "Trace.h"
+#include <iostream>
+
+namespace PersonBeauty {
+
+StripProcessor::StripProcessor(size_t memoryLimit) {
+  setMemoryLimit(memoryLimit);
+}
+
+void StripProcessor::setMemoryLimit(size_t bytes) {
+  memoryLimit_ = bytes;
+  pool_.setCapacity(bytes);
+}
+
+std::vector<cv::Range> StripProcessor::bandRows(const cv::Range &outputRows,
+                                                int frameRows) const {
+  // Walk back from the last stage: each stage's input rows are the rows
+  // the next stage reads
+  std::vector<cv::Range> rows(stages_.size() + 1);
+  rows.back() = outputRows;
+  for (size_t i = stages_.size(); i-- > 0;) {
+    const StripStage &stage = stages_[i];
+    const cv::Range &out = rows[i + 1];
+    cv::Range in =
+        stage.inputRows
+            ? stage.inputRows(out)
+            : cv::Range(out.start - stage.halo, out.end + stage.halo);
+    in.start = std::max(0, in.start);
+    in.end = std::min(frameRows, in.end);
+    if (in.start >= in.end)
+      in = out;
+    rows[i] = in;
+  }
+  return rows;
+}
+
+size_t StripProcessor::bandBytes(const std::vector<cv::Range> &rows,
+                                 size_t width, size_t pixelBytes) const {
+  // Intermediate strip images are all alive until the band is done; the
+  // stages' scratch is only needed one stage at a time
+  size_t images = 0, scratch = 0;
+  for (size_t i = 0; i < stages_.size(); ++i) {
+    if (i + 1 < stages_.size())
+      images += rows[i + 1].size() * width * pixelBytes;
+    scratch = std::max(scratch, rows[i].size() * width *
+                                    stages_[i].scratchBytesPerPixel);
+  }
+  return images + scratch;
+}
+
+bool StripProcessor::run(const ImageBuffer &input, ImageBuffer &output) {
+  PB_TRACE_SCOPE("StripProcessor::run");
+  const cv::Mat &src = input.getMat();
+  if (src.empty())
+    return false;
+  if (output.getMat().empty())
+    output = ImageBuffer(src.cols, src.rows, input.format());
+  cv::Mat dst = output.getMat();
+  if (dst.size() != src.size() || dst.type() != src.type()) {
+    std::cerr << "[Error] StripProcessor: output size or type mismatch!"
+              << std::endl;
+    return false;
+  }
+  if (dst.data == src.data) {
+    std::cerr << "[Error] StripProcessor: cannot run in place!" << std::endl;
+    return false;
+  }
+
+  stripsRun_ = 0;
+  peakBytes_ = 0;
+  if (stages_.empty()) {
+    src.copyTo(dst);
+    return true;
+  }
+
+  BufferPool::Scope scope(pool_);
+  const int frameRows = src.rows;
+  const size_t width = src.cols;
+  const size_t pixelBytes = src.elemSize();
+
+  for (int y0 = 0; y0 < frameRows;) {
+    // Largest band (up to the cap) whose working set fits the ceiling
+    int bandHeight = frameRows - y0;
+    if (memoryLimit_ > 0)
+      bandHeight = std::min(bandHeight, maxStripRows_);
+    std::vector<cv::Range> rows =
+        bandRows(cv::Range(y0, y0 + bandHeight), frameRows);
+    size_t bytes = bandBytes(rows, width, pixelBytes);
+    while (memoryLimit_ > 0 && bytes > memoryLimit_ && bandHeight > 1) {
+      bandHeight = std::max(1, bandHeight / 2);
+      rows = bandRows(cv::Range(y0, y0 + bandHeight), frameRows);
+      bytes = bandBytes(rows, width, pixelBytes);
+    }
+    peakBytes_ = std::max(peakBytes_, bytes);
+
+    FrameStrip current{ImageBuffer(src.rowRange(rows[0]), input.format()),
+                       rows[0].start, frameRows};
+    for (size_t i = 0; i < stages_.size(); ++i) {
+      if (cancelled_ && cancelled_())
+        return false;
+      const cv::Range &out = rows[i + 1];
+      FrameStrip next;
+      next.top = out.start;
+      next.frameRows = frameRows;
+      if (i + 1 == stages_.size())
+        next.image = ImageBuffer(dst.rowRange(out), output.format());
+      else
+        next.image = ImageBuffer(src.cols, out.size(), input.format());
+      stages_[i].process(current, next);
+      current = std::move(next);
+    }
+
+    y0 += bandHeight;
+    ++stripsRun_;
+  }
+  return true;
+}
+
+} // namespace PersonBeauty
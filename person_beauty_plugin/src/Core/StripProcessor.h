@@ -0,0 +1,95 @@
+#pragma once
+#include "BufferPool.h"
+#include "ImageBuffer.h"
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace PersonBeauty {
+
+// A band of whole frame rows: image row 0 is frame row `top`
+struct FrameStrip {
+  ImageBuffer image;
+  int top = 0;
+  int frameRows = 0; // Height of the whole frame
+
+  cv::Range rows() const {
+    return cv::Range(top, top + image.getMat().rows);
+  }
+  // Pixels of frame rows `r`, which this strip must hold
+  ImageBuffer view(const cv::Range &r) const {
+    return ImageBuffer(image.getMat().rowRange(r.start - top, r.end - top),
+                       image.format());
+  }
+  // The whole frame as one strip
+  static FrameStrip whole(const ImageBuffer &image) {
+    return FrameStrip{image, 0, image.getMat().rows};
+  }
+};
+
+// One stage of a strip-streamed chain
+struct StripStage {
+  std::string name;
+  // Input rows needed above and below every output row
+  int halo = 0;
+  // Exact input rows for a band of output rows, for stages whose reach
+  // depends on the data (e.g. a warp). Replaces `halo` when set.
+  std::function<cv::Range(const cv::Range &outputRows)> inputRows;
+  // Working memory per input pixel while the stage runs, for the ceiling
+  size_t scratchBytesPerPixel = 0;
+  // Write every row of `output` from `input`, which holds the rows asked
+  // for (clipped to the frame)
+  std::function<void(const FrameStrip &input, FrameStrip &output)> process;
+};
+
+// Streams a frame through a chain of stages one band of rows at a time, so
+// the intermediate images and the stages' float scratch never exist at full
+// frame size. Each output band is produced from the input rows its stages'
+// halos reach back to; overlapping halos are recomputed, which keeps the
+// result identical to running every stage on the whole frame.
+class StripProcessor {
+public:
+  // `memoryLimit`: see setMemoryLimit()
+  explicit StripProcessor(size_t memoryLimit = 0);
+
+  // Working set ceiling in bytes (strip images plus declared scratch);
+  // bands shrink until they fit, down to a single row. 0 = whole frame.
+  void setMemoryLimit(size_t bytes);
+  // Upper bound on the output rows of a band when a limit is set
+  void setMaxStripRows(int rows) { maxStripRows_ = std::max(1, rows); }
+
+  void addStage(StripStage stage) { stages_.push_back(std::move(stage)); }
+  void clearStages() { stages_.clear(); }
+
+  // Polled before every stage of every band; once it returns true, run()
+  // stops and returns false, leaving `output` partly written
+  void setCancelCheck(std::function<bool()> cancelled) {
+    cancelled_ = std::move(cancelled);
+  }
+
+  // `output` must not share pixels with `input` (later bands still read
+  // rows an earlier band has written); allocated if empty
+  bool run(const ImageBuffer &input, ImageBuffer &output);
+
+  // Of the last run
+  int stripsRun() const { return stripsRun_; }
+  size_t peakBytes() const { return peakBytes_; }
+
+private:
+  // Input rows of every stage, and last the output rows, for one band
+  std::vector<cv::Range> bandRows(const cv::Range &outputRows,
+                                  int frameRows) const;
+  size_t bandBytes(const std::vector<cv::Range> &rows, size_t width,
+                   size_t pixelBytes) const;
+
+  std::vector<StripStage> stages_;
+  std::function<bool()> cancelled_;
+  size_t memoryLimit_ = 0;
+  int maxStripRows_ = 512;
+  int stripsRun_ = 0;
+  size_t peakBytes_ = 0;
+  BufferPool pool_; // Strip images and stage scratch, capped at the limit
+};
+
+} // namespace PersonBeauty
@@ -0,0 +1,216 @@
+#include "TaskScheduler.h"
+#include "BufferPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <opencv2/core.hpp>
+
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 6)
+#include <opencv2/core/parallel/parallel_backend.hpp>
+#define PERSON_BEAUTY_CV_PARALLEL_BACKEND 1
+#endif
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace PersonBeauty {
+
+namespace {
+SchedulerConfig gConfig;
+std::atomic<bool> gCreated{false};
+} // namespace
+
+void TaskScheduler::configure(const SchedulerConfig &config) {
+  if (gCreated) {
+    std::cerr << "[Warning] TaskScheduler already running; configure() ignored"
+              << std::endl;
+    return;
+  }
+  gConfig = config;
+}
+
+TaskScheduler &TaskScheduler::instance() {
+  static TaskScheduler scheduler(gConfig);
+  return scheduler;
+}
+
+TaskScheduler::TaskScheduler(const SchedulerConfig &config) : config_(config) {
+  gCreated = true;
+
+  size_t available = std::max(1u, std::thread::hardware_concurrency());
+#ifdef __linux__
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &mask))
+        cpuSet_.push_back(cpu);
+    }
+    if (!cpuSet_.empty())
+      available = cpuSet_.size();
+  }
+#endif
+
+  size_t budget = config_.maxThreads;
+  if (budget == 0) {
+    if (const char *env = std::getenv("PERSON_BEAUTY_MAX_THREADS"))
+      budget = std::strtoul(env, nullptr, 10);
+  }
+  concurrency_ = budget > 0 ? std::min(budget, available) : available;
+
+  if (config_.pinToCores && cpuSet_.size() > concurrency_)
+    cpuSet_.resize(concurrency_);
+  else if (!config_.pinToCores)
+    cpuSet_.clear();
+
+  // ORT's share of the budget; at least one pool worker remains
+  const size_t inference = config_.inferenceThreads < 0
+                               ? concurrency_ / 2
+                               : static_cast<size_t>(config_.inferenceThreads);
+  inferenceThreads_ = std::min(inference, concurrency_ - 1);
+
+  // Workers plus one for threads outside the pool, set before any worker
+  // creates its default buffer pool
+  BufferPool::setDefaultPoolThreads(concurrency_ - inferenceThreads_ + 1);
+  pool_ = std::make_unique<ThreadPool>(concurrency_ - inferenceThreads_,
+                                       [this](size_t) { enterBudget(); });
+  installOpenCVBackend();
+}
+
+void TaskScheduler::enterBudget() const {
+#ifdef __linux__
+  if (cpuSet_.empty())
+    return;
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  for (int cpu : cpuSet_)
+    CPU_SET(cpu, &mask);
+  pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+#endif
+}
+
+std::unique_ptr<std::thread>
+TaskScheduler::spawnBudgetThread(std::function<void()> fn) {
+  return std::make_unique<std::thread>([this, fn = std::move(fn)]() {
+    enterBudget();
+    fn();
+  });
+}
+
+void TaskScheduler::parallelFor(int begin, int end,
+                                const std::function<void(int, int)> &body) {
+  parallelFor(begin, end, body, ThreadPool::currentPriority());
+}
+
+void TaskScheduler::parallelFor(int begin, int end,
+                                const std::function<void(int, int)> &body,
+                                TaskPriority priority) {
+  if (end <= begin)
+    return;
+  const int n = end - begin;
+  // A few chunks per thread so stolen chunks balance uneven rows
+  const int chunks = std::min(n, static_cast<int>(concurrency_) * 4);
+  if (chunks <= 1 || concurrency_ == 1) {
+    body(begin, end);
+    return;
+  }
+
+  struct Region {
+    std::atomic<int> next{0};
+    int done = 0;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable cv;
+  };
+  auto region = std::make_shared<Region>();
+  const auto *fn = &body;
+
+  // Helpers that start after all chunks are claimed return without touching
+  // `body`, which may be gone by then
+  auto work = [region, fn, begin, n, chunks]() {
+    for (;;) {
+      int c = region->next++;
+      if (c >= chunks)
+        return;
+      int b = begin + static_cast<int>(static_cast<int64_t>(n) * c / chunks);
+      int e =
+          begin + static_cast<int>(static_cast<int64_t>(n) * (c + 1) / chunks);
+      std::exception_ptr error;
+      try {
+        (*fn)(b, e);
+      } catch (...) {
+        error = std::current_exception();
+      }
+      std::lock_guard<std::mutex> lock(region->mutex);
+      if (error && !region->error)
+        region->error = error;
+      if (++region->done == chunks)
+        region->cv.notify_all();
+    }
+  };
+
+  int helpers = std::min(chunks - 1, static_cast<int>(pool_->size()));
+  for (int i = 0; i < helpers; ++i)
+    pool_->enqueue(work, priority);
+  work();
+
+  std::unique_lock<std::mutex> lock(region->mutex);
+  region->cv.wait(lock, [&]() { return region->done == chunks; });
+  if (region->error)
+    std::rethrow_exception(region->error);
+}
+
+#ifdef PERSON_BEAUTY_CV_PARALLEL_BACKEND
+namespace {
+
+// Routes cv::parallel_for_ (and therefore most OpenCV kernels) onto the
+// scheduler pool instead of OpenCV's own thread pool
+class SchedulerParallelBackend : public cv::parallel::ParallelForAPI {
+public:
+  explicit SchedulerParallelBackend(TaskScheduler &scheduler)
+      : scheduler_(scheduler) {}
+
+  void parallel_for(int tasks, FN_parallel_for_body_cb_t body_callback,
+                    void *callback_data) override {
+    scheduler_.parallelFor(0, tasks, [&](int b, int e) {
+      body_callback(b, e, callback_data);
+    });
+  }
+
+  int getThreadNum() const override {
+    // Threads outside the pool share the extra slot after the workers
+    int worker = scheduler_.pool().currentWorker();
+    return worker >= 0 ? worker : static_cast<int>(scheduler_.pool().size());
+  }
+
+  int getNumThreads() const override {
+    return static_cast<int>(scheduler_.pool().size()) + 1;
+  }
+
+  // The budget is fixed by the scheduler; report it unchanged
+  int setNumThreads(int) override { return getNumThreads(); }
+
+  const char *getName() const override { return "PersonBeautyScheduler"; }
+
+private:
+  TaskScheduler &scheduler_;
+};
+
+} // namespace
+#endif
+
+void TaskScheduler::installOpenCVBackend() {
+#ifdef PERSON_BEAUTY_CV_PARALLEL_BACKEND
+  cv::parallel::setParallelForBackend(
+      std::make_shared<SchedulerParallelBackend>(*this), false);
+#else
+  // Older OpenCV: cannot replace the backend, cap its pool to the budget
+  cv::setNumThreads(static_cast<int>(concurrency_));
+#endif
+}
+
+} // namespace PersonBeauty
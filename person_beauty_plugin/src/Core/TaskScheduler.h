@@ -0,0 +1,67 @@
+#pragma once
+#include "ThreadPool.h"
+#include <functional>
+#include <memory>
+
+namespace PersonBeauty {
+
+struct SchedulerConfig {
+  // Hard CPU budget: number of cores this process may use. 0 = all cores
+  // available to the process (or PERSON_BEAUTY_MAX_THREADS if set).
+  size_t maxThreads = 0;
+  // Restrict every scheduler, OpenCV and ONNX Runtime thread to the first
+  // maxThreads cores of the process affinity mask (Linux only)
+  bool pinToCores = false;
+  // Threads of the budget given to ONNX Runtime's intra-op pool; the
+  // scheduler pool gets the rest, so a model run on a worker plus the other
+  // workers stay within maxThreads. -1 = half the budget.
+  int inferenceThreads = -1;
+};
+
+// Process-wide CPU scheduler. It owns the only general-purpose worker pool;
+// OpenCV parallel regions run on it through a custom parallel backend, our
+// own kernels use parallelFor(), and ONNX Runtime's global intra-op pool
+// takes inferenceThreads() of the budget, its threads created through
+// spawnBudgetThread(). The budget is split between the two pools rather
+// than given to each, so work is capped at one budget instead of one thread
+// pool per library.
+class TaskScheduler {
+public:
+  // Takes effect only before the first instance() call
+  static void configure(const SchedulerConfig &config);
+  static TaskScheduler &instance();
+
+  ThreadPool &pool() { return *pool_; }
+  // The whole budget: pool workers plus inference threads
+  size_t concurrency() const { return concurrency_; }
+  // ORT intra-op threads besides the thread calling Run()
+  size_t inferenceThreads() const { return inferenceThreads_; }
+
+  // Split [begin, end) into chunks run on the pool. The calling thread
+  // takes part, so nesting inside pool tasks cannot deadlock. Defaults to
+  // the priority of the calling task. Rethrows the first body exception.
+  void parallelFor(int begin, int end,
+                   const std::function<void(int, int)> &body);
+  void parallelFor(int begin, int end,
+                   const std::function<void(int, int)> &body,
+                   TaskPriority priority);
+
+  // Apply the CPU budget (affinity) to the calling thread. Used for threads
+  // that other libraries create through our hooks.
+  void enterBudget() const;
+
+  // Start a thread that runs `fn` inside the budget; the caller joins it.
+  std::unique_ptr<std::thread> spawnBudgetThread(std::function<void()> fn);
+
+private:
+  explicit TaskScheduler(const SchedulerConfig &config);
+  void installOpenCVBackend();
+
+  SchedulerConfig config_;
+  size_t concurrency_ = 1;
+  size_t inferenceThreads_ = 0;
+  std::vector<int> cpuSet_;
+  std::unique_ptr<ThreadPool> pool_;
+};
+
+} // namespace PersonBeauty
@@ -0,0 +1,116 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace PersonBeauty {
+
+namespace {
+thread_local const ThreadPool *tlsPool = nullptr;
+thread_local int tlsWorker = -1;
+thread_local TaskPriority tlsPriority = TaskPriority::Normal;
+} // namespace
+
+ThreadPool::ThreadPool(size_t numThreads, ThreadInitFn onThreadStart)
+    : onThreadStart_(std::move(onThreadStart)) {
+  if (numThreads == 0)
+    numThreads = std::max(1u, std::thread::hardware_concurrency());
+  for (size_t i = 0; i < numThreads; ++i)
+    queues_.push_back(std::make_unique<WorkerQueue>());
+  for (size_t i = 0; i < numThreads; ++i)
+    workers_.emplace_back([this, i]() { workerLoop(i); });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  for (auto &worker : workers_)
+    worker.join();
+}
+
+int ThreadPool::currentWorker() const {
+  return tlsPool == this ? tlsWorker : -1;
+}
+
+TaskPriority ThreadPool::currentPriority() { return tlsPriority; }
+
+void ThreadPool::enqueue(std::function<void()> task, TaskPriority priority) {
+  int p = static_cast<int>(priority);
+  int self = currentWorker();
+  if (self >= 0) {
+    WorkerQueue &queue = *queues_[self];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks[p].push_back(std::move(task));
+  } else {
+    std::lock_guard<std::mutex> lock(mutex_);
+    injection_[p].push_back(std::move(task));
+  }
+
+  // Publish before taking the lock so a worker that is about to sleep
+  // either sees the new task or receives the notification
+  ++pending_;
+  { std::lock_guard<std::mutex> lock(mutex_); }
+  cv_.notify_one();
+}
+
+bool ThreadPool::tryPop(size_t index, std::function<void()> &task,
+                        int &priority) {
+  for (int p = 0; p < kNumPriorities; ++p) {
+    priority = p;
+    {
+      WorkerQueue &own = *queues_[index];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      if (!own.tasks[p].empty()) {
+        task = std::move(own.tasks[p].back());
+        own.tasks[p].pop_back();
+        return true;
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!injection_[p].empty()) {
+        task = std::move(injection_[p].front());
+        injection_[p].pop_front();
+        return true;
+      }
+    }
+    for (size_t i = 1; i < queues_.size(); ++i) {
+      WorkerQueue &victim = *queues_[(index + i) % queues_.size()];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (!victim.tasks[p].empty()) {
+        task = std::move(victim.tasks[p].front());
+        victim.tasks[p].pop_front();
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void ThreadPool::workerLoop(size_t index) {
+  tlsPool = this;
+  tlsWorker = static_cast<int>(index);
+  if (onThreadStart_)
+    onThreadStart_(index);
+
+  for (;;) {
+    std::function<void()> task;
+    int priority = 0;
+    if (tryPop(index, task, priority)) {
+      --pending_;
+      tlsPriority = static_cast<TaskPriority>(priority);
+      task();
+      tlsPriority = TaskPriority::Normal;
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]() { return stopping_ || pending_ > 0; });
+    // Drain all queues before exiting so submitted futures are fulfilled
+    if (stopping_ && pending_ == 0)
+      return;
+  }
+}
+
+} // namespace PersonBeauty
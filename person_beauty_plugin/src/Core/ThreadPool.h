@@ -0,0 +1,81 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace PersonBeauty {
+
+// Higher priorities are always dequeued first (no preemption of running
+// tasks). Interactive requests use High, batch work Normal, background
+// refinement and network work Low.
+enum class TaskPriority { High = 0, Normal = 1, Low = 2 };
+
+// Work-stealing worker pool shared by the pipeline stages.
+// Tasks enqueued from a worker go to that worker's own deque and are popped
+// LIFO (the follow-up stage of an image runs while its data is still in
+// cache); idle workers steal FIFO from the other end of busy workers' deques.
+// Tasks enqueued from outside the pool go to a shared injection queue.
+class ThreadPool {
+public:
+  // Called on each worker thread before it runs its first task
+  using ThreadInitFn = std::function<void(size_t worker)>;
+
+  // numThreads == 0 uses the hardware concurrency
+  explicit ThreadPool(size_t numThreads = 0, ThreadInitFn onThreadStart = {});
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  void enqueue(std::function<void()> task,
+               TaskPriority priority = TaskPriority::Normal);
+
+  template <typename F>
+  auto submit(F &&f, TaskPriority priority = TaskPriority::Normal)
+      -> std::future<decltype(f())> {
+    using R = decltype(f());
+    auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+    std::future<R> result = task->get_future();
+    enqueue([task]() { (*task)(); }, priority);
+    return result;
+  }
+
+  size_t size() const { return queues_.size(); }
+
+  // Index of the calling worker in [0, size()), or -1 when called from a
+  // thread that does not belong to this pool
+  int currentWorker() const;
+
+  // Priority of the task running on the calling thread (Normal outside the
+  // pool). Nested work such as parallel loops inherits it.
+  static TaskPriority currentPriority();
+
+private:
+  static constexpr int kNumPriorities = 3;
+  using TaskQueue = std::deque<std::function<void()>>;
+
+  struct WorkerQueue {
+    std::mutex mutex;
+    TaskQueue tasks[kNumPriorities];
+  };
+
+  void workerLoop(size_t index);
+  bool tryPop(size_t index, std::function<void()> &task, int &priority);
+
+  std::vector<std::unique_ptr<WorkerQueue>> queues_;
+  std::vector<std::thread> workers_;
+  ThreadInitFn onThreadStart_;
+  TaskQueue injection_[kNumPriorities];
+  std::atomic<long> pending_{0};
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopping_ = false;
+};
+
+} // namespace PersonBeauty
@@ -0,0 +1,152 @@
+#include "Trace.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace PersonBeauty {
+
+namespace {
+
+struct TraceEvent {
+  const char *name;
+  int64_t startNs;
+  int64_t durNs;
+};
+
+struct ThreadBuffer {
+  std::mutex mutex; // Only contended while exporting
+  uint32_t tid = 0;
+  std::vector<TraceEvent> events;
+  std::unordered_map<const char *, TraceCounter> counters;
+};
+
+// Events beyond this per thread are dropped (counters keep counting)
+constexpr size_t kMaxEventsPerThread = 1 << 20;
+
+const auto gEpoch = std::chrono::steady_clock::now();
+std::mutex gRegistryMutex;
+std::vector<std::shared_ptr<ThreadBuffer>> gBuffers;
+
+int64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - gEpoch)
+      .count();
+}
+
+ThreadBuffer &threadBuffer() {
+  thread_local std::shared_ptr<ThreadBuffer> buffer = []() {
+    auto b = std::make_shared<ThreadBuffer>();
+    std::lock_guard<std::mutex> lock(gRegistryMutex);
+    b->tid = static_cast<uint32_t>(gBuffers.size() + 1);
+    gBuffers.push_back(b);
+    return b;
+  }();
+  return *buffer;
+}
+
+thread_local TraceScope *tlsCurrent = nullptr;
+
+} // namespace
+
+void TraceScope::begin(const char *name) {
+  name_ = name;
+  bytes_ = 0;
+  parent_ = tlsCurrent;
+  tlsCurrent = this;
+  startNs_ = nowNs();
+}
+
+void TraceScope::end() {
+  int64_t dur = nowNs() - startNs_;
+  tlsCurrent = parent_;
+  if (parent_)
+    parent_->bytes_ += bytes_;
+
+  ThreadBuffer &buffer = threadBuffer();
+  std::lock_guard<std::mutex> lock(buffer.mutex);
+  if (buffer.events.size() < kMaxEventsPerThread)
+    buffer.events.push_back({name_, startNs_, dur});
+  TraceCounter &c = buffer.counters[name_];
+  c.calls += 1;
+  c.totalNs += static_cast<uint64_t>(dur);
+  c.maxNs = std::max(c.maxNs, static_cast<uint64_t>(dur));
+  c.bytes += bytes_;
+  name_ = nullptr;
+}
+
+void Trace::addBytes(uint64_t bytes) {
+  if (tlsCurrent)
+    tlsCurrent->bytes_ += bytes;
+}
+
+void Trace::reset() {
+  std::lock_guard<std::mutex> lock(gRegistryMutex);
+  for (auto &buffer : gBuffers) {
+    std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+    buffer->events.clear();
+    buffer->counters.clear();
+  }
+}
+
+std::vector<TraceCounter> Trace::counters() {
+  // The same literal may live at different addresses in different
+  // translation units, so merge by name
+  std::map<std::string, TraceCounter> merged;
+  {
+    std::lock_guard<std::mutex> lock(gRegistryMutex);
+    for (auto &buffer : gBuffers) {
+      std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+      for (const auto &entry : buffer->counters) {
+        TraceCounter &m = merged[entry.first];
+        m.calls += entry.second.calls;
+        m.totalNs += entry.second.totalNs;
+        m.maxNs = std::max(m.maxNs, entry.second.maxNs);
+        m.bytes += entry.second.bytes;
+      }
+    }
+  }
+
+  std::vector<TraceCounter> result;
+  for (auto &entry : merged) {
+    entry.second.name = entry.first;
+    result.push_back(entry.second);
+  }
+  std::sort(result.begin(), result.end(),
+            [](const TraceCounter &a, const TraceCounter &b) {
+              return a.totalNs > b.totalNs;
+            });
+  return result;
+}
+
+bool Trace::exportChromeTrace(const std::string &path) {
+  std::ofstream out(path);
+  if (!out) {
+    std::cerr << "[Error] Trace: cannot write " << path << std::endl;
+    return false;
+  }
+
+  out.setf(std::ios::fixed);
+  out.precision(3);
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  std::lock_guard<std::mutex> lock(gRegistryMutex);
+  for (auto &buffer : gBuffers) {
+    std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+    for (const auto &e : buffer->events) {
+      out << (first ? "\n" : ",\n") << "{\"name\":\"" << e.name
+          << "\",\"cat\":\"PersonBeauty\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+          << buffer->tid << ",\"ts\":" << e.startNs / 1000.0
+          << ",\"dur\":" << e.durNs / 1000.0 << "}";
+      first = false;
+    }
+  }
+  out << "\n]}\n";
+  return static_cast<bool>(out);
+}
+
+} // namespace PersonBeauty
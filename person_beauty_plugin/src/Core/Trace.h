@@ -0,0 +1,99 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace PersonBeauty {
+
+// Aggregate statistics of one trace scope name
+struct TraceCounter {
+  std::string name;
+  uint64_t calls = 0;
+  uint64_t totalNs = 0;
+  uint64_t maxNs = 0;
+  uint64_t bytes = 0; // Bytes reported through PB_TRACE_BYTES (inclusive)
+};
+
+// Lightweight per-stage tracing.
+// Instrumentation compiles in only when PERSON_BEAUTY_TRACING is defined
+// (CMake option of the same name) and records only while enabled at
+// runtime; a disabled scope costs one relaxed atomic load. Events are kept
+// in per-thread buffers and can be exported as Chrome / Perfetto trace JSON.
+class Trace {
+public:
+  static void setEnabled(bool enabled) {
+    enabled_.store(enabled, std::memory_order_relaxed);
+  }
+  static bool isEnabled() { return enabled_.load(std::memory_order_relaxed); }
+
+  // Drop recorded events and counters
+  static void reset();
+
+  // Counters of every scope name seen so far, sorted by total time
+  static std::vector<TraceCounter> counters();
+
+  // Write all recorded events in Chrome trace-event format
+  // (chrome://tracing, ui.perfetto.dev)
+  static bool exportChromeTrace(const std::string &path);
+
+  // Attribute an allocation to the innermost open scope on this thread
+  static void addBytes(uint64_t bytes);
+
+private:
+  static inline std::atomic<bool> enabled_{false};
+};
+
+// RAII scope. `name` must outlive the trace (use string literals).
+class TraceScope {
+public:
+  explicit TraceScope(const char *name) {
+    if (Trace::isEnabled())
+      begin(name);
+  }
+  ~TraceScope() {
+    if (name_)
+      end();
+  }
+
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+  // Close the current phase and open the next one under a new name
+  void next(const char *name) {
+    if (name_)
+      end();
+    if (Trace::isEnabled())
+      begin(name);
+  }
+
+private:
+  friend class Trace;
+  void begin(const char *name);
+  void end();
+
+  const char *name_ = nullptr;
+  int64_t startNs_ = 0;
+  uint64_t bytes_ = 0;
+  TraceScope *parent_ = nullptr;
+};
+
+} // namespace PersonBeauty
+
+#ifdef PERSON_BEAUTY_TRACING
+#define PB_TRACE_CONCAT_(a, b) a##b
+#define PB_TRACE_CONCAT(a, b) PB_TRACE_CONCAT_(a, b)
+// Time the enclosing block
+#define PB_TRACE_SCOPE(name)                                                   \
+  ::PersonBeauty::TraceScope PB_TRACE_CONCAT(pbTraceScope_, __LINE__)(name)
+// Sequential phases of one function: PB_TRACE_PHASE opens the first,
+// PB_TRACE_NEXT closes the current phase and opens the next
+#define PB_TRACE_PHASE(var, name) ::PersonBeauty::TraceScope var(name)
+#define PB_TRACE_NEXT(var, name) var.next(name)
+#define PB_TRACE_BYTES(bytes) ::PersonBeauty::Trace::addBytes(bytes)
+#else
+#define PB_TRACE_SCOPE(name) ((void)0)
+#define PB_TRACE_PHASE(var, name) ((void)0)
+#define PB_TRACE_NEXT(var, name) ((void)0)
+#define PB_TRACE_BYTES(bytes) ((void)0)
+#endif
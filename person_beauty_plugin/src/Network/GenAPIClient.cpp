@@ -1,122 +1,580 @@
 #include "GenAPIClient.h"
-#include <curl/curl.h>
+#include "../Core/TaskScheduler.h"
+#include "ImageResponse.h"
+#include "../Processing/MaskProcessor.h"
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <opencv2/opencv.hpp>
-#include <thread>
+#include <random>
 
 namespace PersonBeauty {
 namespace Network {
 
+struct GenJob {
+  GenAPIClient *client = nullptr;
+  ImageBuffer input;
+  ImageBuffer mask;
+  std::string prompt;
+  GenCallback callback;
+  std::chrono::steady_clock::time_point deadline;
+  // Encoded once for all attempts; the body streams from these buffers
+  std::shared_ptr<std::vector<uint8_t>> imageBytes;
+  std::shared_ptr<std::vector<uint8_t>> maskBytes;
+  std::shared_ptr<const HttpBody> body;
+  std::vector<HttpFormPart> form;
+  cv::Rect region;  // Uploaded part of the input
+  cv::Size upload;  // Size of the uploaded image
+  size_t uploadBytes = 0;
+  std::string cacheKey;
+  // Compressed result of the current attempt, decoded once the job is Ok
+  std::shared_ptr<std::vector<uint8_t>> responseBytes;
+  std::shared_ptr<ImageResponseSink> sink;
+  std::promise<GenResult> promise;
+  int attempts = 0;
+  std::atomic<bool> cancelled{false};
+  std::atomic<bool> finished{false}; // Result decided
+  std::mutex mutex;
+  uint64_t transferId = 0; // HttpClient transfer in progress, 0 if none
+};
+
+void GenHandle::cancel() {
+  if (job_ && !job_->finished)
+    job_->client->cancelJob(job_);
+}
+
 GenAPIClient::GenAPIClient(const std::string &endpoint,
-                           const std::string &apiKey)
-    : endpoint_(endpoint), apiKey_(apiKey) {
-  static bool curl_initialized = false;
-  if (!curl_initialized) {
-    curl_global_init(CURL_GLOBAL_ALL);
-    curl_initialized = true;
-  }
-}
-
-static std::string base64_encode(const cv::Mat &mat) {
-  std::vector<uchar> buf;
-  cv::imencode(".jpg", mat, buf);
-  static const char *base64_chars =
-      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-  std::string ret;
-  int i = 0;
-  unsigned char char_array_3[3];
-  unsigned char char_array_4[4];
-
-  for (auto const &c : buf) {
-    char_array_3[i++] = c;
-    if (i == 3) {
-      char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-      char_array_4[1] =
-          ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-      char_array_4[2] =
-          ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-      char_array_4[3] = char_array_3[2] & 0x3f;
-      for (i = 0; (i < 4); i++)
-        ret += base64_chars[char_array_4[i]];
-      i = 0;
+                           const std::string &apiKey,
+                           const GenAPIConfig &config)
+    : endpoint_(endpoint), apiKey_(apiKey), config_(config),
+      http_(std::make_unique<HttpClient>(config.http)) {
+  config_.maxPending = std::max<size_t>(1, config_.maxPending);
+  config_.maxAttempts = std::max(1, config_.maxAttempts);
+  if (!config_.cacheDir.empty()) {
+    cache_ = std::make_unique<ResultCache>(config_.cacheDir,
+                                           config_.cacheBytes);
+    if (!cache_->valid())
+      cache_.reset();
+  }
+}
+
+GenAPIClient::~GenAPIClient() {
+  std::vector<std::shared_ptr<GenJob>> jobs;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobs.assign(jobs_.begin(), jobs_.end());
+  }
+  for (const auto &job : jobs)
+    cancelJob(job);
+  // Jobs reference `this` until they have released their slot
+  std::unique_lock<std::mutex> lock(mutex_);
+  slotCv_.wait(lock, [this]() { return jobs_.empty(); });
+}
+
+static std::string jsonEscape(const std::string &text) {
+  std::string out;
+  out.reserve(text.size());
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      static const char hex[] = "0123456789abcdef";
+      out += "\\u00";
+      out += hex[(c >> 4) & 0xf];
+      out += hex[c & 0xf];
+    } else {
+      out += c;
     }
   }
+  return out;
+}
+
+static std::string mimeType(const std::string &ext) {
+  if (ext == ".png")
+    return "image/png";
+  if (ext == ".webp")
+    return "image/webp";
+  return "image/jpeg";
+}
 
-  if (i) {
-    int j;
-    for (j = i; j < 3; j++)
-      char_array_3[j] = '\0';
-    char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-    char_array_4[1] =
-        ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-    char_array_4[2] =
-        ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-    char_array_4[3] = char_array_3[2] & 0x3f;
-    for (j = 0; (j < i + 1); j++)
-      ret += base64_chars[char_array_4[j]];
-    while ((i++ < 3))
-      ret += '=';
+// Dimensions, type and rows of `image`; views hash only their own pixels
+static void addPixels(ContentHash &hash, const cv::Mat &image) {
+  const int header[] = {image.cols, image.rows, image.type()};
+  hash.add(header, sizeof(header));
+  const size_t rowBytes = image.cols * image.elemSize();
+  for (int y = 0; y < image.rows; ++y)
+    hash.add(image.ptr(y), rowBytes);
+}
+
+// Padded bounding box of the mask's non-zero pixels; the whole frame for an
+// empty mask
+static cv::Rect maskRegion(const cv::Mat &mask, int padding) {
+  const cv::Rect frame(0, 0, mask.cols, mask.rows);
+  cv::Rect box = cv::boundingRect(mask);
+  if (box.empty())
+    return frame;
+  box.x -= padding;
+  box.y -= padding;
+  box.width += 2 * padding;
+  box.height += 2 * padding;
+  return box & frame;
+}
+
+// Blend the service's patch for `region` into a copy of the input; the
+// mask, feathered, is the per-pixel weight of the patch, so pixels outside
+// it keep the input's values
+static ImageBuffer compositePatch(const ImageBuffer &input,
+                                  const ImageBuffer &mask, cv::Mat patch,
+                                  const cv::Rect &region, int feather) {
+  const cv::Mat &src = input.getMat();
+  ImageBuffer out(src.cols, src.rows, input.format());
+  src.copyTo(out.getMat());
+
+  if (patch.size() != region.size())
+    cv::resize(patch, patch, region.size(), 0, 0,
+               patch.cols > region.width ? cv::INTER_AREA : cv::INTER_LINEAR);
+  // Decoded images are BGR
+  const int code = fromBGRCode(input.format());
+  if (code >= 0)
+    cv::cvtColor(patch, patch, code);
+
+  ImageBuffer alpha(region.width, region.height, 1);
+  if (mask.getMat().size() == src.size())
+    mask.getMat()(region).copyTo(alpha.getMat());
+  else
+    alpha.getMat() = cv::Scalar(255);
+  if (feather > 0)
+    Processing::MaskProcessor::feather(alpha, feather);
+
+  // patch * a + input * (1 - a); a 4th channel keeps the input's alpha
+  cv::Mat base = out.getMat()(region);
+  const int cn = base.channels();
+  const int colors = std::min(cn, 3);
+  for (int y = 0; y < base.rows; ++y) {
+    uint8_t *dst = base.ptr<uint8_t>(y);
+    const uint8_t *fresh = patch.ptr<uint8_t>(y);
+    const uint8_t *weight = alpha.getMat().ptr<uint8_t>(y);
+    for (int x = 0; x < base.cols; ++x) {
+      const int a = weight[x];
+      for (int c = 0; c < colors; ++c) {
+        uint8_t &v = dst[x * cn + c];
+        v = static_cast<uint8_t>(
+            (fresh[x * cn + c] * a + v * (255 - a) + 127) / 255);
+      }
+    }
   }
-  return ret;
+  return out;
+}
+
+std::shared_ptr<std::vector<uint8_t>> GenAPIClient::acquireEncodeBuffer() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (encodeBuffers_.empty())
+    return std::make_shared<std::vector<uint8_t>>();
+  auto buffer = std::move(encodeBuffers_.back());
+  encodeBuffers_.pop_back();
+  return buffer;
+}
+
+void GenAPIClient::recycleEncodeBuffer(
+    std::shared_ptr<std::vector<uint8_t>> &buffer) {
+  // Only once no body refers to it any more
+  if (buffer && buffer.use_count() == 1) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (encodeBuffers_.size() <
+        2 * static_cast<size_t>(std::max(1, config_.http.maxInFlight)))
+      encodeBuffers_.push_back(std::move(buffer));
+  }
+  buffer.reset();
+}
+
+GenHandle GenAPIClient::submit(const ImageBuffer &input,
+                               const ImageBuffer &mask,
+                               const std::string &prompt,
+                               std::chrono::milliseconds deadline) {
+  return enqueue(input, mask, prompt, deadline, nullptr);
 }
 
 void GenAPIClient::generate(const ImageBuffer &input, const ImageBuffer &mask,
                             const std::string &prompt, GenCallback callback) {
+  enqueue(input, mask, prompt, std::chrono::milliseconds(0),
+          std::move(callback));
+}
 
-  std::thread([this, input, mask, prompt, callback]() {
-    CURL *curl;
-    CURLcode res;
-    bool success = false;
-    ImageBuffer resultImage(input.getMat().cols, input.getMat().rows, 3);
-
-    curl = curl_easy_init();
-    if (curl) {
-      struct curl_slist *headers = NULL;
-      headers = curl_slist_append(headers, "Content-Type: application/json");
-      std::string auth = "Authorization: Bearer " + apiKey_;
-      headers = curl_slist_append(headers, auth.c_str());
-
-      std::string imgBase64 = base64_encode(input.getMat());
-      std::string maskBase64 = base64_encode(mask.getMat());
-
-      // Simple manual JSON construct
-      std::string jsonPayload = "{\"prompt\": \"" + prompt +
-                                "\", \"image\": \"" + imgBase64 +
-                                "\", \"mask\": \"" + maskBase64 + "\"}";
-
-      curl_easy_setopt(curl, CURLOPT_URL, endpoint_.c_str());
-      curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-      curl_easy_setopt(curl, CURLOPT_POSTFIELDS, jsonPayload.c_str());
-      curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L);
-
-      std::cout << "[Network] Sending request to " << endpoint_ << " ..."
-                << std::endl;
+size_t GenAPIClient::pending() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return jobs_.size();
+}
 
-      res = curl_easy_perform(curl);
-
-      if (res == CURLE_OK) {
-        long response_code;
-        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
-        if (response_code == 200) {
-          success = true;
-          input.getMat().copyTo(resultImage.getMat());
-        } else {
-          std::cerr << "[Network] API returned error: " << response_code
-                    << std::endl;
-        }
-      } else {
-        std::cerr << "[Network] curl_easy_perform() failed: "
-                  << curl_easy_strerror(res) << std::endl;
+ResultCacheStats GenAPIClient::cacheStats() const {
+  return cache_ ? cache_->stats() : ResultCacheStats();
+}
+
+GenHandle GenAPIClient::enqueue(const ImageBuffer &input,
+                                const ImageBuffer &mask,
+                                const std::string &prompt,
+                                std::chrono::milliseconds deadline,
+                                GenCallback callback) {
+  auto job = std::make_shared<GenJob>();
+  job->client = this;
+  job->input = input;
+  job->mask = mask;
+  job->prompt = prompt;
+  job->callback = std::move(callback);
+  job->deadline = std::chrono::steady_clock::now() +
+                  (deadline.count() > 0 ? deadline : config_.deadline);
+
+  GenHandle handle;
+  handle.job_ = job;
+  handle.result_ = job->promise.get_future().share();
+
+  {
+    // Backpressure: the number of jobs in any stage is bounded
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto hasSlot = [this]() { return jobs_.size() < config_.maxPending; };
+    if (!hasSlot()) {
+      const bool rejected = config_.whenFull == QueueFullPolicy::Reject;
+      if (rejected || !slotCv_.wait_until(lock, job->deadline, hasSlot)) {
+        lock.unlock();
+        GenResult result;
+        result.status = rejected ? GenStatus::Rejected : GenStatus::TimedOut;
+        result.error = "request queue full";
+        job->finished = true;
+        if (job->callback)
+          TaskScheduler::instance().pool().enqueue(
+              [job]() { job->callback(false, ImageBuffer()); },
+              TaskPriority::Low);
+        job->promise.set_value(std::move(result));
+        return handle;
       }
+    }
+    jobs_.insert(job);
+  }
+
+  // Encoding runs on the shared scheduler at low priority; the transfer
+  // itself is multiplexed with all others on the HttpClient loop thread
+  TaskScheduler::instance().pool().enqueue([this, job]() { encode(job); },
+                                           TaskPriority::Low);
+  return handle;
+}
 
-      curl_easy_cleanup(curl);
-      curl_slist_free_all(headers);
+void GenAPIClient::encode(const std::shared_ptr<GenJob> &job) {
+  PB_TRACE_SCOPE("GenAPIClient::encode");
+  GenResult result;
+  if (job->cancelled) {
+    result.status = GenStatus::Cancelled;
+    complete(job, std::move(result));
+    return;
+  }
+  if (std::chrono::steady_clock::now() >= job->deadline) {
+    result.status = GenStatus::TimedOut;
+    result.error = "deadline exceeded before sending";
+    complete(job, std::move(result));
+    return;
+  }
+
+  cv::Mat image = job->input.getMat();
+  cv::Mat mask = job->mask.getMat();
+  job->region = cv::Rect(0, 0, image.cols, image.rows);
+  job->upload = image.size();
+  if (config_.cropToMask && mask.size() == image.size()) {
+    job->region = maskRegion(mask, std::max(0, config_.cropPadding));
+    image = image(job->region);
+    mask = mask(job->region);
+    job->upload = image.size();
+    const int side = std::max(image.cols, image.rows);
+    if (config_.maxUploadSide > 0 && side > config_.maxUploadSide) {
+      const double scale = static_cast<double>(config_.maxUploadSide) / side;
+      job->upload = cv::Size(std::max(1, cvRound(image.cols * scale)),
+                             std::max(1, cvRound(image.rows * scale)));
     }
+  }
 
-    if (callback) {
-      callback(success, resultImage);
+  // Same pixels, prompt and upload settings to the same service: answer
+  // from the cache. The key covers what the upload is made from, so a hit
+  // skips the resize and encode as well as the round trip.
+  job->responseBytes = acquireEncodeBuffer();
+  if (cache_) {
+    ContentHash hash;
+    hash.add(endpoint_)
+        .add(job->prompt)
+        .add(config_.imageFormat)
+        .add(config_.maskFormat)
+        .add(&config_.upload, sizeof(config_.upload));
+    const int layout[] = {static_cast<int>(job->input.format()),
+                          job->region.x,
+                          job->region.y,
+                          job->region.width,
+                          job->region.height,
+                          job->upload.width,
+                          job->upload.height};
+    hash.add(layout, sizeof(layout));
+    addPixels(hash, image);
+    addPixels(hash, mask);
+    job->cacheKey = hash.hex();
+    if (cache_->load(job->cacheKey, *job->responseBytes)) {
+      result.status = GenStatus::Ok;
+      result.cached = true;
+      complete(job, std::move(result));
+      return;
     }
-  }).detach();
+  }
+
+  if (job->upload != image.size()) {
+    cv::Mat small, smallMask;
+    cv::resize(image, small, job->upload, 0, 0, cv::INTER_AREA);
+    cv::resize(mask, smallMask, job->upload, 0, 0, cv::INTER_AREA);
+    image = small;
+    mask = smallMask;
+  }
+
+  // Encoders take BGR; gray is sent as it is
+  if (job->input.format() != PixelFormat::Gray8) {
+    const int code = toBGRCode(job->input.format());
+    if (code >= 0) {
+      cv::Mat bgr;
+      cv::cvtColor(image, bgr, code);
+      image = bgr;
+    }
+  }
+
+  // Compressed bytes go into recycled buffers and are the only copy of
+  // the upload: base64 is produced chunk by chunk while curl reads
+  job->imageBytes = acquireEncodeBuffer();
+  job->maskBytes = acquireEncodeBuffer();
+  if (!cv::imencode(config_.imageFormat, image, *job->imageBytes) ||
+      !cv::imencode(config_.maskFormat, mask, *job->maskBytes)) {
+    result.error = "image encoding failed";
+    complete(job, std::move(result));
+    return;
+  }
+
+  if (config_.upload == UploadMode::Multipart) {
+    auto part = [](const std::shared_ptr<std::vector<uint8_t>> &bytes) {
+      auto body = std::make_shared<SegmentedBody>();
+      body->addBytes(bytes);
+      return body;
+    };
+    job->form = {
+        {"prompt", "", "", job->prompt, nullptr},
+        {"image", "image" + config_.imageFormat,
+         mimeType(config_.imageFormat), "", part(job->imageBytes)},
+        {"mask", "mask" + config_.maskFormat, mimeType(config_.maskFormat),
+         "", part(job->maskBytes)}};
+  } else {
+    auto body = std::make_shared<SegmentedBody>();
+    body->addText("{\"prompt\": \"" + jsonEscape(job->prompt) +
+                  "\", \"image\": \"");
+    body->addBytes(job->imageBytes, true);
+    body->addText("\", \"mask\": \"");
+    body->addBytes(job->maskBytes, true);
+    body->addText("\"}");
+    job->body = std::move(body);
+  }
+  job->uploadBytes = job->body ? job->body->size()
+                               : job->imageBytes->size() +
+                                     job->maskBytes->size();
+
+  std::cout << "[Network] Sending request to " << endpoint_ << " ..."
+            << std::endl;
+  attempt(job, std::chrono::milliseconds(0));
+}
+
+void GenAPIClient::attempt(const std::shared_ptr<GenJob> &job,
+                           std::chrono::milliseconds delay) {
+  using namespace std::chrono;
+  const auto remaining = duration_cast<milliseconds>(
+      job->deadline - (steady_clock::now() + delay));
+  if (remaining.count() <= 0) {
+    GenResult result;
+    result.status = GenStatus::TimedOut;
+    result.attempts = job->attempts;
+    result.error = "deadline exceeded";
+    complete(job, std::move(result));
+    return;
+  }
+
+  HttpRequest request;
+  request.url = endpoint_;
+  request.headers = {"Authorization: Bearer " + apiKey_};
+  if (job->body)
+    request.headers.push_back("Content-Type: application/json");
+  request.body = job->body;
+  request.form = job->form;
+  // A fresh sink per attempt: a failed one may have left partial data
+  job->sink = std::make_shared<ImageResponseSink>(
+      config_.responseField, config_.spillBytes, job->responseBytes);
+  request.sink = job->sink;
+  request.timeoutMs = static_cast<long>(remaining.count());
+  request.startDelayMs = static_cast<long>(delay.count());
+  ++job->attempts;
+
+  const uint64_t id = http_->send(
+      std::move(request),
+      [this, job](HttpResponse &resp) { onResponse(job, resp); });
+  {
+    std::lock_guard<std::mutex> lock(job->mutex);
+    job->transferId = id;
+  }
+  // cancelJob() may have run before the id was known
+  if (job->cancelled)
+    http_->cancel(id);
+}
+
+void GenAPIClient::onResponse(const std::shared_ptr<GenJob> &job,
+                              HttpResponse &resp) {
+  {
+    std::lock_guard<std::mutex> lock(job->mutex);
+    job->transferId = 0;
+  }
+  GenResult result;
+  result.attempts = job->attempts;
+  result.httpStatus = resp.status;
+  if (resp.cancelled) {
+    result.status = GenStatus::Cancelled;
+    result.error = resp.error;
+  } else if (resp.ok && resp.status == 200) {
+    result.status = GenStatus::Ok;
+  } else {
+    const bool retryable = !resp.ok || resp.status == 408 ||
+                           resp.status == 429 || resp.status >= 500;
+    if (resp.ok) {
+      result.error = "HTTP " + std::to_string(resp.status);
+      if (!job->sink->text().empty())
+        result.error += ": " + job->sink->text();
+      std::cerr << "[Network] API returned error: " << result.error
+                << std::endl;
+    } else {
+      result.error = resp.error;
+      std::cerr << "[Network] Request failed: " << resp.error << std::endl;
+    }
+    if (retryable && job->attempts < config_.maxAttempts && !job->cancelled) {
+      attempt(job, retryDelay(job->attempts));
+      return;
+    }
+    result.status = std::chrono::steady_clock::now() >= job->deadline
+                        ? GenStatus::TimedOut
+                        : GenStatus::Failed;
+  }
+  complete(job, std::move(result));
+}
+
+void GenAPIClient::complete(const std::shared_ptr<GenJob> &job,
+                            GenResult result) {
+  if (job->finished.exchange(true))
+    return;
+  // Off the loop thread before touching pixels or user code
+  TaskScheduler::instance().pool().enqueue(
+      [this, job, result]() mutable {
+        result.region = job->region;
+        result.uploadBytes = job->uploadBytes;
+        if (result.status == GenStatus::Ok)
+          decodeResult(job, result);
+        // Only fresh responses that decoded are worth serving again
+        const bool cacheable = cache_ && job->sink && job->sink->hasImage() &&
+                               result.status == GenStatus::Ok;
+        if (job->callback)
+          job->callback(result.status == GenStatus::Ok, result.image);
+        job->promise.set_value(std::move(result));
+
+        // Disk writes after the result is out
+        if (cacheable) {
+          if (job->sink->spillPath().empty())
+            cache_->store(job->cacheKey, *job->responseBytes);
+          else
+            cache_->storeFile(job->cacheKey, job->sink->spillPath());
+        }
+        job->sink.reset(); // Removes a spill file
+        recycleEncodeBuffer(job->responseBytes);
+
+        job->body.reset();
+        job->form.clear();
+        recycleEncodeBuffer(job->imageBytes);
+        recycleEncodeBuffer(job->maskBytes);
+
+        // Notify under the lock: the destructor may return as soon as it
+        // is released
+        std::lock_guard<std::mutex> lock(mutex_);
+        jobs_.erase(job);
+        slotCv_.notify_all();
+      },
+      TaskPriority::Low);
+}
+
+void GenAPIClient::decodeResult(const std::shared_ptr<GenJob> &job,
+                                GenResult &result) {
+  PB_TRACE_SCOPE("GenAPIClient::decodeResult");
+  // The sink fills job->responseBytes; a cache hit has no sink
+  std::string spillPath;
+  if (job->sink) {
+    job->sink->close();
+    if (!job->sink->hasImage()) {
+      result.status = GenStatus::Failed;
+      result.error = "response carried no image";
+      return;
+    }
+    spillPath = job->sink->spillPath();
+  }
+
+  // The generated image is expected at the uploaded size, so it decodes
+  // straight into a pooled buffer; other sizes make imdecode reallocate
+  ImageBuffer decoded(job->upload.width, job->upload.height,
+                      PixelFormat::BGR8);
+  cv::Mat &pixels = decoded.getMat();
+  if (!spillPath.empty()) {
+    pixels = cv::imread(spillPath, cv::IMREAD_COLOR);
+  } else {
+    const std::vector<uint8_t> &bytes = *job->responseBytes;
+    cv::imdecode(cv::Mat(1, static_cast<int>(bytes.size()), CV_8UC1,
+                         const_cast<uint8_t *>(bytes.data())),
+                 cv::IMREAD_COLOR, &pixels);
+  }
+  if (pixels.empty()) {
+    result.status = GenStatus::Failed;
+    result.error = "response image could not be decoded";
+    return;
+  }
+
+  if (config_.cropToMask) {
+    result.image = compositePatch(job->input, job->mask, pixels, job->region,
+                                  config_.compositeFeather);
+    return;
+  }
+  // Back to the input's layout; a 4th channel takes the input's alpha
+  const PixelFormat format = job->input.format();
+  const int code = fromBGRCode(format);
+  if (code < 0) {
+    result.image = std::move(decoded);
+    return;
+  }
+  result.image = ImageBuffer(pixels.cols, pixels.rows, format);
+  cv::cvtColor(pixels, result.image.getMat(), code);
+  if (channelCount(format) == 4) {
+    cv::Mat alpha;
+    cv::extractChannel(job->input.getMat(), alpha, 3);
+    if (alpha.size() != pixels.size())
+      cv::resize(alpha, alpha, pixels.size(), 0, 0, cv::INTER_LINEAR);
+    cv::insertChannel(alpha, result.image.getMat(), 3);
+  }
+}
+
+void GenAPIClient::cancelJob(const std::shared_ptr<GenJob> &job) {
+  job->cancelled = true;
+  std::lock_guard<std::mutex> lock(job->mutex);
+  if (job->transferId)
+    http_->cancel(job->transferId);
+}
+
+std::chrono::milliseconds GenAPIClient::retryDelay(int retry) const {
+  // Full jitter on a capped exponential backoff
+  thread_local std::mt19937 rng(std::random_device{}());
+  const int shift = std::min(std::max(retry - 1, 0), 20);
+  const long long cap = std::min<long long>(
+      config_.retryMax.count(), config_.retryBase.count() << shift);
+  if (cap <= 0)
+    return std::chrono::milliseconds(0);
+  std::uniform_int_distribution<long long> jitter(0, cap - 1);
+  return std::chrono::milliseconds(jitter(rng));
 }
 
 } // namespace Network
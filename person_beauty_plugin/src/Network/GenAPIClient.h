@@ -1,7 +1,14 @@
 #pragma once
 #include "../Core/ImageBuffer.h"
+#include "HttpClient.h"
+#include "ResultCache.h"
+#include <chrono>
+#include <condition_variable>
 #include <functional>
 #include <future>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -12,19 +19,149 @@ namespace Network {
 using GenCallback =
     std::function<void(bool success, const ImageBuffer &result)>;
 
+enum class GenStatus { Ok, Failed, Cancelled, TimedOut, Rejected };
+
+struct GenResult {
+  GenStatus status = GenStatus::Failed;
+  ImageBuffer image;
+  long httpStatus = 0; // Of the last attempt
+  int attempts = 0;
+  cv::Rect region;        // Part of the input that was uploaded
+  size_t uploadBytes = 0; // Request body size (one attempt), 0 if cached
+  bool cached = false;    // Served from the result cache, nothing sent
+  std::string error;
+};
+
+// What submit() does while maxPending jobs are outstanding
+enum class QueueFullPolicy {
+  Block, // Wait for a slot, at most until the job's deadline
+  Reject // Return at once with GenStatus::Rejected
+};
+
+// How the image and mask are uploaded
+enum class UploadMode {
+  Json,     // {"prompt", "image", "mask"} with base64 images
+  Multipart // multipart/form-data with the binary images (a third smaller)
+};
+
+struct GenAPIConfig {
+  HttpClientConfig http;
+  UploadMode upload = UploadMode::Json;
+  // cv::imencode extensions
+  std::string imageFormat = ".jpg";
+  std::string maskFormat = ".jpg";
+  // Upload only the mask's bounding box, padded by cropPadding pixels and
+  // downscaled to fit maxUploadSide, then composite the returned patch back
+  // through the mask feathered by compositeFeather. Upload size and
+  // service time then follow the edited region, not the frame. An empty
+  // mask sends the whole frame.
+  bool cropToMask = false;
+  int cropPadding = 32;
+  int maxUploadSide = 1024; // 0 = no limit
+  int compositeFeather = 8;
+  // Jobs submitted and not yet finished (encoding, queued, retrying)
+  size_t maxPending = 256;
+  QueueFullPolicy whenFull = QueueFullPolicy::Block;
+  // Transport errors, 408, 429 and 5xx are retried after a random delay
+  // in [0, min(retryMax, retryBase * 2^retry)) ("full jitter"), so clients
+  // failing together do not retry in lockstep
+  int maxAttempts = 3;
+  std::chrono::milliseconds retryBase{250};
+  std::chrono::milliseconds retryMax{8000};
+  // Default time budget of a job, retries and waiting for a slot included
+  std::chrono::milliseconds deadline{60000};
+  // Responses are decoded while they arrive: an image/* body is the image,
+  // a JSON body carries it base64-encoded (or as a data URL) in
+  // `responseField`. Compressed results larger than spillBytes go to a
+  // temporary file instead of memory (0 = never). Without cropToMask the
+  // decoded frame is handed over as it is, with no composite or copy.
+  std::string responseField = "image";
+  size_t spillBytes = size_t(64) << 20;
+  // On-disk LRU cache of responses keyed by a hash of the endpoint, prompt,
+  // upload settings and source pixels, checked before encoding:
+  // resubmitting the same edit (e.g. after an undo) costs no encode and no
+  // round trip. Empty = no cache.
+  std::string cacheDir;
+  size_t cacheBytes = size_t(256) << 20;
+};
+
+struct GenJob;
+class GenAPIClient;
+
+// One submitted job. Copies refer to the same job.
+class GenHandle {
+public:
+  bool valid() const { return result_.valid(); }
+  const std::shared_future<GenResult> &result() const { return result_; }
+  // Stop the job wherever it is; the result becomes Cancelled unless it
+  // was already decided
+  void cancel();
+
+private:
+  friend class GenAPIClient;
+  std::shared_ptr<GenJob> job_;
+  std::shared_future<GenResult> result_;
+};
+
+// Keep one client for many requests: it owns the HttpClient whose open
+// connections later requests reuse. `endpoint` may be any URL, e.g. a
+// local stub server for testing.
 class GenAPIClient {
 public:
-  GenAPIClient(const std::string &endpoint, const std::string &apiKey);
+  GenAPIClient(const std::string &endpoint, const std::string &apiKey,
+               const GenAPIConfig &config = GenAPIConfig());
+  // Cancels every outstanding job and waits until they have settled
+  ~GenAPIClient();
+  GenAPIClient(const GenAPIClient &) = delete;
+  GenAPIClient &operator=(const GenAPIClient &) = delete;
 
-  // Send mask and prompt to external API for inpainting/generation
-  // Returns a future that resolves when request is sent (or completes,
-  // depending on design) Here we simulate async with std::async
+  // Send mask and prompt to external API for inpainting/generation.
+  // Encoding runs on the TaskScheduler, the transfer on the HttpClient
+  // loop. With the Block policy this may wait for a slot, so do not call
+  // it from a pool worker. `deadline` 0 uses the configured default.
+  GenHandle submit(const ImageBuffer &input, const ImageBuffer &mask,
+                   const std::string &prompt,
+                   std::chrono::milliseconds deadline =
+                       std::chrono::milliseconds(0));
+
+  // Fire-and-forget form of submit(); `callback` runs on a pool worker
   void generate(const ImageBuffer &input, const ImageBuffer &mask,
                 const std::string &prompt, GenCallback callback);
 
+  size_t pending() const;
+  // Zeros when no cache is configured
+  ResultCacheStats cacheStats() const;
+
 private:
+  friend class GenHandle;
+
+  GenHandle enqueue(const ImageBuffer &input, const ImageBuffer &mask,
+                    const std::string &prompt,
+                    std::chrono::milliseconds deadline, GenCallback callback);
+  void encode(const std::shared_ptr<GenJob> &job);
+  void attempt(const std::shared_ptr<GenJob> &job,
+               std::chrono::milliseconds delay);
+  void onResponse(const std::shared_ptr<GenJob> &job, HttpResponse &resp);
+  void complete(const std::shared_ptr<GenJob> &job, GenResult result);
+  // Turn the Ok response of `job` into result.image
+  void decodeResult(const std::shared_ptr<GenJob> &job, GenResult &result);
+  void cancelJob(const std::shared_ptr<GenJob> &job);
+  std::chrono::milliseconds retryDelay(int retry) const;
+  std::shared_ptr<std::vector<uint8_t>> acquireEncodeBuffer();
+  void recycleEncodeBuffer(std::shared_ptr<std::vector<uint8_t>> &buffer);
+
   std::string endpoint_;
   std::string apiKey_;
+  GenAPIConfig config_;
+  std::unique_ptr<HttpClient> http_;
+  std::unique_ptr<ResultCache> cache_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable slotCv_;
+  std::set<std::shared_ptr<GenJob>> jobs_; // Outstanding
+  // Compressed image buffers (uploads and responses) of finished jobs,
+  // reused by the next ones
+  std::vector<std::shared_ptr<std::vector<uint8_t>>> encodeBuffers_;
 };
 
 } // namespace Network
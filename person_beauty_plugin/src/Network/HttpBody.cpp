@@ -0,0 +1,83 @@
+#include "HttpBody.h"
+#include "../Core/Kernels.h"
+#include <algorithm>
+#include <cstring>
+
+namespace PersonBeauty {
+namespace Network {
+
+void SegmentedBody::addText(std::string text) {
+  Segment seg;
+  seg.start = size_;
+  seg.size = text.size();
+  seg.text = std::move(text);
+  size_ += seg.size;
+  segments_.push_back(std::move(seg));
+}
+
+void SegmentedBody::addBytes(Bytes bytes, bool base64) {
+  if (!bytes)
+    return;
+  Segment seg;
+  seg.start = size_;
+  seg.size = base64 ? Kernels::base64EncodedSize(bytes->size())
+                    : bytes->size();
+  seg.bytes = std::move(bytes);
+  seg.base64 = base64;
+  size_ += seg.size;
+  segments_.push_back(std::move(seg));
+}
+
+size_t SegmentedBody::read(size_t offset, char *dst, size_t max) const {
+  size_t done = 0;
+  // Few segments: a linear scan is enough
+  for (const Segment &seg : segments_) {
+    if (done == max)
+      break;
+    const size_t pos = offset + done;
+    if (pos >= seg.start + seg.size)
+      continue;
+    const size_t inner = pos - seg.start;
+    const size_t n = std::min(max - done, seg.size - inner);
+    if (!seg.bytes)
+      std::memcpy(dst + done, seg.text.data() + inner, n);
+    else if (!seg.base64)
+      std::memcpy(dst + done, seg.bytes->data() + inner, n);
+    else
+      readBase64(seg, inner, dst + done, n);
+    done += n;
+  }
+  return done;
+}
+
+void SegmentedBody::readBase64(const Segment &seg, size_t offset, char *dst,
+                               size_t count) {
+  // Output groups of 4 chars map to input groups of 3 bytes; whole groups
+  // go straight into curl's buffer, a group cut by the chunk edge goes
+  // through a 4 byte scratch
+  const uint8_t *src = seg.bytes->data();
+  const size_t srcSize = seg.bytes->size();
+  size_t written = 0;
+  while (written < count) {
+    const size_t pos = offset + written;
+    const size_t group = pos / 4;
+    const size_t skip = pos % 4;
+    const size_t left = count - written;
+    const size_t first = group * 3;
+    if (skip == 0 && left >= 4) {
+      const size_t last = std::min(srcSize, (group + left / 4) * 3);
+      written += Kernels::base64Encode(src + first, last - first,
+                                       dst + written);
+    } else {
+      char scratch[4];
+      Kernels::base64Encode(src + first, std::min<size_t>(3, srcSize - first),
+                            scratch);
+      const size_t n = std::min(4 - skip, left);
+      std::memcpy(dst + written, scratch + skip, n);
+      written += n;
+    }
+  }
+}
+
+} // namespace Network
+} // namespace PersonBeauty
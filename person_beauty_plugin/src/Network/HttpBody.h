@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace PersonBeauty {
+namespace Network {
+
+// Request body that curl pulls in chunks, so it never has to exist as one
+// contiguous string. read() is random access and const: a body can be sent
+// again (retry, redirect) by any number of transfers.
+class HttpBody {
+public:
+  virtual ~HttpBody() = default;
+  virtual size_t size() const = 0;
+  // Copy up to `max` bytes starting at `offset` into `dst`; returns the
+  // count (0 at the end)
+  virtual size_t read(size_t offset, char *dst, size_t max) const = 0;
+};
+
+// A body made of text and byte segments, sent back to back. Byte segments
+// can be base64-encoded on the fly as curl reads them, so an encoded image
+// is never held in memory: only its binary bytes are, shared, not copied.
+class SegmentedBody : public HttpBody {
+public:
+  using Bytes = std::shared_ptr<const std::vector<uint8_t>>;
+
+  void addText(std::string text);
+  void addBytes(Bytes bytes, bool base64 = false);
+
+  size_t size() const override { return size_; }
+  size_t read(size_t offset, char *dst, size_t max) const override;
+
+private:
+  struct Segment {
+    std::string text;
+    Bytes bytes;
+    bool base64 = false;
+    size_t start = 0; // Offset in the body
+    size_t size = 0;  // Bytes sent (after encoding)
+  };
+
+  static void readBase64(const Segment &seg, size_t offset, char *dst,
+                         size_t count);
+
+  std::vector<Segment> segments_;
+  size_t size_ = 0;
+};
+
+// One part of a multipart/form-data request
+struct HttpFormPart {
+  std::string name;
+  std::string filename;    // Optional
+  std::string contentType; // Optional
+  std::string text;        // Used when `body` is not set
+  std::shared_ptr<const HttpBody> body;
+};
+
+} // namespace Network
+} // namespace PersonBeauty
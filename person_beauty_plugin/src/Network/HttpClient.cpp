@@ -0,0 +1,387 @@
+#include "HttpClient.h"
+#include "../Core/Trace.h"
+#include <algorithm>
+#include <curl/curl.h>
+#include <iostream>
+
+namespace PersonBeauty {
+namespace Network {
+
+namespace {
+
+// Read position of one body (request body or form part)
+struct BodyCursor {
+  std::shared_ptr<const HttpBody> body;
+  size_t offset = 0;
+};
+
+size_t readBody(char *dst, size_t size, size_t count, void *user) {
+  auto *cursor = static_cast<BodyCursor *>(user);
+  const size_t n = cursor->body->read(cursor->offset, dst, size * count);
+  cursor->offset += n;
+  return n;
+}
+
+// Rewinds for redirects and re-sent requests
+int seekBody(void *user, curl_off_t offset, int origin) {
+  auto *cursor = static_cast<BodyCursor *>(user);
+  if (origin != SEEK_SET || offset < 0 ||
+      static_cast<size_t>(offset) > cursor->body->size())
+    return CURL_SEEKFUNC_CANTSEEK;
+  cursor->offset = static_cast<size_t>(offset);
+  return CURL_SEEKFUNC_OK;
+}
+
+} // namespace
+
+struct HttpClient::Transfer {
+  uint64_t id = 0;
+  std::chrono::steady_clock::time_point startAt;
+  HttpRequest request;
+  HttpCallback callback;
+  HttpResponse response;
+  curl_slist *headers = nullptr;
+  curl_mime *mime = nullptr;
+  std::vector<std::unique_ptr<BodyCursor>> cursors;
+  CURL *easy = nullptr;
+  bool sinkStarted = false;
+};
+
+size_t HttpClient::receiveBody(char *data, size_t size, size_t count,
+                               void *user) {
+  auto *transfer = static_cast<Transfer *>(user);
+  const size_t n = size * count;
+  HttpSink *sink = transfer->request.sink.get();
+  if (!sink) {
+    transfer->response.body.append(data, n);
+    return n;
+  }
+  if (!transfer->sinkStarted) {
+    transfer->sinkStarted = true;
+    long status = 0;
+    char *type = nullptr;
+    curl_off_t length = -1;
+    curl_easy_getinfo(transfer->easy, CURLINFO_RESPONSE_CODE, &status);
+    curl_easy_getinfo(transfer->easy, CURLINFO_CONTENT_TYPE, &type);
+    curl_easy_getinfo(transfer->easy, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T,
+                      &length);
+    if (!sink->begin(status, type ? type : "", length))
+      return 0;
+  }
+  // A short count makes curl fail the transfer with CURLE_WRITE_ERROR
+  return sink->write(data, n) ? n : 0;
+}
+
+void HttpClient::release(Transfer &transfer) {
+  curl_slist_free_all(transfer.headers);
+  transfer.headers = nullptr;
+  curl_mime_free(transfer.mime);
+  transfer.mime = nullptr;
+  // Bodies may be large; drop them before the callback runs, so the owner
+  // gets its buffers back
+  transfer.cursors.clear();
+  transfer.request.body.reset();
+  transfer.request.form.clear();
+  transfer.request.sink.reset();
+}
+
+HttpClient::HttpClient(const HttpClientConfig &config) : config_(config) {
+  static const bool curlInitialized =
+      curl_global_init(CURL_GLOBAL_ALL) == CURLE_OK;
+  (void)curlInitialized;
+
+  config_.maxInFlight = std::max(1, config_.maxInFlight);
+  if (config_.maxConnectionsPerHost <= 0)
+    config_.maxConnectionsPerHost = config_.maxInFlight;
+
+  CURLM *multi = curl_multi_init();
+  curl_multi_setopt(multi, CURLMOPT_PIPELINING,
+                    config_.http2 ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING);
+  curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS,
+                    static_cast<long>(config_.maxConnectionsPerHost));
+  // Idle connections kept for reuse
+  curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS,
+                    static_cast<long>(config_.maxConnectionsPerHost + 4));
+  multi_ = multi;
+  thread_ = std::thread([this]() { loop(); });
+}
+
+HttpClient::~HttpClient() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  curl_multi_wakeup(multi_);
+  thread_.join();
+  for (void *easy : idleHandles_)
+    curl_easy_cleanup(easy);
+  curl_multi_cleanup(multi_);
+}
+
+uint64_t HttpClient::send(HttpRequest request, HttpCallback callback) {
+  auto transfer = std::make_unique<Transfer>();
+  transfer->startAt = std::chrono::steady_clock::now() +
+                      std::chrono::milliseconds(request.startDelayMs);
+  transfer->request = std::move(request);
+  transfer->callback = std::move(callback);
+  uint64_t id;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    id = transfer->id = nextId_++;
+    queue_.push_back(std::move(transfer));
+  }
+  curl_multi_wakeup(multi_);
+  return id;
+}
+
+void HttpClient::cancel(uint64_t id) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cancelled_.push_back(id);
+  }
+  curl_multi_wakeup(multi_);
+}
+
+size_t HttpClient::queued() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return queue_.size();
+}
+
+void HttpClient::loop() {
+  using Clock = std::chrono::steady_clock;
+  std::vector<std::unique_ptr<Transfer>> starting;
+  std::vector<uint64_t> cancelled;
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stopping_)
+        break;
+      cancelled.swap(cancelled_);
+    }
+    if (!cancelled.empty()) {
+      cancelTransfers(cancelled);
+      cancelled.clear();
+    }
+
+    // Longest sleep; shortened while a delayed transfer is waiting
+    int waitMs = 1000;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      // FIFO among the transfers whose start delay has passed
+      const Clock::time_point now = Clock::now();
+      for (auto it = queue_.begin(); it != queue_.end();) {
+        if ((*it)->startAt > now) {
+          auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        (*it)->startAt - now)
+                        .count();
+          waitMs = std::min<int>(waitMs, static_cast<int>(ms) + 1);
+          ++it;
+        } else if (active_.size() + starting.size() <
+                   static_cast<size_t>(config_.maxInFlight)) {
+          starting.push_back(std::move(*it));
+          it = queue_.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
+    for (auto &transfer : starting)
+      start(std::move(transfer));
+    starting.clear();
+
+    int running = 0;
+    curl_multi_perform(multi_, &running);
+    CURLMsg *msg;
+    int pending;
+    bool freed = false;
+    while ((msg = curl_multi_info_read(multi_, &pending))) {
+      if (msg->msg == CURLMSG_DONE) {
+        finish(msg->easy_handle, msg->data.result);
+        freed = true;
+      }
+    }
+
+    // Sleeps until a socket is ready, curl's next timeout or a wakeup from
+    // send() / the destructor. A finished transfer freed a slot: go straight
+    // round to start the next queued one.
+    curl_multi_poll(multi_, nullptr, 0, freed ? 0 : waitMs, nullptr);
+  }
+  abortAll();
+}
+
+void HttpClient::start(std::unique_ptr<Transfer> transfer) {
+  CURL *easy;
+  if (!idleHandles_.empty()) {
+    easy = idleHandles_.back();
+    idleHandles_.pop_back();
+  } else {
+    easy = curl_easy_init();
+  }
+
+  const HttpRequest &request = transfer->request;
+  for (const auto &header : request.headers)
+    transfer->headers = curl_slist_append(transfer->headers, header.c_str());
+
+  curl_easy_setopt(easy, CURLOPT_URL, request.url.c_str());
+  curl_easy_setopt(easy, CURLOPT_HTTPHEADER, transfer->headers);
+  if (!request.form.empty()) {
+    transfer->mime = curl_mime_init(easy);
+    for (const auto &field : request.form) {
+      curl_mimepart *part = curl_mime_addpart(transfer->mime);
+      curl_mime_name(part, field.name.c_str());
+      if (!field.filename.empty())
+        curl_mime_filename(part, field.filename.c_str());
+      if (!field.contentType.empty())
+        curl_mime_type(part, field.contentType.c_str());
+      if (field.body) {
+        auto cursor = std::make_unique<BodyCursor>();
+        cursor->body = field.body;
+        curl_mime_data_cb(part, static_cast<curl_off_t>(field.body->size()),
+                          readBody, seekBody, nullptr, cursor.get());
+        transfer->cursors.push_back(std::move(cursor));
+      } else {
+        curl_mime_data(part, field.text.data(), field.text.size());
+      }
+    }
+    curl_easy_setopt(easy, CURLOPT_MIMEPOST, transfer->mime);
+  } else if (request.body) {
+    // Streamed: curl pulls the body into its own upload buffer
+    auto cursor = std::make_unique<BodyCursor>();
+    cursor->body = request.body;
+    curl_easy_setopt(easy, CURLOPT_POST, 1L);
+    curl_easy_setopt(easy, CURLOPT_POSTFIELDSIZE_LARGE,
+                     static_cast<curl_off_t>(request.body->size()));
+    curl_easy_setopt(easy, CURLOPT_READFUNCTION, readBody);
+    curl_easy_setopt(easy, CURLOPT_READDATA, cursor.get());
+    curl_easy_setopt(easy, CURLOPT_SEEKFUNCTION, seekBody);
+    curl_easy_setopt(easy, CURLOPT_SEEKDATA, cursor.get());
+    transfer->cursors.push_back(std::move(cursor));
+  }
+  curl_easy_setopt(easy, CURLOPT_TIMEOUT_MS, request.timeoutMs);
+  curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT_MS, config_.connectTimeoutMs);
+  curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE, 1L);
+  curl_easy_setopt(easy, CURLOPT_HTTP_VERSION,
+                   config_.http2 ? CURL_HTTP_VERSION_2TLS
+                                 : CURL_HTTP_VERSION_1_1);
+  // Wait for a connection that can multiplex instead of opening another
+  if (config_.http2)
+    curl_easy_setopt(easy, CURLOPT_PIPEWAIT, 1L);
+  transfer->easy = easy;
+  curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, receiveBody);
+  curl_easy_setopt(easy, CURLOPT_WRITEDATA, transfer.get());
+
+  CURLMcode rc = curl_multi_add_handle(multi_, easy);
+  if (rc != CURLM_OK) {
+    std::cerr << "[Network] curl_multi_add_handle() failed: "
+              << curl_multi_strerror(rc) << std::endl;
+    transfer->response.error = curl_multi_strerror(rc);
+    curl_easy_cleanup(easy);
+    release(*transfer);
+    if (transfer->callback)
+      transfer->callback(transfer->response);
+    return;
+  }
+  active_[easy] = std::move(transfer);
+  ++inFlight_;
+}
+
+void HttpClient::finish(void *easy, int result) {
+  PB_TRACE_SCOPE("HttpClient::finish");
+  auto it = active_.find(easy);
+  if (it == active_.end())
+    return;
+  std::unique_ptr<Transfer> transfer = std::move(it->second);
+  active_.erase(it);
+  --inFlight_;
+
+  HttpResponse &response = transfer->response;
+  const CURLcode code = static_cast<CURLcode>(result);
+  if (code == CURLE_OK) {
+    response.ok = true;
+    curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &response.status);
+    char *type = nullptr;
+    curl_easy_getinfo(easy, CURLINFO_CONTENT_TYPE, &type);
+    if (type)
+      response.contentType = type;
+  } else {
+    response.error = curl_easy_strerror(code);
+  }
+  long connects = 0;
+  curl_easy_getinfo(easy, CURLINFO_NUM_CONNECTS, &connects);
+  connectionsOpened_ += connects;
+
+  // The connection goes back to the multi handle's cache; the easy handle
+  // is kept for the next request
+  curl_multi_remove_handle(multi_, easy);
+  if (idleHandles_.size() < static_cast<size_t>(config_.maxInFlight)) {
+    curl_easy_reset(easy);
+    idleHandles_.push_back(easy);
+  } else {
+    curl_easy_cleanup(easy);
+  }
+  release(*transfer);
+
+  if (transfer->callback)
+    transfer->callback(response);
+}
+
+void HttpClient::cancelTransfers(const std::vector<uint64_t> &ids) {
+  std::vector<std::unique_ptr<Transfer>> dropped;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = queue_.begin(); it != queue_.end();) {
+      if (std::find(ids.begin(), ids.end(), (*it)->id) != ids.end()) {
+        dropped.push_back(std::move(*it));
+        it = queue_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+  for (auto it = active_.begin(); it != active_.end();) {
+    if (std::find(ids.begin(), ids.end(), it->second->id) != ids.end()) {
+      curl_multi_remove_handle(multi_, it->first);
+      curl_easy_cleanup(it->first);
+      release(*it->second);
+      dropped.push_back(std::move(it->second));
+      it = active_.erase(it);
+      --inFlight_;
+    } else {
+      ++it;
+    }
+  }
+
+  for (auto &transfer : dropped) {
+    transfer->response.cancelled = true;
+    transfer->response.error = "cancelled";
+    if (transfer->callback)
+      transfer->callback(transfer->response);
+  }
+}
+
+void HttpClient::abortAll() {
+  std::deque<std::unique_ptr<Transfer>> waiting;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    waiting.swap(queue_);
+  }
+  for (auto &entry : active_) {
+    curl_multi_remove_handle(multi_, entry.first);
+    curl_easy_cleanup(entry.first);
+    release(*entry.second);
+    waiting.push_back(std::move(entry.second));
+  }
+  active_.clear();
+  inFlight_ = 0;
+
+  for (auto &transfer : waiting) {
+    transfer->response.cancelled = true;
+    transfer->response.error = "client shut down";
+    if (transfer->callback)
+      transfer->callback(transfer->response);
+  }
+}
+
+} // namespace Network
+} // namespace PersonBeauty
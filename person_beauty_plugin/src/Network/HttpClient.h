@@ -0,0 +1,124 @@
+#pragma once
+#include "HttpBody.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace PersonBeauty {
+namespace Network {
+
+// Consumes a response body as it arrives, instead of HttpResponse::body.
+// Called on the loop thread: keep it cheap per chunk.
+class HttpSink {
+public:
+  virtual ~HttpSink() = default;
+  // Before the first chunk, with what the headers announced
+  // (contentLength -1 if unknown). Returning false aborts the transfer.
+  virtual bool begin(long status, const std::string &contentType,
+                     int64_t contentLength) = 0;
+  virtual bool write(const char *data, size_t size) = 0;
+};
+
+struct HttpRequest {
+  std::string url;
+  std::vector<std::string> headers; // "Name: value"
+  // POSTed when set, else GET. curl pulls it in chunks; shared so that
+  // retries resend it without a copy.
+  std::shared_ptr<const HttpBody> body;
+  // multipart/form-data POST instead of `body` when not empty
+  std::vector<HttpFormPart> form;
+  // Receives the response body when set (one sink per transfer)
+  std::shared_ptr<HttpSink> sink;
+  long timeoutMs = 30000;
+  // Wait this long before starting (retry backoff); the transfer does not
+  // take an in-flight slot meanwhile
+  long startDelayMs = 0;
+};
+
+struct HttpResponse {
+  bool ok = false; // The transfer completed (with any status)
+  bool cancelled = false;
+  long status = 0;
+  std::string contentType;
+  std::string body; // Empty when the request had a sink
+  std::string error; // Why the transfer failed when !ok
+};
+
+using HttpCallback = std::function<void(HttpResponse &response)>;
+
+struct HttpClientConfig {
+  // Transfers running at once; further requests wait in FIFO order
+  int maxInFlight = 8;
+  // Open connections per host (0 = maxInFlight)
+  int maxConnectionsPerHost = 0;
+  // Negotiate HTTP/2 on TLS connections and multiplex concurrent requests
+  // to one host over a single connection; HTTP/1.1 servers are unaffected
+  bool http2 = true;
+  long connectTimeoutMs = 10000;
+};
+
+// A single event-loop thread drives every transfer through one curl multi
+// handle. Connections stay open after a response and are reused by later
+// requests to the same host, so TCP and TLS setup is paid once rather than
+// per request, and the thread count no longer grows with the load.
+// Callbacks run on the loop thread: keep them short and hand decoding or
+// other heavy work to the TaskScheduler.
+class HttpClient {
+public:
+  explicit HttpClient(const HttpClientConfig &config = HttpClientConfig());
+  // Aborts queued and running transfers (their callbacks see `cancelled`)
+  ~HttpClient();
+  HttpClient(const HttpClient &) = delete;
+  HttpClient &operator=(const HttpClient &) = delete;
+
+  // Thread-safe, also from a callback. Returns an id for cancel().
+  uint64_t send(HttpRequest request, HttpCallback callback);
+  // Abort a queued or running transfer; its callback runs with
+  // `cancelled` set. Unknown or finished ids are ignored.
+  void cancel(uint64_t id);
+
+  size_t inFlight() const { return inFlight_.load(); }
+  size_t queued() const;
+  // Connections opened so far; fewer than requests sent means reuse
+  long connectionsOpened() const { return connectionsOpened_.load(); }
+
+private:
+  struct Transfer;
+
+  void loop();
+  void start(std::unique_ptr<Transfer> transfer);
+  void finish(void *easy, int result);
+  static void release(Transfer &transfer);
+  static size_t receiveBody(char *data, size_t size, size_t count,
+                            void *user);
+  void cancelTransfers(const std::vector<uint64_t> &ids);
+  void abortAll();
+
+  HttpClientConfig config_;
+  void *multi_ = nullptr; // CURLM, kept out of this header
+  std::thread thread_;
+
+  mutable std::mutex mutex_;
+  std::deque<std::unique_ptr<Transfer>> queue_;
+  std::vector<uint64_t> cancelled_;
+  uint64_t nextId_ = 1;
+  bool stopping_ = false;
+
+  // Loop thread only
+  std::map<void *, std::unique_ptr<Transfer>> active_;
+  std::vector<void *> idleHandles_; // Reset easy handles for reuse
+
+  std::atomic<size_t> inFlight_{0};
+  std::atomic<long> connectionsOpened_{0};
+};
+
+} // namespace Network
+} // namespace PersonBeauty
@@ -0,0 +1,244 @@
+#include "ImageResponse.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+
+namespace PersonBeauty {
+namespace Network {
+
+namespace {
+
+// Error bodies are kept up to this size for messages
+constexpr size_t kMaxText = 1024;
+
+// Sextet of a base64 (or base64url) character, -1 for others
+int base64Value(unsigned char c) {
+  static const auto table = []() {
+    std::array<int8_t, 256> t;
+    t.fill(-1);
+    const char *alphabet =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    for (int i = 0; i < 64; ++i)
+      t[static_cast<unsigned char>(alphabet[i])] = static_cast<int8_t>(i);
+    t['-'] = 62;
+    t['_'] = 63;
+    return t;
+  }();
+  return table[c];
+}
+
+} // namespace
+
+ImageResponseSink::ImageResponseSink(
+    std::string field, size_t spillBytes,
+    std::shared_ptr<std::vector<uint8_t>> buffer)
+    : key_("\"" + field + "\""), spillBytes_(spillBytes),
+      buffer_(buffer ? std::move(buffer)
+                     : std::make_shared<std::vector<uint8_t>>()) {
+  buffer_->clear();
+}
+
+ImageResponseSink::~ImageResponseSink() {
+  close();
+  if (!spillPath_.empty()) {
+    std::error_code ec;
+    std::filesystem::remove(spillPath_, ec);
+  }
+}
+
+bool ImageResponseSink::begin(long status, const std::string &contentType,
+                              int64_t contentLength) {
+  if (status != 200)
+    mode_ = Mode::Text;
+  else if (contentType.compare(0, 6, "image/") == 0 ||
+           contentType.compare(0, 24, "application/octet-stream") == 0)
+    mode_ = Mode::Binary;
+  else if (contentType.find("json") != std::string::npos)
+    mode_ = Mode::Json;
+
+  if (contentLength > 0 && (mode_ == Mode::Binary || mode_ == Mode::Json)) {
+    // Base64 carries 3 bytes per 4 chars
+    size_t expected = static_cast<size_t>(contentLength);
+    if (mode_ == Mode::Json)
+      expected = expected / 4 * 3;
+    if (spillBytes_ > 0 && expected > spillBytes_)
+      return spill();
+    buffer_->reserve(expected);
+  }
+  return true;
+}
+
+bool ImageResponseSink::write(const char *data, size_t size) {
+  if (mode_ == Mode::Sniff) {
+    // Untyped body: JSON if it starts like an object
+    const char *end = data + size;
+    const char *first = std::find_if(data, end, [](char c) {
+      return c != ' ' && c != '\n' && c != '\r' && c != '\t';
+    });
+    if (first == end)
+      return true;
+    mode_ = *first == '{' ? Mode::Json : Mode::Binary;
+  }
+
+  switch (mode_) {
+  case Mode::Binary:
+    return append(reinterpret_cast<const uint8_t *>(data), size);
+  case Mode::Json:
+    scanJson(data, size);
+    return !failed_;
+  default:
+    text_.append(data, std::min(size, kMaxText - std::min(kMaxText,
+                                                          text_.size())));
+    return true;
+  }
+}
+
+void ImageResponseSink::scanJson(const char *data, size_t size) {
+  uint8_t out[3 * 1024];
+  size_t outCount = 0;
+  auto flush = [&]() {
+    if (outCount > 0 && !append(out, outCount))
+      failed_ = true;
+    outCount = 0;
+  };
+
+  for (size_t i = 0; i < size && scan_ != Scan::Done && !failed_; ++i) {
+    const char c = data[i];
+    switch (scan_) {
+    case Scan::Key:
+      // The key starts with a quote, so a mismatch can only restart there
+      if (c == key_[keyMatched_])
+        ++keyMatched_;
+      else
+        keyMatched_ = c == '"' ? 1 : 0;
+      if (keyMatched_ == key_.size()) {
+        keyMatched_ = 0;
+        scan_ = Scan::Colon;
+      }
+      break;
+    case Scan::Colon:
+    case Scan::Quote:
+      if (c == ' ' || c == '\n' || c == '\r' || c == '\t')
+        break;
+      if (scan_ == Scan::Colon && c == ':')
+        scan_ = Scan::Quote;
+      else if (scan_ == Scan::Quote && c == '"')
+        scan_ = Scan::Value;
+      else // The same text as a value, or a non-string value
+        scan_ = Scan::Key;
+      break;
+    case Scan::Value: {
+      if (escaped_) {
+        // Only "\/" can stand for a base64 character; "\n" etc. are
+        // line breaks
+        escaped_ = false;
+        if (c != '/')
+          break;
+      } else if (c == '\\') {
+        escaped_ = true;
+        break;
+      } else if (c == '"' || c == '=') {
+        // End of the data: flush the final partial group
+        if (quadCount_ == 2) {
+          out[outCount++] = static_cast<uint8_t>(quad_ >> 4);
+        } else if (quadCount_ == 3) {
+          out[outCount++] = static_cast<uint8_t>(quad_ >> 10);
+          out[outCount++] = static_cast<uint8_t>(quad_ >> 2);
+        }
+        quad_ = 0;
+        quadCount_ = 0;
+        if (c == '"')
+          scan_ = Scan::Done;
+        break;
+      } else if (c == ',') {
+        // "data:image/png;base64," prefix: what was decoded is not data
+        outCount = 0;
+        quad_ = 0;
+        quadCount_ = 0;
+        buffer_->clear();
+        break;
+      }
+      const int v = base64Value(static_cast<unsigned char>(c));
+      if (v < 0)
+        break;
+      quad_ = (quad_ << 6) | static_cast<uint32_t>(v);
+      if (++quadCount_ == 4) {
+        out[outCount++] = static_cast<uint8_t>(quad_ >> 16);
+        out[outCount++] = static_cast<uint8_t>(quad_ >> 8);
+        out[outCount++] = static_cast<uint8_t>(quad_);
+        quad_ = 0;
+        quadCount_ = 0;
+        if (outCount + 3 > sizeof(out))
+          flush();
+      }
+      break;
+    }
+    case Scan::Done:
+      break;
+    }
+  }
+  flush();
+}
+
+bool ImageResponseSink::append(const uint8_t *data, size_t size) {
+  if (!spillFile_ && spillBytes_ > 0 && buffer_->size() + size > spillBytes_)
+    if (!spill())
+      return false;
+  if (spillFile_) {
+    if (std::fwrite(data, 1, size, spillFile_) != size) {
+      std::cerr << "[Network] Failed to write " << spillPath_ << std::endl;
+      failed_ = true;
+      return false;
+    }
+    return true;
+  }
+  buffer_->insert(buffer_->end(), data, data + size);
+  return true;
+}
+
+bool ImageResponseSink::spill() {
+  static std::atomic<uint64_t> counter{0};
+  const auto stamp =
+      std::chrono::steady_clock::now().time_since_epoch().count();
+  spillPath_ = (std::filesystem::temp_directory_path() /
+                ("person_beauty_gen_" + std::to_string(stamp) + "_" +
+                 std::to_string(counter++)))
+                   .string();
+  spillFile_ = std::fopen(spillPath_.c_str(), "wb");
+  if (!spillFile_) {
+    std::cerr << "[Network] Cannot create " << spillPath_ << std::endl;
+    spillPath_.clear();
+    failed_ = true;
+    return false;
+  }
+  // What arrived so far moves to the file; the buffer keeps its capacity
+  // for the next response
+  if (!buffer_->empty() &&
+      std::fwrite(buffer_->data(), 1, buffer_->size(), spillFile_) !=
+          buffer_->size())
+    failed_ = true;
+  buffer_->clear();
+  return !failed_;
+}
+
+void ImageResponseSink::close() {
+  if (spillFile_) {
+    if (std::fclose(spillFile_) != 0)
+      failed_ = true;
+    spillFile_ = nullptr;
+  }
+}
+
+bool ImageResponseSink::hasImage() const {
+  if (failed_)
+    return false;
+  if (mode_ == Mode::Json)
+    return scan_ == Scan::Done;
+  return mode_ == Mode::Binary && (!buffer_->empty() || !spillPath_.empty());
+}
+
+} // namespace Network
+} // namespace PersonBeauty
@@ -0,0 +1,69 @@
+#pragma once
+#include "HttpClient.h"
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace PersonBeauty {
+namespace Network {
+
+// Collects the compressed image of a generation response while it arrives.
+// Binary bodies (image/*, octet-stream) are kept as they are. JSON bodies
+// are scanned for the string value of `field`, which is base64-decoded on
+// the fly (a "data:...;base64," prefix is dropped); the rest of the JSON is
+// never stored. The bytes go to `buffer`, or to a temporary file once they
+// would exceed `spillBytes` (0 = never).
+class ImageResponseSink : public HttpSink {
+public:
+  ImageResponseSink(std::string field, size_t spillBytes,
+                    std::shared_ptr<std::vector<uint8_t>> buffer);
+  // Removes the spill file
+  ~ImageResponseSink() override;
+  ImageResponseSink(const ImageResponseSink &) = delete;
+  ImageResponseSink &operator=(const ImageResponseSink &) = delete;
+
+  bool begin(long status, const std::string &contentType,
+             int64_t contentLength) override;
+  bool write(const char *data, size_t size) override;
+
+  // Flush and close the spill file; call once the transfer is done
+  void close();
+  // A complete image was received
+  bool hasImage() const;
+  // The image bytes, unless they were spilled
+  const std::vector<uint8_t> &bytes() const { return *buffer_; }
+  // Spill file holding the image bytes, empty if kept in memory
+  const std::string &spillPath() const { return spillPath_; }
+  // Start of a body without an image (e.g. an error message)
+  const std::string &text() const { return text_; }
+
+private:
+  enum class Mode { Sniff, Binary, Json, Text };
+  enum class Scan { Key, Colon, Quote, Value, Done };
+
+  void scanJson(const char *data, size_t size);
+  bool append(const uint8_t *data, size_t size);
+  bool spill();
+
+  std::string key_; // "field" with quotes
+  size_t spillBytes_;
+  std::shared_ptr<std::vector<uint8_t>> buffer_;
+  Mode mode_ = Mode::Sniff;
+  std::string text_;
+
+  // JSON scanner
+  Scan scan_ = Scan::Key;
+  size_t keyMatched_ = 0;
+  bool escaped_ = false;
+  uint32_t quad_ = 0; // Pending base64 sextets
+  int quadCount_ = 0;
+
+  std::string spillPath_;
+  std::FILE *spillFile_ = nullptr;
+  bool failed_ = false;
+};
+
+} // namespace Network
+} // namespace PersonBeauty
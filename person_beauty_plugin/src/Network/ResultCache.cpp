@@ -0,0 +1,324 @@
+#include "ResultCache.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace PersonBeauty {
+namespace Network {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// xxHash64 primes and lane round
+constexpr uint64_t kPrime1 = 11400714785074694791ull;
+constexpr uint64_t kPrime2 = 14029467366897019519ull;
+constexpr uint64_t kPrime3 = 1609587929392839161ull;
+constexpr uint64_t kPrime4 = 9650029242287828579ull;
+constexpr uint64_t kPrime5 = 2870177450012600261ull;
+
+uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+uint64_t mixLane(uint64_t acc, uint64_t word) {
+  acc += word * kPrime2;
+  return rotl(acc, 31) * kPrime1;
+}
+
+uint64_t readWord(const uint8_t *p) {
+  uint64_t word;
+  std::memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+// Fold the unstriped tail into `h` and avalanche
+uint64_t finish(uint64_t h, const uint8_t *tail, size_t size) {
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8)
+    h = rotl(h ^ mixLane(0, readWord(tail + i)), 27) * kPrime1 + kPrime4;
+  for (; i < size; ++i)
+    h = rotl(h ^ (tail[i] * kPrime5), 11) * kPrime1;
+  h ^= h >> 33;
+  h *= kPrime2;
+  h ^= h >> 29;
+  h *= kPrime3;
+  h ^= h >> 32;
+  return h;
+}
+
+// Temporary files untouched for this long belong to no live store
+constexpr auto kStaleTempAge = std::chrono::hours(1);
+
+bool isKey(const std::string &name) {
+  return name.size() == 32 &&
+         std::all_of(name.begin(), name.end(), [](char c) {
+           return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+         });
+}
+
+// Force a file's data, or a directory's entries, to the disk. Without it
+// a power loss after rename() can leave the new name on a truncated file.
+bool syncPath(const std::string &path, bool directory) {
+#ifdef _WIN32
+  // NTFS journals the rename; directories cannot be flushed from here
+  if (directory)
+    return true;
+  const int fd = _open(path.c_str(), _O_RDWR | _O_BINARY);
+  if (fd < 0)
+    return false;
+  const bool ok = _commit(fd) == 0;
+  _close(fd);
+  return ok;
+#else
+  const int fd = ::open(path.c_str(), directory ? O_RDONLY : O_RDWR);
+  if (fd < 0)
+    return false;
+  const bool ok = ::fsync(fd) == 0;
+  ::close(fd);
+  return ok;
+#endif
+}
+
+} // namespace
+
+ContentHash::ContentHash()
+    : lanes_{kPrime1 + kPrime2, kPrime2, 0, 0 - kPrime1} {}
+
+ContentHash &ContentHash::add(const void *data, size_t size) {
+  const uint64_t length = size;
+  update(reinterpret_cast<const uint8_t *>(&length), sizeof(length));
+  update(static_cast<const uint8_t *>(data), size);
+  return *this;
+}
+
+void ContentHash::update(const uint8_t *data, size_t size) {
+  total_ += size;
+  if (pendingSize_ > 0) {
+    const size_t n = std::min(size, sizeof(pending_) - pendingSize_);
+    std::memcpy(pending_ + pendingSize_, data, n);
+    pendingSize_ += n;
+    data += n;
+    size -= n;
+    if (pendingSize_ < sizeof(pending_))
+      return;
+    stripe(pending_);
+    pendingSize_ = 0;
+  }
+  // Whole stripes straight from the caller's memory
+  for (; size >= sizeof(pending_); data += 32, size -= 32)
+    stripe(data);
+  std::memcpy(pending_, data, size);
+  pendingSize_ = size;
+}
+
+void ContentHash::stripe(const uint8_t *data) {
+  // Four independent lanes keep the multipliers busy
+  for (int i = 0; i < 4; ++i)
+    lanes_[i] = mixLane(lanes_[i], readWord(data + 8 * i));
+}
+
+std::string ContentHash::hex() const {
+  // Two different merges of the lanes make the two halves
+  const uint64_t *l = lanes_;
+  uint64_t hi = rotl(l[0], 1) + rotl(l[1], 7) + rotl(l[2], 12) + rotl(l[3], 18);
+  uint64_t lo = rotl(l[3], 1) + rotl(l[2], 7) + rotl(l[1], 12) + rotl(l[0], 18);
+  hi = finish(hi + total_, pending_, pendingSize_);
+  lo = finish(lo ^ (total_ * kPrime5), pending_, pendingSize_);
+
+  static const char digits[] = "0123456789abcdef";
+  std::string out(32, '0');
+  for (int i = 0; i < 16; ++i) {
+    out[15 - i] = digits[(hi >> (4 * i)) & 0xf];
+    out[31 - i] = digits[(lo >> (4 * i)) & 0xf];
+  }
+  return out;
+}
+
+ResultCache::ResultCache(const std::string &directory, size_t maxBytes)
+    : directory_(directory), maxBytes_(maxBytes) {
+  std::error_code ec;
+  fs::create_directories(directory_, ec);
+  if (!fs::is_directory(directory_, ec)) {
+    std::cerr << "[Network] Cannot use cache directory " << directory_
+              << std::endl;
+    return;
+  }
+
+  struct Found {
+    fs::file_time_type time;
+    std::string key;
+    size_t size;
+  };
+  std::vector<Found> found;
+  for (const auto &item : fs::directory_iterator(directory_, ec)) {
+    if (!item.is_regular_file(ec))
+      continue;
+    const std::string name = item.path().filename().string();
+    if (item.path().extension() == ".tmp") {
+      // Left by a crash mid-store, unless another process sharing the
+      // directory is still writing it
+      const auto written = item.last_write_time(ec);
+      if (!ec && fs::file_time_type::clock::now() - written > kStaleTempAge)
+        fs::remove(item.path(), ec);
+    } else if (isKey(name)) {
+      found.push_back({item.last_write_time(ec), name,
+                       static_cast<size_t>(item.file_size(ec))});
+    }
+  }
+  std::sort(found.begin(), found.end(),
+            [](const Found &a, const Found &b) { return a.time > b.time; });
+  for (const Found &f : found) {
+    lru_.push_back(f.key);
+    entries_[f.key] = {f.size, std::prev(lru_.end())};
+    bytes_ += f.size;
+  }
+  evict();
+  valid_ = true;
+}
+
+bool ResultCache::load(const std::string &key, std::vector<uint8_t> &bytes) {
+  std::ifstream file;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it != entries_.end())
+      file.open(fs::path(directory_) / key, std::ios::binary);
+    if (!file.is_open()) {
+      if (it != entries_.end()) { // Removed behind our back
+        bytes_ -= it->second.size;
+        lru_.erase(it->second.lru);
+        entries_.erase(it);
+      }
+      ++stats_.misses;
+      return false;
+    }
+    touch(key);
+    ++stats_.hits;
+  }
+  // Read unlocked: an open file stays readable if it is evicted meanwhile
+  file.seekg(0, std::ios::end);
+  bytes.resize(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  file.read(reinterpret_cast<char *>(bytes.data()),
+            static_cast<std::streamsize>(bytes.size()));
+  return static_cast<bool>(file);
+}
+
+bool ResultCache::store(const std::string &key,
+                        const std::vector<uint8_t> &bytes) {
+  if (!valid_ || bytes.size() > maxBytes_)
+    return false;
+  const std::string temp = tempPath();
+  {
+    std::ofstream file(temp, std::ios::binary);
+    file.write(reinterpret_cast<const char *>(bytes.data()),
+               static_cast<std::streamsize>(bytes.size()));
+    if (!file.flush()) {
+      std::error_code ec;
+      fs::remove(temp, ec);
+      return false;
+    }
+  }
+  if (!syncPath(temp, false)) {
+    std::error_code ec;
+    fs::remove(temp, ec);
+    return false;
+  }
+  return commit(key, temp, bytes.size());
+}
+
+bool ResultCache::storeFile(const std::string &key, const std::string &path) {
+  std::error_code ec;
+  const auto size = fs::file_size(path, ec);
+  if (!valid_ || ec || size > maxBytes_)
+    return false;
+  const std::string temp = tempPath();
+  if (!fs::copy_file(path, temp, ec) || !syncPath(temp, false)) {
+    fs::remove(temp, ec);
+    return false;
+  }
+  return commit(key, temp, static_cast<size_t>(size));
+}
+
+ResultCacheStats ResultCache::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ResultCacheStats stats = stats_;
+  stats.entries = entries_.size();
+  stats.bytes = bytes_;
+  return stats;
+}
+
+std::string ResultCache::tempPath() {
+  // Unique across threads and, by the address and time, across processes
+  // sharing the directory
+  static std::atomic<uint64_t> counter{0};
+  const auto stamp =
+      std::chrono::steady_clock::now().time_since_epoch().count();
+  return (fs::path(directory_) /
+          (std::to_string(reinterpret_cast<uintptr_t>(this)) + "_" +
+           std::to_string(stamp) + "_" + std::to_string(counter++) + ".tmp"))
+      .string();
+}
+
+bool ResultCache::commit(const std::string &key, const std::string &temp,
+                         size_t size) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::error_code ec;
+    // rename() replaces atomically: readers see the old or the new entry
+    fs::rename(temp, fs::path(directory_) / key, ec);
+    if (ec) {
+      std::cerr << "[Network] Cache store failed: " << ec.message()
+                << std::endl;
+      fs::remove(temp, ec);
+      return false;
+    }
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+      bytes_ -= it->second.size;
+      lru_.erase(it->second.lru);
+    }
+    lru_.push_front(key);
+    entries_[key] = {size, lru_.begin()};
+    // The kernel's coarse write time could sort before an earlier touch()
+    touch(key);
+    bytes_ += size;
+    ++stats_.stores;
+    evict();
+  }
+  // Persist the rename itself; the entry is usable either way
+  syncPath(directory_, true);
+  return true;
+}
+
+void ResultCache::touch(const std::string &key) {
+  Entry &entry = entries_[key];
+  lru_.splice(lru_.begin(), lru_, entry.lru);
+  std::error_code ec;
+  fs::last_write_time(fs::path(directory_) / key,
+                      fs::file_time_type::clock::now(), ec);
+}
+
+void ResultCache::evict() {
+  while (bytes_ > maxBytes_ && !lru_.empty()) {
+    const std::string key = lru_.back();
+    std::error_code ec;
+    fs::remove(fs::path(directory_) / key, ec);
+    bytes_ -= entries_[key].size;
+    entries_.erase(key);
+    lru_.pop_back();
+    ++stats_.evictions;
+  }
+}
+
+} // namespace Network
+} // namespace PersonBeauty
@@ -0,0 +1,92 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace PersonBeauty {
+namespace Network {
+
+// 128-bit non-cryptographic hash of a sequence of byte fields, fast enough
+// to run over whole encoded images (several GB/s). Each field's length is
+// hashed too, so ("ab", "c") and ("a", "bc") differ.
+class ContentHash {
+public:
+  ContentHash();
+  ContentHash &add(const void *data, size_t size);
+  ContentHash &add(const std::string &text) {
+    return add(text.data(), text.size());
+  }
+  // 32 hex digits
+  std::string hex() const;
+
+private:
+  void update(const uint8_t *data, size_t size);
+  void stripe(const uint8_t *data);
+
+  uint64_t lanes_[4];
+  uint8_t pending_[32];
+  size_t pendingSize_ = 0;
+  uint64_t total_ = 0;
+};
+
+struct ResultCacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t stores = 0;
+  uint64_t evictions = 0;
+  size_t entries = 0;
+  size_t bytes = 0;
+};
+
+// Content-addressed LRU cache of response bodies in one directory, one file
+// per key. Files appear atomically (written and synced under a temporary
+// name, then renamed), so a crash, a power loss or a concurrent reader
+// never sees half an entry.
+// Recency is the file's modification time, refreshed on every hit, so the
+// LRU order survives restarts. Thread-safe.
+class ResultCache {
+public:
+  // Indexes the entries already in `directory`, creating it if needed, and
+  // evicts down to `maxBytes`. Temporary files over an hour old are
+  // removed as leftovers of a crash.
+  ResultCache(const std::string &directory, size_t maxBytes);
+
+  bool valid() const { return valid_; }
+
+  // Read the entry into `bytes`; false (a miss) if there is none
+  bool load(const std::string &key, std::vector<uint8_t> &bytes);
+  // Add or replace an entry from memory, or from a file that is copied
+  bool store(const std::string &key, const std::vector<uint8_t> &bytes);
+  bool storeFile(const std::string &key, const std::string &path);
+
+  ResultCacheStats stats() const;
+
+private:
+  struct Entry {
+    size_t size = 0;
+    std::list<std::string>::iterator lru;
+  };
+
+  std::string tempPath();
+  // Rename `temp` to the entry of `key` and account for it
+  bool commit(const std::string &key, const std::string &temp, size_t size);
+  void touch(const std::string &key);
+  void evict();
+
+  std::string directory_;
+  size_t maxBytes_;
+  bool valid_ = false;
+
+  mutable std::mutex mutex_;
+  std::list<std::string> lru_; // Most recent first
+  std::unordered_map<std::string, Entry> entries_;
+  size_t bytes_ = 0;
+  ResultCacheStats stats_;
+};
+
+} // namespace Network
+} // namespace PersonBeauty
@@ -0,0 +1,83 @@
+#include "BeautyChain.h"
+#include "../Core/RenderGraph.h"
+#include "ColorEngine.h"
+
+namespace PersonBeauty {
+namespace Processing {
+
+const char *BeautyChain::stepName(Step step) {
+  switch (step) {
+  case Adjust:
+    return "adjust";
+  case Retouch:
+    return "retouch";
+  case Stereo:
+    return "stereo";
+  default:
+    return "liquify";
+  }
+}
+
+uint64_t BeautyChain::paramsHash(Step step, const BeautyParams &params) {
+  ParamHash hash;
+  switch (step) {
+  case Adjust:
+    hash.add(params.brightness)
+        .add(params.contrast)
+        .add(params.saturation)
+        .add(params.hue);
+    break;
+  case Retouch:
+    // The layer precision is global, read by the retouch itself
+    hash.add(params.retouchStrength).add(ColorEngine::layerPrecision());
+    break;
+  case Stereo:
+    hash.add(params.stereoStrength).add(ColorEngine::layerPrecision());
+    break;
+  default:
+    hash.add(params.slimStrength);
+    break;
+  }
+  return hash.value();
+}
+
+BeautyChain::BeautyChain(int width, int height, const BeautyAnalysis &analysis,
+                         const BeautyParams &params, float scale)
+    : liquify_(width, height) {
+  for (const auto &pts : analysis.landmarks)
+    liquify_.slimFace(pts, params.slimStrength);
+
+  stages_.resize(StepCount);
+  stages_[Adjust] = ColorEngine::adjustStage(
+      analysis.skinMask, params.brightness, params.contrast,
+      params.saturation, params.hue);
+  stages_[Retouch] = ColorEngine::retouchStage(
+      analysis.skinMask, params.retouchStrength, scale);
+  stages_[Stereo] = ColorEngine::stereoStage(analysis.landmarks,
+                                             params.stereoStrength, scale);
+  stages_[Liquify] = liquify_.stripStage();
+}
+
+void BeautyChain::addStages(StripProcessor &tiler) const {
+  for (const StripStage &stage : stages_)
+    tiler.addStage(stage);
+}
+
+ImageBuffer BeautyChain::apply(Step step, const ImageBuffer &input) const {
+  const cv::Mat &src = input.getMat();
+  ImageBuffer output(src.cols, src.rows, input.format());
+  FrameStrip out = FrameStrip::whole(output);
+  stages_[step].process(FrameStrip::whole(input), out);
+  return output;
+}
+
+ImageBuffer BeautyChain::render(const ImageBuffer &input) const {
+  // Each step's input returns to the pool as the next one is made
+  ImageBuffer image = input;
+  for (int step = 0; step < StepCount; ++step)
+    image = apply(static_cast<Step>(step), image);
+  return image;
+}
+
+} // namespace Processing
+} // namespace PersonBeauty
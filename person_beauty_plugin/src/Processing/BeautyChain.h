@@ -0,0 +1,66 @@
+#pragma once
+#include "../Core/ImageBuffer.h"
+#include "../Core/StripProcessor.h"
+#include "LiquifyEngine.h"
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+namespace PersonBeauty {
+namespace Processing {
+
+// Slider values of the ColorEngine / Liquify edit chain
+struct BeautyParams {
+  float brightness = 0.1f;
+  float contrast = 1.05f;
+  float saturation = 1.0f;
+  float hue = 0.0f;
+  float retouchStrength = 0.7f;
+  float stereoStrength = 0.7f;
+  float slimStrength = 0.45f;
+};
+
+// Analysis results the edits read, at source resolution
+struct BeautyAnalysis {
+  ImageBuffer skinMask;
+  std::vector<std::vector<cv::Point2f>> landmarks;
+};
+
+// The beauty edit chain adjust -> retouch -> stereo -> liquify, defined
+// once as StripProcessor stages. Proxy previews, tiled refinement and the
+// render graph's edit nodes all run these stages: whole frames one step at
+// a time, or banded through a StripProcessor.
+class BeautyChain {
+public:
+  enum Step { Adjust, Retouch, Stereo, Liquify, StepCount };
+
+  static const char *stepName(Step step);
+  // Hash of what `step` reads from `params` (and of global settings that
+  // change its output), e.g. for RenderGraph keys
+  static uint64_t paramsHash(Step step, const BeautyParams &params);
+
+  // Stages for a `width` x `height` frame; they share the mask's pixels
+  // rather than copy them. `scale` is the frame's size relative to the
+  // source the radii are tuned for (proxy rendering).
+  BeautyChain(int width, int height, const BeautyAnalysis &analysis,
+              const BeautyParams &params, float scale = 1.0f);
+  // The liquify stage refers to the chain's own engine
+  BeautyChain(const BeautyChain &) = delete;
+  BeautyChain &operator=(const BeautyChain &) = delete;
+
+  // Valid while the chain exists
+  const StripStage &stage(Step step) const { return stages_[step]; }
+  void addStages(StripProcessor &tiler) const;
+
+  // One step on a whole frame, into a new image
+  ImageBuffer apply(Step step, const ImageBuffer &input) const;
+  // Every step on a whole frame
+  ImageBuffer render(const ImageBuffer &input) const;
+
+private:
+  LiquifyEngine liquify_;
+  std::vector<StripStage> stages_;
+};
+
+} // namespace Processing
+} // namespace PersonBeauty
@@ -1,160 +1,394 @@
 #include "ColorEngine.h"
+#include "../Core/Kernels.h"
+#include <algorithm>
 #include <iostream>
 
 namespace PersonBeauty {
 namespace Processing {
 
+namespace {
+
+bool isRGBOrder(PixelFormat format) {
+  return format == PixelFormat::RGB8 || format == PixelFormat::RGBA8;
+}
+
+// 8-bit 3/4-channel pixels -> CV_32FC3 in [0, 1]. A fourth (alpha) channel
+// is dropped in the same pass instead of a separate cvtColor.
+void loadColor(const cv::Mat &src, cv::Mat &dst) {
+  if (src.channels() == 3) {
+    src.convertTo(dst, CV_32F, 1.0 / 255.0);
+    return;
+  }
+  const int cn = src.channels();
+  cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range &range) {
+    for (int y = range.start; y < range.end; ++y) {
+      const uchar *s = src.ptr<uchar>(y);
+      float *d = dst.ptr<float>(y);
+      for (int x = 0; x < src.cols; ++x, s += cn, d += 3) {
+        d[0] = s[0] * (1.0f / 255.0f);
+        d[1] = s[1] * (1.0f / 255.0f);
+        d[2] = s[2] * (1.0f / 255.0f);
+      }
+    }
+  });
+}
+
+// CV_32FC3 in [0, 1] -> the color channels of `dst`. The alpha channel of a
+// 4-channel `dst` is taken from `alphaSource` (nothing to do when they are
+// the same buffer).
+void storeColor(const cv::Mat &src, const cv::Mat &alphaSource,
+                cv::Mat &dst) {
+  if (dst.channels() == 3) {
+    src.convertTo(dst, CV_8U, 255.0);
+    return;
+  }
+  const int cn = dst.channels();
+  const bool copyAlpha = alphaSource.data != dst.data;
+  cv::parallel_for_(cv::Range(0, dst.rows), [&](const cv::Range &range) {
+    for (int y = range.start; y < range.end; ++y) {
+      const float *s = src.ptr<float>(y);
+      const uchar *a = alphaSource.ptr<uchar>(y);
+      uchar *d = dst.ptr<uchar>(y);
+      for (int x = 0; x < dst.cols; ++x, s += 3, a += cn, d += cn) {
+        d[0] = cv::saturate_cast<uchar>(s[0] * 255.0f);
+        d[1] = cv::saturate_cast<uchar>(s[1] * 255.0f);
+        d[2] = cv::saturate_cast<uchar>(s[2] * 255.0f);
+        if (copyAlpha)
+          d[3] = a[3];
+      }
+    }
+  });
+}
+
+// Effect radius for a proxy at `scale` of the source size (never larger)
+int scaledRadius(int radius, float scale) {
+  return scale >= 1.0f ? radius : std::max(1, cvRound(radius * scale));
+}
+
+// dst16 += src * scale for a half-float dst, widening one row at a time
+void accumulateHalf(const cv::Mat &src, float scale, cv::Mat &dst16) {
+  cv::parallel_for_(cv::Range(0, dst16.rows), [&](const cv::Range &range) {
+    cv::Mat row;
+    for (int y = range.start; y < range.end; ++y) {
+      cv::Mat dstRow = dst16.row(y);
+      dstRow.convertTo(row, CV_32F);
+      cv::scaleAdd(src.row(y), scale, row, row);
+      row.convertTo(dstRow, CV_16F);
+    }
+  });
+}
+
+} // namespace
+
 void ColorEngine::adjust(ImageBuffer &image, const ImageBuffer &mask,
                          float brightness, float contrast, float saturation,
                          float hue) {
-  if (image.getMat().size() != mask.getMat().size()) {
+  adjust(image, image, mask, brightness, contrast, saturation, hue);
+}
+
+void ColorEngine::adjust(const ImageBuffer &input, ImageBuffer &output,
+                         const ImageBuffer &mask, float brightness,
+                         float contrast, float saturation, float hue) {
+  PB_TRACE_SCOPE("ColorEngine::adjust");
+  if (input.getMat().size() != mask.getMat().size()) {
     std::cerr << "[Error] ColorEngine: Image and Mask size mismatch!"
               << std::endl;
     return;
   }
+  if (input.getMat().channels() < 3) {
+    std::cerr << "[Error] ColorEngine: Color image expected!" << std::endl;
+    return;
+  }
+  // A wrapped host buffer must be written in place, never reallocated
+  const cv::Mat &out = output.getMat();
+  if (!out.empty() &&
+      (out.size() != input.getMat().size() ||
+       out.type() != input.getMat().type())) {
+    std::cerr << "[Error] ColorEngine: Output size or type mismatch!"
+              << std::endl;
+    return;
+  }
+
+  // Scratch buffers come from the pool and every step writes into a
+  // preallocated destination, so a steady stream of same-sized frames does
+  // not allocate
+  BufferPool &pool = BufferPool::current();
+  const cv::Size size = input.getMat().size();
 
-  cv::Mat floatImg;
-  image.getMat().convertTo(floatImg, CV_32F, 1.0 / 255.0);
+  cv::Mat floatImg = pool.acquire(size, CV_32FC3);
+  loadColor(input.getMat(), floatImg);
 
-  cv::Mat hsv;
-  cv::cvtColor(floatImg, hsv, cv::COLOR_BGR2HSV);
+  const bool rgb = isRGBOrder(input.format());
+  cv::Mat hsv = pool.acquire(size, CV_32FC3);
+  cv::cvtColor(floatImg, hsv, rgb ? cv::COLOR_RGB2HSV : cv::COLOR_BGR2HSV);
 
-  std::vector<cv::Mat> channels;
+  std::vector<cv::Mat> channels = {pool.acquire(size, CV_32FC1),
+                                   pool.acquire(size, CV_32FC1),
+                                   pool.acquire(size, CV_32FC1)};
   cv::split(hsv, channels);
 
-  cv::Mat floatMask;
+  cv::Mat floatMask = pool.acquire(size, CV_32FC1);
   mask.getMat().convertTo(floatMask, CV_32F, 1.0 / 255.0);
 
+  cv::Mat delta = pool.acquire(size, CV_32FC1);
+
   if (hue != 0) {
     channels[0] += hue;
   }
 
   if (saturation != 1.0f) {
-    cv::Mat s_target = channels[1] * saturation;
-    cv::Mat s_diff = s_target - channels[1];
-    cv::Mat s_delta;
-    cv::multiply(s_diff, floatMask, s_delta);
-    channels[1] += s_delta;
+    // s += (s * saturation - s) * mask
+    cv::multiply(channels[1], floatMask, delta, saturation - 1.0f);
+    cv::add(channels[1], delta, channels[1]);
   }
 
   if (contrast != 1.0f || brightness != 0.0f) {
-    cv::Mat v_target;
-    cv::subtract(channels[2], 0.5, v_target);
-    cv::multiply(v_target, contrast, v_target);
-    cv::add(v_target, 0.5 + brightness, v_target);
-
-    cv::Mat v_diff = v_target - channels[2];
-    cv::Mat v_delta;
-    cv::multiply(v_diff, floatMask, v_delta);
-    channels[2] += v_delta;
+    // v += ((v - 0.5) * contrast + 0.5 + brightness - v) * mask
+    channels[2].convertTo(delta, CV_32F, contrast - 1.0f,
+                          0.5f + brightness - 0.5f * contrast);
+    cv::multiply(delta, floatMask, delta);
+    cv::add(channels[2], delta, channels[2]);
   }
 
   cv::merge(channels, hsv);
-  cv::cvtColor(hsv, floatImg, cv::COLOR_HSV2BGR);
-  floatImg.convertTo(image.getMat(), CV_8U, 255.0);
+  cv::cvtColor(hsv, floatImg, rgb ? cv::COLOR_HSV2RGB : cv::COLOR_HSV2BGR);
+  if (output.getMat().empty())
+    output = ImageBuffer(size.width, size.height, input.format());
+  storeColor(floatImg, input.getMat(), output.getMat());
 }
 
 void ColorEngine::blend(ImageBuffer &base, const ImageBuffer &blendLayer,
                         const ImageBuffer &mask, BlendMode mode,
                         float opacity) {
+  PB_TRACE_SCOPE("ColorEngine::blend");
   if (base.getMat().empty() || blendLayer.getMat().empty())
     return;
 
-  cv::Mat baseF, blendF, maskF;
-  base.getMat().convertTo(baseF, CV_32FC3, 1.0 / 255.0);
-  blendLayer.getMat().convertTo(blendF, CV_32FC3, 1.0 / 255.0);
+  cv::Mat img = base.getMat();
+  const cv::Mat &layer = blendLayer.getMat();
+  const cv::Mat &m = mask.getMat();
+  if (layer.size() != img.size() || (!m.empty() && m.size() != img.size())) {
+    std::cerr << "[Error] ColorEngine: Blend layer or Mask size mismatch!"
+              << std::endl;
+    return;
+  }
+  const bool floatLayer =
+      layer.depth() == CV_32F || layer.depth() == CV_16F;
+  if (img.channels() < 3 ||
+      (floatLayer ? layer.channels() == 2 || layer.channels() > 3
+                  : layer.channels() < 3)) {
+    std::cerr << "[Error] ColorEngine: Color image expected!" << std::endl;
+    return;
+  }
 
-  if (!mask.getMat().empty()) {
-    mask.getMat().convertTo(maskF, CV_32FC1, 1.0 / 255.0);
-  } else {
-    maskF = cv::Mat::ones(baseF.size(), CV_32FC1);
+  // Float layers (the neutral-gray ones) are already in [0, 1]: read
+  // directly, half-float ones a row at a time. 8-bit ones are converted
+  // once, scaled by 1/255.
+  cv::Mat layerF = layer;
+  if (layer.depth() != CV_32F && layer.depth() != CV_16F) {
+    layerF = BufferPool::current().acquire(img.size(), CV_32FC3);
+    loadColor(layer, layerF);
   }
 
-  cv::Mat resultF = baseF.clone();
-
-  // Optimized vectorized approach where possible
-  if (mode == BlendMode::SoftLight) {
-    // SoftLight: (1-2*L)*B^2 + 2*L*B
-    // This is a simplified version, let's use the more accurate one:
-    for (int y = 0; y < baseF.rows; ++y) {
-      for (int x = 0; x < baseF.cols; ++x) {
-        cv::Vec3f &b = baseF.at<cv::Vec3f>(y, x);
-        cv::Vec3f &l = blendF.at<cv::Vec3f>(y, x);
-        float m = maskF.at<float>(y, x) * opacity;
-        cv::Vec3f res;
-        for (int c = 0; c < 3; ++c) {
-          if (l[c] < 0.5f) {
-            res[c] = b[c] - (1.0f - 2.0f * l[c]) * b[c] * (1.0f - b[c]);
-          } else {
-            float d = (b[c] < 0.25f)
-                          ? ((16.0f * b[c] - 12.0f) * b[c] + 4.0f) * b[c]
-                          : std::sqrt(b[c]);
-            res[c] = b[c] + (2.0f * l[c] - 1.0f) * (d - b[c]);
-          }
-          resultF.at<cv::Vec3f>(y, x)[c] = b[c] * (1.0f - m) + res[c] * m;
-        }
+  // Works on the 8-bit pixels row by row: no full-frame float copies of the
+  // base, and the alpha channel of 4-channel images is never touched
+  const int cn = img.channels();
+  const int lcn = layerF.channels();
+  // Fallback to normal blend for unimplemented modes
+  const Kernels::BlendOp op = mode == BlendMode::SoftLight
+                                  ? Kernels::BlendOp::SoftLight
+                                  : Kernels::BlendOp::Normal;
+  cv::parallel_for_(cv::Range(0, img.rows), [&](const cv::Range &range) {
+    cv::Mat layerRow;
+    for (int y = range.start; y < range.end; ++y) {
+      uchar *p = img.ptr<uchar>(y);
+      const float *l;
+      if (layerF.depth() == CV_16F) {
+        layerF.row(y).convertTo(layerRow, CV_32F);
+        l = layerRow.ptr<float>();
+      } else {
+        l = layerF.ptr<float>(y);
       }
+      const uchar *mrow = m.empty() ? nullptr : m.ptr<uchar>(y);
+      Kernels::blendRow(p, cn, l, lcn, mrow, opacity, op, img.cols);
     }
-  } else {
-    // Fallback to normal blend for unimplemented modes
-    cv::addWeighted(blendF, opacity, baseF, 1.0f - opacity, 0, resultF);
-  }
-
-  resultF.convertTo(base.getMat(), CV_8U, 255.0);
+  });
 }
 
 void ColorEngine::applyNeutralGrayRetouch(ImageBuffer &image,
                                           const ImageBuffer &skinMask,
-                                          float strength) {
-  cv::Mat img = image.getMat();
-  cv::Mat floatImg;
-  img.convertTo(floatImg, CV_32FC3, 1.0 / 255.0);
+                                          float strength, float scale) {
+  FrameStrip strip = FrameStrip::whole(image);
+  applyNeutralGrayRetouch(strip, strip, skinMask, strength, scale);
+}
 
-  cv::Mat blurred;
-  cv::GaussianBlur(floatImg, blurred, cv::Size(21, 21), 0);
+void ColorEngine::applyNeutralGrayRetouch(const FrameStrip &input,
+                                          FrameStrip &output,
+                                          const ImageBuffer &skinMask,
+                                          float strength, float scale) {
+  PB_TRACE_SCOPE("ColorEngine::applyNeutralGrayRetouch");
+  const cv::Mat &src = input.image.getMat();
+  cv::Mat img = output.image.getMat();
+  if (img.channels() < 3)
+    return;
 
-  // Gray Layer: 0.5 + (blurred - original) * strength
-  cv::Mat grayLayer = cv::Mat::ones(img.size(), CV_32FC3) * 0.5f;
-  grayLayer += (blurred - floatImg) * strength;
+  // Rows the blur reads: the output rows plus the halo, clipped to the
+  // frame. Inside the frame the halo rows are real pixels, at its edges the
+  // blur reflects exactly as it does for the whole frame.
+  const int halo = scaledRadius(kRetouchHalo, scale);
+  const cv::Range in = input.rows();
+  const cv::Range out = output.rows();
+  const cv::Range span(std::max(0, out.start - halo),
+                       std::min(output.frameRows, out.end + halo));
+  if (src.cols != img.cols || src.type() != img.type() ||
+      in.start > span.start || in.end < span.end) {
+    std::cerr << "[Error] ColorEngine: Retouch input does not cover the halo!"
+              << std::endl;
+    return;
+  }
+  const cv::Mat &m = skinMask.getMat();
+  if (!m.empty() && (m.rows != output.frameRows || m.cols != img.cols)) {
+    std::cerr << "[Error] ColorEngine: Blend layer or Mask size mismatch!"
+              << std::endl;
+    return;
+  }
+
+  BufferPool &pool = BufferPool::current();
+  const cv::Size ksize(2 * halo + 1, 2 * halo + 1);
+  cv::Mat grayLayer;
+
+  if (layerPrecision() == LayerPrecision::Float32) {
+    cv::Mat floatImg = pool.acquire(span.size(), img.cols, CV_32FC3);
+    loadColor(src.rowRange(span.start - in.start, span.end - in.start),
+              floatImg);
+
+    cv::Mat blurred = pool.acquire(span.size(), img.cols, CV_32FC3);
+    cv::GaussianBlur(floatImg, blurred, ksize, 0, 0,
+                     cv::BORDER_REFLECT_101 | cv::BORDER_ISOLATED);
+
+    // Gray Layer: 0.5 + (blurred - original) * strength
+    const cv::Range inner(out.start - span.start, out.end - span.start);
+    grayLayer = pool.acquire(out.size(), img.cols, CV_32FC3);
+    cv::subtract(blurred.rowRange(inner), floatImg.rowRange(inner),
+                 grayLayer);
+    grayLayer.convertTo(grayLayer, CV_32F, strength, 0.5);
+  } else {
+    // Only the half-float gray layer spans all output rows; the float image
+    // and its blur are built in strips. Each strip carries `halo` extra rows
+    // on both sides, so its blur matches a full-frame blur.
+    const int stripRows = 64;
+    grayLayer = pool.acquire(out.size(), img.cols, CV_16FC3);
+    cv::Mat floatStrip = pool.acquire(stripRows + 2 * halo, img.cols, CV_32FC3);
+    cv::Mat blurStrip = pool.acquire(stripRows + 2 * halo, img.cols, CV_32FC3);
+    cv::Mat grayStrip = pool.acquire(stripRows, img.cols, CV_32FC3);
+
+    for (int y0 = out.start; y0 < out.end; y0 += stripRows) {
+      int y1 = std::min(out.end, y0 + stripRows);
+      int top = std::max(0, y0 - halo);
+      int bottom = std::min(output.frameRows, y1 + halo);
+
+      cv::Mat f = floatStrip.rowRange(0, bottom - top);
+      loadColor(src.rowRange(top - in.start, bottom - in.start), f);
+      cv::Mat b = blurStrip.rowRange(0, bottom - top);
+      // Isolated: the rest of the strip buffers holds stale rows
+      cv::GaussianBlur(f, b, ksize, 0, 0,
+                       cv::BORDER_REFLECT_101 | cv::BORDER_ISOLATED);
+
+      cv::Mat g = grayStrip.rowRange(0, y1 - y0);
+      cv::subtract(b.rowRange(y0 - top, y1 - top),
+                   f.rowRange(y0 - top, y1 - top), g);
+      cv::Mat dst = grayLayer.rowRange(y0 - out.start, y1 - out.start);
+      g.convertTo(dst, CV_16F, strength, 0.5);
+    }
+  }
 
+  // Blend onto the output rows; with a separate input they start as a copy
+  const cv::Mat base = src.rowRange(out.start - in.start, out.end - in.start);
+  if (base.data != img.data)
+    base.copyTo(img);
   ImageBuffer grayBuf(grayLayer);
-  blend(image, grayBuf, skinMask, BlendMode::SoftLight, 1.0f);
+  ImageBuffer maskRows =
+      m.empty() ? ImageBuffer() : ImageBuffer(m.rowRange(out));
+  blend(output.image, grayBuf, maskRows, BlendMode::SoftLight, 1.0f);
 }
 
 void ColorEngine::applyNeutralGrayStereo(
     ImageBuffer &image, const std::vector<cv::Point2f> &landmarks,
-    float strength) {
+    float strength, float scale) {
+  FrameStrip strip = FrameStrip::whole(image);
+  applyNeutralGrayStereo(strip, landmarks, strength, scale);
+}
+
+void ColorEngine::applyNeutralGrayStereo(
+    FrameStrip &strip, const std::vector<cv::Point2f> &landmarks,
+    float strength, float scale) {
+  PB_TRACE_SCOPE("ColorEngine::applyNeutralGrayStereo");
   if (landmarks.size() < 68)
     return;
 
-  cv::Mat img = image.getMat();
-  cv::Mat grayLayer = cv::Mat::ones(img.size(), CV_32FC3) * 0.5f;
+  cv::Mat img = strip.image.getMat();
+  const cv::Range rows = strip.rows();
+  BufferPool &pool = BufferPool::current();
+  // Every pattern offsets all three channels equally, so a single-channel
+  // layer carries the same information at a third of the size
+  const bool half = layerPrecision() == LayerPrecision::Float16;
+  cv::Mat grayLayer =
+      pool.acquire(img.rows, img.cols, half ? CV_16FC1 : CV_32FC1);
+  grayLayer = cv::Scalar(0.5);
+
+  // Feature masks are drawn over the strip plus the widest blur radius
+  const int maxBlur = scaledRadius(40, scale);
+  const int thickness = scaledRadius(10, scale);
+  const int maskTop = std::max(0, rows.start - maxBlur);
+  const int maskBottom = std::min(strip.frameRows, rows.end + maxBlur);
+  cv::Mat maskRows = pool.acquire(maskBottom - maskTop, img.cols, CV_32FC1);
 
   auto drawPattern = [&](const std::vector<int> &indices, float delta,
                          int blurSize) {
     if (indices.empty())
       return;
+    blurSize = scaledRadius(blurSize, scale);
     std::vector<cv::Point> pts;
     for (int i : indices)
       pts.push_back(cv::Point((int)landmarks[i].x, (int)landmarks[i].y));
 
-    cv::Mat featureMask = cv::Mat::zeros(img.size(), CV_32FC1);
+    // A pattern whose blurred footprint (line half-width included) misses
+    // the strip adds exactly zero there
+    int minY = pts[0].y, maxY = pts[0].y;
+    for (const auto &p : pts) {
+      minY = std::min(minY, p.y);
+      maxY = std::max(maxY, p.y);
+    }
+    const int reach = blurSize + thickness / 2 + 1;
+    if (maxY + reach < rows.start || minY - reach >= rows.end)
+      return;
+
+    // Drawn and blurred over the rows the blur reads; isolated, so the
+    // frame edges reflect as they do for a whole-frame mask
+    const int top = std::max(0, rows.start - blurSize);
+    const int bottom = std::min(strip.frameRows, rows.end + blurSize);
+    cv::Mat featureMask = maskRows.rowRange(top - maskTop, bottom - maskTop);
+    const cv::Point offset(0, -top);
+
+    featureMask = cv::Scalar(0.0);
     if (pts.size() > 2) {
       std::vector<std::vector<cv::Point>> contours = {pts};
-      cv::fillPoly(featureMask, contours, cv::Scalar(1.0));
+      cv::fillPoly(featureMask, contours, cv::Scalar(1.0), cv::LINE_8, 0,
+                   offset);
     } else if (pts.size() == 2) {
-      cv::line(featureMask, pts[0], pts[1], cv::Scalar(1.0), 10);
+      cv::line(featureMask, pts[0] + offset, pts[1] + offset, cv::Scalar(1.0),
+               thickness);
     }
 
     cv::GaussianBlur(featureMask, featureMask,
-                     cv::Size(blurSize * 2 + 1, blurSize * 2 + 1), 0);
+                     cv::Size(blurSize * 2 + 1, blurSize * 2 + 1), 0, 0,
+                     cv::BORDER_REFLECT_101 | cv::BORDER_ISOLATED);
 
-    for (int c = 0; c < 3; ++c) {
-      cv::Mat channel;
-      cv::extractChannel(grayLayer, channel, c);
-      channel += featureMask * delta * strength;
-      cv::insertChannel(channel, grayLayer, c);
-    }
+    cv::Mat inner = featureMask.rowRange(rows.start - top, rows.end - top);
+    if (half)
+      accumulateHalf(inner, delta * strength, grayLayer);
+    else
+      cv::scaleAdd(inner, delta * strength, grayLayer, grayLayer);
   };
 
   // Dodge: T-Zone, Chin
@@ -166,7 +400,54 @@ void ColorEngine::applyNeutralGrayStereo(
   drawPattern({0, 1, 2, 3, 13, 14, 15, 16}, -0.2f, 40);
 
   ImageBuffer grayBuf(grayLayer);
-  blend(image, grayBuf, ImageBuffer(), BlendMode::SoftLight, 1.0f);
+  blend(strip.image, grayBuf, ImageBuffer(), BlendMode::SoftLight, 1.0f);
+}
+
+StripStage ColorEngine::adjustStage(const ImageBuffer &mask, float brightness,
+                                    float contrast, float saturation,
+                                    float hue) {
+  StripStage stage;
+  stage.name = "adjust";
+  // Float image, HSV and its three planes, mask and delta
+  stage.scratchBytesPerPixel = 44;
+  stage.process = [=](const FrameStrip &input, FrameStrip &output) {
+    const cv::Range rows = output.rows();
+    const cv::Mat &m = mask.getMat();
+    adjust(input.view(rows), output.image,
+           m.empty() ? ImageBuffer() : ImageBuffer(m.rowRange(rows)),
+           brightness, contrast, saturation, hue);
+  };
+  return stage;
+}
+
+StripStage ColorEngine::retouchStage(const ImageBuffer &skinMask,
+                                     float strength, float scale) {
+  StripStage stage;
+  stage.name = "retouch";
+  stage.halo = scaledRadius(kRetouchHalo, scale);
+  // Float image, blur and gray layer, or just the half-float gray layer
+  stage.scratchBytesPerPixel =
+      layerPrecision() == LayerPrecision::Float32 ? 36 : 6;
+  stage.process = [=](const FrameStrip &input, FrameStrip &output) {
+    applyNeutralGrayRetouch(input, output, skinMask, strength, scale);
+  };
+  return stage;
+}
+
+StripStage
+ColorEngine::stereoStage(const std::vector<std::vector<cv::Point2f>> &faces,
+                         float strength, float scale) {
+  StripStage stage;
+  stage.name = "stereo";
+  // Gray layer plus the feature mask
+  stage.scratchBytesPerPixel =
+      layerPrecision() == LayerPrecision::Float32 ? 8 : 6;
+  stage.process = [=](const FrameStrip &input, FrameStrip &output) {
+    input.view(output.rows()).getMat().copyTo(output.image.getMat());
+    for (const auto &landmarks : faces)
+      applyNeutralGrayStereo(output, landmarks, strength, scale);
+  };
+  return stage;
 }
 
 } // namespace Processing
@@ -1,5 +1,7 @@
 #pragma once
 #include "../Core/ImageBuffer.h"
+#include "../Core/StripProcessor.h"
+#include <atomic>
 #include <opencv2/opencv.hpp>
 
 namespace PersonBeauty {
@@ -7,26 +9,82 @@ namespace Processing {
 
 enum class BlendMode { Normal, Multiply, Screen, Overlay, SoftLight, Color };
 
+// Storage of the full-frame neutral-gray working layers
+enum class LayerPrecision {
+  Float32,
+  // Half the memory and bandwidth; values are widened to float row by row.
+  // Output differs from Float32 by at most 1/255 per channel.
+  Float16
+};
+
+// Images are 8-bit with 3 or 4 channels, in the channel order of their
+// PixelFormat. A fourth (alpha) channel is passed through untouched.
 class ColorEngine {
 public:
+  static void setLayerPrecision(LayerPrecision precision) {
+    precision_.store(precision, std::memory_order_relaxed);
+  }
+  static LayerPrecision layerPrecision() {
+    return precision_.load(std::memory_order_relaxed);
+  }
+
   // Adjust brightness/contrast/saturation on masked region
   static void adjust(ImageBuffer &image, const ImageBuffer &mask,
                      float brightness, float contrast, float saturation,
                      float hue);
+  // Same, reading `input` and writing `output` (e.g. a wrapped host buffer;
+  // allocated if empty), which saves copying the input first
+  static void adjust(const ImageBuffer &input, ImageBuffer &output,
+                     const ImageBuffer &mask, float brightness, float contrast,
+                     float saturation, float hue);
 
-  // Blend two images using a mask
+  // Blend two images using a mask. The layer may be 8-bit (3/4 channels,
+  // read as value / 255) or a float / half-float layer with 3 channels or 1
+  // (applied to all), read as it is: values in [0, 1], 0.5 being neutral
+  // for SoftLight
   static void blend(ImageBuffer &base, const ImageBuffer &blendLayer,
                     const ImageBuffer &mask, BlendMode mode, float opacity);
 
-  // Neutral Gray Retouching: smooths skin while preserving texture
+  // Neutral Gray Retouching: smooths skin while preserving texture.
+  // `scale` (at most 1) shrinks the blur radii and stroke widths of this
+  // and the stereo effect for proxies rendered at that fraction of the
+  // source size.
   static void applyNeutralGrayRetouch(ImageBuffer &image,
                                       const ImageBuffer &skinMask,
-                                      float strength);
+                                      float strength, float scale = 1.0f);
 
   // Neutral Gray Stereo: enhances facial features (Dodge & Burn)
   static void applyNeutralGrayStereo(ImageBuffer &image,
                                      const std::vector<cv::Point2f> &landmarks,
-                                     float strength);
+                                     float strength, float scale = 1.0f);
+
+  // Band forms for tiled processing (Core/StripProcessor.h); they write
+  // exactly the rows the whole-frame forms would. Retouch reads the output
+  // rows plus kRetouchHalo above and below (clipped to the frame) from
+  // `input`, which may be `output` itself. Masks are full-frame.
+  static constexpr int kRetouchHalo = 10;
+  static void applyNeutralGrayRetouch(const FrameStrip &input,
+                                      FrameStrip &output,
+                                      const ImageBuffer &skinMask,
+                                      float strength, float scale = 1.0f);
+  static void applyNeutralGrayStereo(FrameStrip &strip,
+                                     const std::vector<cv::Point2f> &landmarks,
+                                     float strength, float scale = 1.0f);
+
+  // The same steps as StripProcessor stages, with their halos and scratch
+  // declared. Masks are shared with the caller, not copied.
+  static StripStage adjustStage(const ImageBuffer &mask, float brightness,
+                                float contrast, float saturation, float hue);
+  static StripStage retouchStage(const ImageBuffer &skinMask, float strength,
+                                 float scale = 1.0f);
+  // One pass per face, in order
+  static StripStage
+  stereoStage(const std::vector<std::vector<cv::Point2f>> &faces,
+              float strength, float scale = 1.0f);
+
+private:
+  static inline std::atomic<LayerPrecision> precision_{
+      LayerPrecision::Float32};
 };
 
 } // namespace Processing
@@ -1,8 +1,32 @@
 #include "LiquifyEngine.h"
+#include <algorithm>
+#include <iostream>
 
 namespace PersonBeauty {
 namespace Processing {
 
+namespace {
+
+// Source sample and weight of destination index `d` when cv::resize
+// (INTER_LINEAR) scales `n` samples to `size`: pixel centers aligned,
+// clamped at both ends. `s + 1` is always a valid sample.
+inline void linearTap(int d, int n, int size, int &s, float &w) {
+  float f = static_cast<float>((d + 0.5) * (static_cast<double>(n) / size) -
+                               0.5);
+  s = cvFloor(f);
+  w = f - s;
+  if (s < 0) {
+    s = 0;
+    w = 0.0f;
+  }
+  if (s >= n - 1) {
+    s = n - 2;
+    w = 1.0f;
+  }
+}
+
+} // namespace
+
 LiquifyEngine::LiquifyEngine(int width, int height)
     : width_(width), height_(height) {
   reset();
@@ -19,11 +43,106 @@ void LiquifyEngine::reset() {
       mesh_.push_back(cv::Point2f(x * cellW, y * cellH));
     }
   }
+
+  history_.clear();
+  keyframes_.assign(1, mesh_);
+  historyPos_ = 0;
+  mapsDirty_ = true;
+}
+
+void LiquifyEngine::beginStroke() { strokeBase_ = mesh_; }
+
+void LiquifyEngine::commitStroke() {
+  MeshDelta delta;
+  for (size_t i = 0; i < mesh_.size(); ++i) {
+    cv::Point2f offset = mesh_[i] - strokeBase_[i];
+    if (offset.x == 0.0f && offset.y == 0.0f)
+      continue;
+    delta.indices.push_back(static_cast<uint32_t>(i));
+    delta.offsets.push_back(offset);
+    // Store exactly what a replay from the previous mesh produces, so undo
+    // and redo land on bit-identical meshes.
+    mesh_[i] = strokeBase_[i] + offset;
+  }
+  if (delta.indices.empty())
+    return;
+
+  // A new stroke discards the redo tail
+  history_.resize(historyPos_);
+  keyframes_.resize(historyPos_ / kKeyframeInterval + 1);
+
+  delta.indices.shrink_to_fit();
+  delta.offsets.shrink_to_fit();
+  history_.push_back(std::move(delta));
+  ++historyPos_;
+  if (historyPos_ % kKeyframeInterval == 0)
+    keyframes_.push_back(mesh_);
+
+  trimHistory();
   mapsDirty_ = true;
 }
 
+void LiquifyEngine::applyDelta(const MeshDelta &delta) {
+  for (size_t i = 0; i < delta.indices.size(); ++i)
+    mesh_[delta.indices[i]] += delta.offsets[i];
+}
+
+void LiquifyEngine::rebuildMesh(size_t position) {
+  size_t k = position / kKeyframeInterval;
+  mesh_ = keyframes_[k];
+  for (size_t i = k * kKeyframeInterval; i < position; ++i)
+    applyDelta(history_[i]);
+  mapsDirty_ = true;
+}
+
+void LiquifyEngine::trimHistory() {
+  if (historyLimit_ == 0)
+    return;
+  // Drop whole keyframe intervals so keyframes_[0] stays the new base, and
+  // only while at least historyLimit_ strokes remain
+  while (history_.size() >= historyLimit_ + kKeyframeInterval &&
+         keyframes_.size() > 1 && historyPos_ >= kKeyframeInterval) {
+    history_.erase(history_.begin(), history_.begin() + kKeyframeInterval);
+    keyframes_.erase(keyframes_.begin());
+    historyPos_ -= kKeyframeInterval;
+  }
+}
+
+bool LiquifyEngine::undo() {
+  PB_TRACE_SCOPE("LiquifyEngine::undo");
+  if (!canUndo())
+    return false;
+  rebuildMesh(--historyPos_);
+  return true;
+}
+
+bool LiquifyEngine::redo() {
+  PB_TRACE_SCOPE("LiquifyEngine::redo");
+  if (!canRedo())
+    return false;
+  applyDelta(history_[historyPos_++]);
+  mapsDirty_ = true;
+  return true;
+}
+
+void LiquifyEngine::setHistoryLimit(size_t maxStrokes) {
+  historyLimit_ = maxStrokes;
+  trimHistory();
+}
+
+size_t LiquifyEngine::historyBytes() const {
+  size_t bytes = 0;
+  for (const auto &delta : history_)
+    bytes += delta.indices.capacity() * sizeof(uint32_t) +
+             delta.offsets.capacity() * sizeof(cv::Point2f);
+  for (const auto &keyframe : keyframes_)
+    bytes += keyframe.capacity() * sizeof(cv::Point2f);
+  return bytes;
+}
+
 void LiquifyEngine::push(float startX, float startY, float endX, float endY,
                          float radius, float strength) {
+  PB_TRACE_SCOPE("LiquifyEngine::push");
   // Convert normalized coords to absolute
   cv::Point2f start(startX * width_, startY * height_);
   cv::Point2f end(endX * width_, endY * height_);
@@ -31,6 +150,7 @@ void LiquifyEngine::push(float startX, float startY, float endX, float endY,
   float r = radius * std::max(width_, height_);
   float r2 = r * r;
 
+  beginStroke();
   // Simple deformation: move mesh points based on distance to segment or point
   // For simplicity, just moving points near 'start' towards 'vec'
   for (auto &pt : mesh_) {
@@ -41,14 +161,16 @@ void LiquifyEngine::push(float startX, float startY, float endX, float endY,
       pt += vec * factor;
     }
   }
-  mapsDirty_ = true;
+  commitStroke();
 }
 
 void LiquifyEngine::expand(float x, float y, float radius, float strength) {
+  PB_TRACE_SCOPE("LiquifyEngine::expand");
   cv::Point2f center(x * width_, y * height_);
   float r = radius * std::max(width_, height_);
   float r2 = r * r;
 
+  beginStroke();
   for (auto &pt : mesh_) {
     float dx = pt.x - center.x;
     float dy = pt.y - center.y;
@@ -64,48 +186,137 @@ void LiquifyEngine::expand(float x, float y, float radius, float strength) {
       pt += dir * (factor * r * 0.1f);
     }
   }
-  mapsDirty_ = true;
+  commitStroke();
 }
 
 void LiquifyEngine::updateMaps() {
+  PB_TRACE_SCOPE("LiquifyEngine::updateMaps");
   if (!mapsDirty_)
     return;
 
-  mapX_.create(height_, width_, CV_32FC1);
-  mapY_.create(height_, width_, CV_32FC1);
+  // Full-frame maps come from the pool so per-frame engines reuse them
+  if (mapX_.rows != height_ || mapX_.cols != width_) {
+    mapX_ = BufferPool::current().acquire(height_, width_, CV_32FC1);
+    mapY_ = BufferPool::current().acquire(height_, width_, CV_32FC1);
+  }
 
-  // Interpolate mesh to pixel maps
-  // This is the heavy part. For 32x32 mesh on 4k img, need efficient
-  // interpolation. Ideally use hardware acceleration or simpler bilinear from
-  // mesh. For this demo, we'll try using cv::resize from a coarse map.
+  fillMaps(0, height_, mapX_, mapY_);
+  mapsDirty_ = false;
+}
 
-  // 1. Create coarse maps from mesh
-  cv::Mat coarseX(meshRows_ + 1, meshCols_ + 1, CV_32FC1);
-  cv::Mat coarseY(meshRows_ + 1, meshCols_ + 1, CV_32FC1);
+void LiquifyEngine::fillMaps(int y0, int y1, cv::Mat &mapX,
+                             cv::Mat &mapY) const {
+  // Interpolate mesh to pixel maps. Same sampling as resizing the vertex
+  // grid to the frame, but any band of rows can be produced on its own, so
+  // tiled processing never needs the full-frame maps.
+  const int cols = meshCols_ + 1;
+  const int rows = meshRows_ + 1;
+  std::vector<int> sx(width_);
+  std::vector<float> wx(width_);
+  for (int x = 0; x < width_; ++x)
+    linearTap(x, cols, width_, sx[x], wx[x]);
 
-  for (int y = 0; y <= meshRows_; ++y) {
-    for (int x = 0; x <= meshCols_; ++x) {
-      int idx = y * (meshCols_ + 1) + x;
-      coarseX.at<float>(y, x) = mesh_[idx].x;
-      coarseY.at<float>(y, x) = mesh_[idx].y;
+  cv::parallel_for_(cv::Range(y0, y1), [&](const cv::Range &range) {
+    for (int y = range.start; y < range.end; ++y) {
+      int sy;
+      float wy;
+      linearTap(y, rows, height_, sy, wy);
+      const cv::Point2f *r0 = &mesh_[sy * cols];
+      const cv::Point2f *r1 = r0 + cols;
+      float *mx = mapX.ptr<float>(y - y0);
+      float *my = mapY.ptr<float>(y - y0);
+      for (int x = 0; x < width_; ++x) {
+        const int i = sx[x];
+        const float w = wx[x];
+        const float topX = r0[i].x * (1.0f - w) + r0[i + 1].x * w;
+        const float topY = r0[i].y * (1.0f - w) + r0[i + 1].y * w;
+        const float bottomX = r1[i].x * (1.0f - w) + r1[i + 1].x * w;
+        const float bottomY = r1[i].y * (1.0f - w) + r1[i + 1].y * w;
+        mx[x] = topX * (1.0f - wy) + bottomX * wy;
+        my[x] = topY * (1.0f - wy) + bottomY * wy;
+      }
     }
-  }
-
-  // 2. Resize to full resolution (Linear interpolation)
-  cv::resize(coarseX, mapX_, cv::Size(width_, height_), 0, 0, cv::INTER_LINEAR);
-  cv::resize(coarseY, mapY_, cv::Size(width_, height_), 0, 0, cv::INTER_LINEAR);
-
-  mapsDirty_ = false;
+  });
 }
 
 void LiquifyEngine::process(const ImageBuffer &input, ImageBuffer &output) {
+  PB_TRACE_SCOPE("LiquifyEngine::process");
   updateMaps();
+  cv::Mat src = input.getMat();
+  if (src.data == output.getMat().data) {
+    // remap cannot run in place and would clone the source; stage it in a
+    // pooled buffer instead
+    cv::Mat staged = BufferPool::current().acquire(src.size(), src.type());
+    src.copyTo(staged);
+    src = staged;
+  }
   // Remap
-  cv::remap(input.getMat(), output.getMat(), mapX_, mapY_, cv::INTER_LINEAR);
+  cv::remap(src, output.getMat(), mapX_, mapY_, cv::INTER_LINEAR);
+}
+
+cv::Range LiquifyEngine::sourceRows(const cv::Range &outputRows) const {
+  // Map values are convex combinations of the vertices of the mesh rows
+  // these pixel rows interpolate between
+  const int cols = meshCols_ + 1;
+  int first, last;
+  float w;
+  linearTap(outputRows.start, meshRows_ + 1, height_, first, w);
+  linearTap(outputRows.end - 1, meshRows_ + 1, height_, last, w);
+  float minY = mesh_[first * cols].y;
+  float maxY = minY;
+  for (int r = first; r <= last + 1; ++r) {
+    for (int c = 0; c < cols; ++c) {
+      minY = std::min(minY, mesh_[r * cols + c].y);
+      maxY = std::max(maxY, mesh_[r * cols + c].y);
+    }
+  }
+  // Bilinear remap reads rows floor(y) and floor(y) + 1 of y rounded to a
+  // 1/32 pixel, so allow a row of margin on either side
+  int start = std::max(0, std::min(height_ - 1, cvFloor(minY) - 1));
+  int end = std::min(height_, std::max(start + 1, cvFloor(maxY) + 3));
+  return cv::Range(start, end);
+}
+
+void LiquifyEngine::process(const FrameStrip &input, FrameStrip &output) const {
+  PB_TRACE_SCOPE("LiquifyEngine::process");
+  const cv::Mat &src = input.image.getMat();
+  cv::Mat dst = output.image.getMat();
+  const cv::Range in = input.rows();
+  const cv::Range out = output.rows();
+  const cv::Range need = sourceRows(out);
+  if (src.cols != width_ || dst.cols != width_ || output.frameRows != height_ ||
+      in.start > need.start || in.end < need.end || src.data == dst.data) {
+    std::cerr << "[Error] LiquifyEngine: input band does not cover the warp!"
+              << std::endl;
+    return;
+  }
+
+  BufferPool &pool = BufferPool::current();
+  cv::Mat mapX = pool.acquire(out.size(), width_, CV_32FC1);
+  cv::Mat mapY = pool.acquire(out.size(), width_, CV_32FC1);
+  fillMaps(out.start, out.end, mapX, mapY);
+  // Address the band instead of the frame. Subtracting a whole number of
+  // rows is exact for these coordinates, and so is remap's 1/32 pixel
+  // rounding of them: the same pixels and weights as a whole-frame remap.
+  if (in.start > 0)
+    cv::subtract(mapY, cv::Scalar(in.start), mapY);
+  cv::remap(src, dst, mapX, mapY, cv::INTER_LINEAR);
+}
+
+StripStage LiquifyEngine::stripStage() const {
+  StripStage stage;
+  stage.name = "liquify";
+  stage.inputRows = [this](const cv::Range &rows) { return sourceRows(rows); };
+  stage.scratchBytesPerPixel = 2 * sizeof(float); // The two maps
+  stage.process = [this](const FrameStrip &input, FrameStrip &output) {
+    process(input, output);
+  };
+  return stage;
 }
 
 void LiquifyEngine::slimFace(const std::vector<cv::Point2f> &landmarks,
                              float strength) {
+  PB_TRACE_SCOPE("LiquifyEngine::slimFace");
   if (landmarks.size() < 68)
     return;
 
@@ -142,12 +353,12 @@ void LiquifyEngine::slimFace(const std::vector<cv::Point2f> &landmarks,
     }
   };
 
+  beginStroke();
   for (int i : leftJaw)
     applySlim(i, 1.0f);
   for (int i : rightJaw)
     applySlim(i, -1.0f);
-
-  mapsDirty_ = true;
+  commitStroke();
 }
 
 } // namespace Processing
@@ -1,5 +1,7 @@
 #pragma once
 #include "../Core/ImageBuffer.h"
+#include "../Core/StripProcessor.h"
+#include <cstdint>
 #include <opencv2/opencv.hpp>
 #include <vector>
 
@@ -16,7 +18,7 @@ class LiquifyEngine {
 public:
   LiquifyEngine(int width, int height);
 
-  // Reset mesh to identity
+  // Reset mesh to identity and clear the undo history
   void reset();
 
   // Apply a warp tool (Push/Puck/Bloat)
@@ -32,9 +34,33 @@ public:
   void slimFace(const std::vector<cv::Point2f> &landmarks, float strength);
 
   // Apply the current mesh warp to an image
-  // Returns warped image
+  // Returns warped image. Any channel count; the alpha of 4-channel images
+  // is warped along with the color.
   void process(const ImageBuffer &input, ImageBuffer &output);
 
+  // Tiled processing (Core/StripProcessor.h). sourceRows() bounds the
+  // input rows the current warp samples for `outputRows`; the band form of
+  // process() writes the rows of `output` from an `input` holding them,
+  // identical to the whole-frame result, without full-frame maps.
+  cv::Range sourceRows(const cv::Range &outputRows) const;
+  void process(const FrameStrip &input, FrameStrip &output) const;
+  // The band form as a stage; the engine must outlive it
+  StripStage stripStage() const;
+
+  // Stroke history. Every push/expand/slimFace call is one undoable stroke.
+  bool undo();
+  bool redo();
+  bool canUndo() const { return historyPos_ > 0; }
+  bool canRedo() const { return historyPos_ < history_.size(); }
+
+  // At least this many strokes stay undoable. Older ones are dropped a
+  // keyframe interval (16 strokes) at a time, so the history holds fewer
+  // than maxStrokes + 16. 0 means unlimited.
+  void setHistoryLimit(size_t maxStrokes);
+  size_t historySize() const { return history_.size(); }
+  // Approximate heap memory held by the history (deltas + keyframes)
+  size_t historyBytes() const;
+
 private:
   int width_, height_;
   int meshRows_ = 32;
@@ -43,6 +69,31 @@ private:
   // Mesh vertices (absolute coordinates)
   std::vector<cv::Point2f> mesh_;
 
+  // Sparse record of the vertices moved by one stroke
+  struct MeshDelta {
+    std::vector<uint32_t> indices;
+    std::vector<cv::Point2f> offsets;
+  };
+
+  void beginStroke();
+  void commitStroke();
+  void applyDelta(const MeshDelta &delta);
+  void rebuildMesh(size_t position);
+  void trimHistory();
+
+  // history_[i] turns the mesh after i strokes into the mesh after i + 1.
+  // keyframes_[k] is the full mesh after k * kKeyframeInterval strokes, so a
+  // rebuild never replays more than kKeyframeInterval - 1 deltas.
+  static constexpr size_t kKeyframeInterval = 16;
+  std::vector<MeshDelta> history_;
+  std::vector<std::vector<cv::Point2f>> keyframes_;
+  size_t historyPos_ = 0;
+  size_t historyLimit_ = 0;
+  std::vector<cv::Point2f> strokeBase_;
+
+  // Pixel maps of frame rows [y0, y1): the mesh vertices bilinearly
+  // interpolated with cv::resize's INTER_LINEAR sampling
+  void fillMaps(int y0, int y1, cv::Mat &mapX, cv::Mat &mapY) const;
   void updateMaps();
   cv::Mat mapX_, mapY_;
   bool mapsDirty_ = true;
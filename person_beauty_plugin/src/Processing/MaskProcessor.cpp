@@ -1,9 +1,37 @@
 #include "MaskProcessor.h"
+#include "../Core/Kernels.h"
+#include <algorithm>
+#include <iostream>
+#include <vector>
 
 namespace PersonBeauty {
 namespace Processing {
 
+namespace {
+
+// Source samples s0, s1 and weight of s1 for destination index `d` when
+// cv::resize (INTER_LINEAR) scales `n` samples to `size`: pixel centers
+// aligned, clamped at both ends
+inline void linearTap(int d, int n, int size, int &s0, int &s1, float &w) {
+  const float f = static_cast<float>(
+      (d + 0.5) * (static_cast<double>(n) / size) - 0.5);
+  s0 = cvFloor(f);
+  w = f - s0;
+  if (s0 < 0) {
+    s0 = 0;
+    w = 0.0f;
+  }
+  if (s0 >= n - 1) {
+    s0 = n - 1;
+    w = 0.0f;
+  }
+  s1 = std::min(s0 + 1, n - 1);
+}
+
+} // namespace
+
 void MaskProcessor::feather(ImageBuffer &mask, int radius) {
+  PB_TRACE_SCOPE("MaskProcessor::feather");
   if (radius <= 0)
     return;
   // Ensure odd kernel size
@@ -12,6 +40,7 @@ void MaskProcessor::feather(ImageBuffer &mask, int radius) {
 }
 
 void MaskProcessor::expand(ImageBuffer &mask, int pixels) {
+  PB_TRACE_SCOPE("MaskProcessor::expand");
   if (pixels <= 0)
     return;
   cv::Mat element = cv::getStructuringElement(
@@ -20,6 +49,7 @@ void MaskProcessor::expand(ImageBuffer &mask, int pixels) {
 }
 
 void MaskProcessor::shrink(ImageBuffer &mask, int pixels) {
+  PB_TRACE_SCOPE("MaskProcessor::shrink");
   if (pixels <= 0)
     return;
   cv::Mat element = cv::getStructuringElement(
@@ -27,15 +57,102 @@ void MaskProcessor::shrink(ImageBuffer &mask, int pixels) {
   cv::erode(mask.getMat(), mask.getMat(), element);
 }
 
+void MaskProcessor::guidedUpsample(const ImageBuffer &mask,
+                                   const ImageBuffer &guide,
+                                   ImageBuffer &result, int radius,
+                                   float eps) {
+  PB_TRACE_SCOPE("MaskProcessor::guidedUpsample");
+  const cv::Mat &full = guide.getMat();
+  cv::Mat gray = full;
+  const int code = toGrayCode(guide.format());
+  if (code >= 0) {
+    gray = BufferPool::current().acquire(full.size(), CV_8UC1);
+    cv::cvtColor(full, gray, code);
+  }
+
+  // Coefficients a, b of mask ~ a * guide + b per window, at low resolution
+  const cv::Size low = mask.getMat().size();
+  cv::Mat I, p;
+  cv::resize(gray, I, low, 0, 0, cv::INTER_AREA);
+  I.convertTo(I, CV_32F, 1.0 / 255.0);
+  mask.getMat().convertTo(p, CV_32F, 1.0 / 255.0);
+
+  const cv::Size window(2 * std::max(1, radius) + 1,
+                        2 * std::max(1, radius) + 1);
+  cv::Mat meanI, meanP, corrI, corrIp;
+  cv::boxFilter(I, meanI, CV_32F, window);
+  cv::boxFilter(p, meanP, CV_32F, window);
+  cv::boxFilter(I.mul(I), corrI, CV_32F, window);
+  cv::boxFilter(I.mul(p), corrIp, CV_32F, window);
+  cv::Mat varI = corrI - meanI.mul(meanI);
+  cv::Mat covIp = corrIp - meanI.mul(meanP);
+  cv::Mat a = covIp / (varI + eps);
+  // b in 0..255 units, so the full-size pass needs no rescale
+  cv::Mat b = (meanP - a.mul(meanI)) * 255.0f;
+  cv::boxFilter(a, a, CV_32F, window);
+  cv::boxFilter(b, b, CV_32F, window);
+
+  // Full resolution, by bands of rows: a and b are interpolated like
+  // cv::resize (INTER_LINEAR) into pooled row scratch and applied at once,
+  // so no full-size float maps are made
+  if (result.getMat().size() != full.size() ||
+      result.getMat().type() != CV_8UC1)
+    result = ImageBuffer(full.cols, full.rows, 1);
+  cv::Mat &dst = result.getMat();
+  std::vector<int> sx0(full.cols), sx1(full.cols);
+  std::vector<float> wx(full.cols);
+  for (int x = 0; x < full.cols; ++x)
+    linearTap(x, low.width, full.cols, sx0[x], sx1[x], wx[x]);
+
+  cv::parallel_for_(cv::Range(0, full.rows), [&](const cv::Range &range) {
+    // Row 0: a, row 1: b, both blended between two low-resolution rows
+    cv::Mat scratch = BufferPool::current().acquire(2, low.width, CV_32F);
+    float *rowA = scratch.ptr<float>(0);
+    float *rowB = scratch.ptr<float>(1);
+    for (int y = range.start; y < range.end; ++y) {
+      int sy0, sy1;
+      float wy;
+      linearTap(y, low.height, full.rows, sy0, sy1, wy);
+      const float *a0 = a.ptr<float>(sy0), *a1 = a.ptr<float>(sy1);
+      const float *b0 = b.ptr<float>(sy0), *b1 = b.ptr<float>(sy1);
+      for (int x = 0; x < low.width; ++x) {
+        rowA[x] = a0[x] * (1.0f - wy) + a1[x] * wy;
+        rowB[x] = b0[x] * (1.0f - wy) + b1[x] * wy;
+      }
+
+      const uint8_t *g = gray.ptr<uint8_t>(y);
+      uint8_t *out = dst.ptr<uint8_t>(y);
+      for (int x = 0; x < full.cols; ++x) {
+        const int i0 = sx0[x], i1 = sx1[x];
+        const float w = wx[x];
+        const float ax = rowA[i0] * (1.0f - w) + rowA[i1] * w;
+        const float bx = rowB[i0] * (1.0f - w) + rowB[i1] * w;
+        out[x] = cv::saturate_cast<uint8_t>(ax * g[x] + bx);
+      }
+    }
+  });
+}
+
 void MaskProcessor::add(ImageBuffer &target, const ImageBuffer &source) {
+  PB_TRACE_SCOPE("MaskProcessor::add");
   cv::bitwise_or(target.getMat(), source.getMat(), target.getMat());
 }
 
 void MaskProcessor::subtract(ImageBuffer &target, const ImageBuffer &source) {
-  // target = target - source  => target & ~source
-  cv::Mat notSource;
-  cv::bitwise_not(source.getMat(), notSource);
-  cv::bitwise_and(target.getMat(), notSource, target.getMat());
+  PB_TRACE_SCOPE("MaskProcessor::subtract");
+  // target = target - source  => target & ~source, fused per row
+  const cv::Mat &src = source.getMat();
+  cv::Mat &dst = target.getMat();
+  if (src.size() != dst.size() || src.type() != dst.type() ||
+      src.depth() != CV_8U) {
+    std::cerr << "[Error] MaskProcessor: subtract expects two 8-bit masks of "
+                 "the same size!"
+              << std::endl;
+    return;
+  }
+  const size_t rowBytes = dst.cols * dst.elemSize();
+  for (int y = 0; y < dst.rows; ++y)
+    Kernels::maskAndNot(dst.ptr<uint8_t>(y), src.ptr<uint8_t>(y), rowBytes);
 }
 
 } // namespace Processing
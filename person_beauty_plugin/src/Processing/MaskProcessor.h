@@ -5,11 +5,20 @@
 namespace PersonBeauty {
 namespace Processing {
 
+// Masks are single-channel 8-bit, also when the frame they belong to is
+// 4-channel (BGRA/RGBA).
 class MaskProcessor {
 public:
   static void feather(ImageBuffer &mask, int radius);
   static void expand(ImageBuffer &mask, int pixels);
   static void shrink(ImageBuffer &mask, int pixels);
+  // Upsample a soft `mask` to the size of `guide` into `result` with a fast
+  // guided filter: the local linear fit of mask to gray guide is solved at
+  // the mask's resolution, then only applied at full size, so the mask's
+  // edges follow the image's. `radius` is in mask pixels, `eps` in squared
+  // intensity (0..1) units; larger values smooth more.
+  static void guidedUpsample(const ImageBuffer &mask, const ImageBuffer &guide,
+                             ImageBuffer &result, int radius, float eps);
 
   // Combine multiple masks (e.g. Skin + Neck)
   static void add(ImageBuffer &target, const ImageBuffer &source);
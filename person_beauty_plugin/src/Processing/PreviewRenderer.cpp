@@ -0,0 +1,154 @@
+#include "PreviewRenderer.h"
+#include "../Core/StripProcessor.h"
+#include "../Core/TaskScheduler.h"
+#include <algorithm>
+#include <memory>
+
+namespace PersonBeauty {
+namespace Processing {
+
+PreviewRenderer::PreviewRenderer(const ImageBuffer &source,
+                                 const BeautyAnalysis &analysis)
+    : source_(source), analysis_(analysis) {
+  const cv::Mat &src = source_.getMat();
+  setViewport(src.cols, src.rows);
+}
+
+PreviewRenderer::~PreviewRenderer() {
+  stopIdleThread();
+  cancel();
+  // Jobs hold `this`; wait until the last one has seen the cancellation
+  std::unique_lock<std::mutex> lock(jobsMutex_);
+  jobsCv_.wait(lock, [this]() { return activeJobs_.load() == 0; });
+}
+
+void PreviewRenderer::setViewport(int width, int height) {
+  PB_TRACE_SCOPE("PreviewRenderer::setViewport");
+  const cv::Mat &src = source_.getMat();
+  if (src.empty() || width <= 0 || height <= 0)
+    return;
+  proxyScale_ = std::min({1.0f, static_cast<float>(width) / src.cols,
+                          static_cast<float>(height) / src.rows});
+  const cv::Size size(std::max(1, cvRound(src.cols * proxyScale_)),
+                      std::max(1, cvRound(src.rows * proxyScale_)));
+
+  // Area averaging keeps the proxy free of aliasing; the mask is resized
+  // the same way, so its feathering shrinks with the image
+  proxySource_ = ImageBuffer(size.width, size.height, source_.format());
+  cv::resize(src, proxySource_.getMat(), size, 0, 0, cv::INTER_AREA);
+
+  const cv::Mat &mask = analysis_.skinMask.getMat();
+  proxyAnalysis_.skinMask = ImageBuffer(size.width, size.height, 1);
+  if (mask.empty())
+    proxyAnalysis_.skinMask.getMat() = cv::Scalar(0);
+  else
+    cv::resize(mask, proxyAnalysis_.skinMask.getMat(), size, 0, 0,
+               cv::INTER_AREA);
+
+  const float sx = static_cast<float>(size.width) / src.cols;
+  const float sy = static_cast<float>(size.height) / src.rows;
+  proxyAnalysis_.landmarks = analysis_.landmarks;
+  for (auto &points : proxyAnalysis_.landmarks) {
+    for (auto &p : points) {
+      p.x *= sx;
+      p.y *= sy;
+    }
+  }
+}
+
+ImageBuffer PreviewRenderer::renderPreview(const BeautyParams &params) {
+  PB_TRACE_SCOPE("PreviewRenderer::renderPreview");
+  // The user is still interacting: full-resolution work is stale
+  ++generation_;
+  {
+    std::lock_guard<std::mutex> lock(idleMutex_);
+    lastParams_ = params;
+    lastPreview_ = std::chrono::steady_clock::now();
+    previewPending_ = true;
+  }
+  idleCv_.notify_all();
+
+  const cv::Mat &src = proxySource_.getMat();
+  const BeautyChain chain(src.cols, src.rows, proxyAnalysis_, params,
+                          proxyScale_);
+  return chain.render(proxySource_);
+}
+
+void PreviewRenderer::refine(const BeautyParams &params,
+                             RefineCallback done) {
+  const uint64_t generation = ++generation_;
+  ++activeJobs_;
+  auto job = [this, params, done, generation]() {
+    PB_TRACE_SCOPE("PreviewRenderer::refine");
+    auto stale = [this, generation]() { return generation_ != generation; };
+    if (!stale()) {
+      const cv::Mat &src = source_.getMat();
+      const BeautyChain chain(src.cols, src.rows, analysis_, params);
+
+      // Row bands keep the working set bounded and give cancellation a
+      // chance between every band and stage
+      StripProcessor tiler(refineMemoryLimit_);
+      tiler.setCancelCheck(stale);
+      chain.addStages(tiler);
+
+      ImageBuffer result;
+      if (tiler.run(source_, result) && !stale() && done)
+        done(result);
+    }
+    // Notify under the lock: the destructor may return as soon as it is
+    // released
+    std::lock_guard<std::mutex> lock(jobsMutex_);
+    --activeJobs_;
+    jobsCv_.notify_all();
+  };
+  TaskScheduler::instance().pool().enqueue(job, TaskPriority::Low);
+}
+
+void PreviewRenderer::cancel() { ++generation_; }
+
+void PreviewRenderer::setAutoRefine(std::chrono::milliseconds idle,
+                                    RefineCallback done) {
+  stopIdleThread();
+  if (idle.count() <= 0)
+    return;
+  std::lock_guard<std::mutex> lock(idleMutex_);
+  idleDelay_ = idle;
+  idleDone_ = std::move(done);
+  previewPending_ = false;
+  stopping_ = false;
+  idleThread_ = std::thread([this]() { idleLoop(); });
+}
+
+void PreviewRenderer::stopIdleThread() {
+  {
+    std::lock_guard<std::mutex> lock(idleMutex_);
+    stopping_ = true;
+  }
+  idleCv_.notify_all();
+  if (idleThread_.joinable())
+    idleThread_.join();
+}
+
+void PreviewRenderer::idleLoop() {
+  std::unique_lock<std::mutex> lock(idleMutex_);
+  while (!stopping_) {
+    if (!previewPending_) {
+      idleCv_.wait(lock);
+      continue;
+    }
+    // Every preview moves the deadline; refine once it passes untouched
+    idleCv_.wait_until(lock, lastPreview_ + idleDelay_);
+    if (!stopping_ && previewPending_ &&
+        std::chrono::steady_clock::now() >= lastPreview_ + idleDelay_) {
+      previewPending_ = false;
+      const BeautyParams params = lastParams_;
+      RefineCallback done = idleDone_;
+      lock.unlock();
+      refine(params, done);
+      lock.lock();
+    }
+  }
+}
+
+} // namespace Processing
+} // namespace PersonBeauty
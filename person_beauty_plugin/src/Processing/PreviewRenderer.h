@@ -0,0 +1,92 @@
+#pragma once
+#include "../Core/ImageBuffer.h"
+#include "BeautyChain.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <thread>
+#include <vector>
+
+namespace PersonBeauty {
+namespace Processing {
+
+// Interactive editing of one photo. While sliders move, renderPreview()
+// applies every edit to a viewport-sized proxy of the source, built once
+// from the already computed analysis (downscaled mask, scaled landmarks),
+// so no model runs again. refine() renders the same parameters at source
+// resolution on a low-priority pool worker; any newer preview or refine
+// cancels it between row bands, and its callback is never invoked.
+class PreviewRenderer {
+public:
+  using RefineCallback = std::function<void(const ImageBuffer &result)>;
+
+  // `source` and `analysis` are shared, not copied; they must not change
+  // while the renderer exists
+  PreviewRenderer(const ImageBuffer &source, const BeautyAnalysis &analysis);
+  // Cancels refinement and waits for it to stop
+  ~PreviewRenderer();
+  PreviewRenderer(const PreviewRenderer &) = delete;
+  PreviewRenderer &operator=(const PreviewRenderer &) = delete;
+
+  // The proxy fits inside this size (aspect kept, never upscaled)
+  void setViewport(int width, int height);
+  // Proxy size relative to the source
+  float proxyScale() const { return proxyScale_; }
+
+  // Render on the proxy. Cancels refinement in flight; with auto refine on
+  // it also restarts the idle timer. Call from one (UI) thread.
+  ImageBuffer renderPreview(const BeautyParams &params);
+
+  // Render at source resolution in the background; `done` runs on the
+  // worker unless cancelled first
+  void refine(const BeautyParams &params, RefineCallback done);
+  // Drop refinement in flight (its callback is not called)
+  void cancel();
+  bool isRefining() const { return activeJobs_.load() > 0; }
+
+  // Start refine() of the last previewed parameters once no preview has
+  // been rendered for `idle` (the user stopped dragging). Zero turns it
+  // off.
+  void setAutoRefine(std::chrono::milliseconds idle, RefineCallback done);
+
+  // Working set ceiling of refinement (row bands, see StripProcessor).
+  // Smaller bands also make cancellation take effect sooner.
+  void setRefineMemoryLimit(size_t bytes) { refineMemoryLimit_ = bytes; }
+
+private:
+  void idleLoop();
+  void stopIdleThread();
+
+  ImageBuffer source_;
+  BeautyAnalysis analysis_;
+
+  ImageBuffer proxySource_;
+  BeautyAnalysis proxyAnalysis_;
+  float proxyScale_ = 1.0f;
+
+  // Bumped by every preview / refine / cancel; a refine job is stale once
+  // it no longer matches the value it started with
+  std::atomic<uint64_t> generation_{0};
+  std::atomic<int> activeJobs_{0};
+  std::mutex jobsMutex_;
+  std::condition_variable jobsCv_;
+  size_t refineMemoryLimit_ = size_t(256) << 20;
+
+  // Auto refine
+  std::mutex idleMutex_;
+  std::condition_variable idleCv_;
+  std::thread idleThread_;
+  std::chrono::milliseconds idleDelay_{0};
+  RefineCallback idleDone_;
+  BeautyParams lastParams_;
+  std::chrono::steady_clock::time_point lastPreview_;
+  bool previewPending_ = false;
+  bool stopping_ = false;
+};
+
+} // namespace Processing
+} // namespace PersonBeauty
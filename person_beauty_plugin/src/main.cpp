@@ -1,23 +1,417 @@
 #include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <future>
 #include <iostream>
 #include <memory>
 #include <opencv2/opencv.hpp>
+#include <optional>
 #include <string>
-#include <thread>
 #include <vector>
 
 #include "AI/FaceDetector.h"
 #include "AI/FaceLandmarkModel.h"
 #include "AI/ParsingModel.h"
+#include "Core/AllocationAudit.h"
+#include "Core/BatchProcessor.h"
 #include "Core/ImageBuffer.h"
+#include "Core/ImageIO.h"
+#include "Core/Pipeline.h"
+#include "Core/RenderGraph.h"
+#include "Core/StripProcessor.h"
+#include "Core/TaskScheduler.h"
+#include "Core/Trace.h"
 #include "Network/GenAPIClient.h"
+#include "Processing/BeautyChain.h"
 #include "Processing/ColorEngine.h"
 #include "Processing/LiquifyEngine.h"
 #include "Processing/MaskProcessor.h"
+#include "Processing/PreviewRenderer.h"
 
 using namespace PersonBeauty;
 
-int main() {
+// Per-frame data shared by the pipeline stages
+struct BeautyFrame {
+  ImageBuffer source; // Read-only input for analysis stages
+  // Reduced decode read by the detector and parsing model instead of
+  // `source` when set
+  AnalysisImage analysis;
+  ImageBuffer image;  // Output; retouch writes it first, later stages edit it
+  std::vector<AI::FaceBox> faces;
+  std::vector<std::vector<cv::Point2f>> landmarks;
+  ImageBuffer skinMask;
+};
+
+// Models are loaded once and shared by every pipeline stage / batch worker
+struct BeautyModels {
+  AI::FaceDetector faceDetector;
+  AI::ParsingModel parsingModel;
+  AI::FaceLandmarkModel landmarkModel;
+  bool hasDetector = false;
+  bool hasLandmarks = false;
+  bool hasParsing = false;
+
+  void load(const std::string &modelDir) {
+    hasDetector = faceDetector.load(modelDir + "face_detector.onnx");
+    // Small faces of group photos survive the downscale to the model input
+    AI::DetectionOptions detection;
+    detection.mode = AI::DetectionMode::Adaptive;
+    faceDetector.setOptions(detection);
+    hasLandmarks = landmarkModel.load(modelDir + "face_landmark.onnx");
+    hasParsing = parsingModel.load(modelDir + "face_parsing.onnx");
+  }
+};
+
+static void detectFaces(BeautyFrame &frame, BeautyModels &models) {
+  if (!models.hasDetector)
+    return;
+  if (frame.analysis.empty()) {
+    frame.faces = models.faceDetector.detect(frame.source);
+    return;
+  }
+  // Boxes found on the reduced decode, in full-resolution coordinates
+  frame.faces = models.faceDetector.detect(frame.analysis.image);
+  const cv::Point2f scale = frame.analysis.scale();
+  for (auto &face : frame.faces) {
+    face.x1 *= scale.x;
+    face.x2 *= scale.x;
+    face.y1 *= scale.y;
+    face.y2 *= scale.y;
+  }
+}
+
+static void extractLandmarks(BeautyFrame &frame, BeautyModels &models) {
+  if (!models.hasLandmarks)
+    return;
+  for (const auto &face : frame.faces) {
+    auto points = models.landmarkModel.getLandmarks(frame.source, face);
+    if (!points.empty())
+      frame.landmarks.push_back(std::move(points));
+  }
+}
+
+// Skin Mask（不依赖人脸检测）
+static bool buildSkinMask(BeautyFrame &frame, BeautyModels &models) {
+  const bool reduced = !frame.analysis.empty();
+  const cv::Size size =
+      reduced ? frame.analysis.fullSize : frame.source.getMat().size();
+  frame.skinMask = ImageBuffer(size.width, size.height, 1);
+  frame.skinMask.getMat() = cv::Scalar(0);
+  if (!models.hasParsing)
+    return false;
+  auto parsingResult = models.parsingModel.process(
+      reduced ? frame.analysis.image : frame.source);
+  if (!parsingResult)
+    return false;
+  // The parsing map is at the resolution of its input; classes 1 (skin),
+  // 10 (nose) and 14 (neck) map to 255 in a single pass
+  static const cv::Mat skinLut = []() {
+    cv::Mat lut(1, 256, CV_8UC1, cv::Scalar(0));
+    for (int label : {1, 10, 14})
+      lut.at<uchar>(label) = 255;
+    return lut;
+  }();
+  if (reduced) {
+    // Upsample the mask, not the labels: interpolation is only valid on it
+    cv::Mat mask;
+    cv::LUT(parsingResult->getMat(), skinLut, mask);
+    cv::resize(mask, frame.skinMask.getMat(), size, 0, 0, cv::INTER_LINEAR);
+  } else {
+    cv::LUT(parsingResult->getMat(), skinLut, frame.skinMask.getMat());
+  }
+  Processing::MaskProcessor::feather(frame.skinMask, 10);
+  return true;
+}
+
+// Edit parameters shared by the whole-frame and tiled paths
+constexpr float kBrightness = 0.1f;
+constexpr float kContrast = 1.05f;
+constexpr float kRetouchStrength = 0.7f;
+constexpr float kStereoStrength = 0.7f;
+constexpr float kSlimStrength = 0.45f;
+// Smallest long side of the reduced decode: the analysis models take at
+// most 512 px inputs
+constexpr int kAnalysisMinSide = 640;
+
+// 中性灰磨皮
+static void retouch(BeautyFrame &frame) {
+  // source -> image: the input is never copied into the output
+  Processing::ColorEngine::adjust(frame.source, frame.image, frame.skinMask,
+                                  kBrightness, kContrast, 1.0f, 0.0f);
+  Processing::ColorEngine::applyNeutralGrayRetouch(frame.image, frame.skinMask,
+                                                   kRetouchStrength);
+}
+
+// 中性灰立体增强
+static void stereo(BeautyFrame &frame) {
+  for (const auto &pts : frame.landmarks)
+    Processing::ColorEngine::applyNeutralGrayStereo(frame.image, pts,
+                                                    kStereoStrength);
+}
+
+// 自动瘦脸
+static void liquify(BeautyFrame &frame) {
+  const cv::Mat &img = frame.image.getMat();
+  Processing::LiquifyEngine liquify(img.cols, img.rows);
+  for (const auto &pts : frame.landmarks)
+    liquify.slimFace(pts, kSlimStrength);
+  liquify.process(frame.image, frame.image);
+}
+
+// 超大图：调色、磨皮、立体与瘦脸按行带流式执行，工作内存不超过
+// memoryLimit，结果与整帧处理逐位一致
+static void renderTiled(BeautyFrame &frame, size_t memoryLimit) {
+  const cv::Mat &img = frame.source.getMat();
+  Processing::BeautyParams params;
+  params.brightness = kBrightness;
+  params.contrast = kContrast;
+  params.retouchStrength = kRetouchStrength;
+  params.stereoStrength = kStereoStrength;
+  params.slimStrength = kSlimStrength;
+  const Processing::BeautyChain chain(img.cols, img.rows,
+                                      {frame.skinMask, frame.landmarks},
+                                      params);
+
+  // One per worker, so its strip buffers are reused across images
+  thread_local StripProcessor tiler;
+  tiler.setMemoryLimit(memoryLimit);
+  tiler.clearStages();
+  chain.addStages(tiler);
+  tiler.run(frame.source, frame.image);
+  // The stages refer to the chain and hold this frame's mask; only the
+  // strip buffers may outlive the call
+  tiler.clearStages();
+}
+
+// Call after changing `params`; only edits whose sliders moved rerun. Each
+// node stores the values with their hash, so it never runs with values
+// other than those its cache key was made from.
+static void setBeautyParams(RenderGraph &graph,
+                            const Processing::BeautyParams &params) {
+  using Processing::BeautyChain;
+  for (int i = 0; i < BeautyChain::StepCount; ++i) {
+    const auto step = static_cast<BeautyChain::Step>(i);
+    graph.setParams(BeautyChain::stepName(step), std::any(params),
+                    BeautyChain::paramsHash(step, params));
+  }
+}
+
+// 交互编辑：分析与各编辑步骤的结果缓存在 RenderGraph 中，只拖动滑杆时
+// 仅重跑受影响的编辑步骤及其下游，模型推理不会重新执行。
+// 编辑参数初始为 params，之后通过 setBeautyParams 修改
+static void buildBeautyGraph(RenderGraph &graph, BeautyModels &models,
+                             const Processing::BeautyParams &params) {
+  auto image = [](const std::any *v) -> const ImageBuffer & {
+    return std::any_cast<const ImageBuffer &>(*v);
+  };
+  auto faces = [](const std::any *v) -> const auto & {
+    return std::any_cast<const std::vector<AI::FaceBox> &>(*v);
+  };
+  auto points = [](const std::any *v) -> const auto & {
+    return std::any_cast<const std::vector<std::vector<cv::Point2f>> &>(*v);
+  };
+
+  graph.addInput("source");
+  graph.addNode(
+      "faces",
+      [&models, image](const RenderGraph::Inputs &in, const std::any &) {
+        BeautyFrame frame;
+        frame.source = image(in[0]);
+        detectFaces(frame, models);
+        return std::any(std::move(frame.faces));
+      },
+      {"source"});
+  graph.addNode(
+      "landmarks",
+      [&models, image, faces](const RenderGraph::Inputs &in,
+                              const std::any &) {
+        BeautyFrame frame;
+        frame.source = image(in[0]);
+        frame.faces = faces(in[1]);
+        extractLandmarks(frame, models);
+        return std::any(std::move(frame.landmarks));
+      },
+      {"source", "faces"});
+  graph.addNode(
+      "skinMask",
+      [&models, image](const RenderGraph::Inputs &in, const std::any &) {
+        BeautyFrame frame;
+        frame.source = image(in[0]);
+        buildSkinMask(frame, models);
+        return std::any(frame.skinMask);
+      },
+      {"source"});
+
+  // One node per step of the chain. Edits write new images: their inputs
+  // are cached results.
+  using Processing::BeautyChain;
+  std::string previous = "source";
+  for (int i = 0; i < BeautyChain::StepCount; ++i) {
+    const auto step = static_cast<BeautyChain::Step>(i);
+    graph.addNode(
+        BeautyChain::stepName(step),
+        [step, image, points](const RenderGraph::Inputs &in,
+                              const std::any &p) {
+          const ImageBuffer &src = image(in[0]);
+          const Processing::BeautyAnalysis analysis{image(in[1]),
+                                                    points(in[2])};
+          const BeautyChain chain(
+              src.getMat().cols, src.getMat().rows, analysis,
+              std::any_cast<const Processing::BeautyParams &>(p));
+          return std::any(chain.apply(step, src));
+        },
+        {previous, "skinMask", "landmarks"});
+    previous = BeautyChain::stepName(step);
+  }
+  setBeautyParams(graph, params);
+}
+
+// 批处理：并行度来自工作窃取线程池，每张图片在单个线程内顺序执行所有阶段
+static int runBatch(const std::vector<BatchJob> &jobs,
+                    const std::string &modelDir, bool auditAllocations,
+                    size_t tileLimit) {
+  std::cout << "=== 批处理模式: " << jobs.size() << " 张图片 ===" << std::endl;
+  BeautyModels models;
+  models.load(modelDir);
+
+  ThreadPool &pool = TaskScheduler::instance().pool();
+  BatchProcessor batch(pool, [&](ImageBuffer &image) {
+    // Frames after a worker's first one should not allocate: every
+    // full-frame buffer comes back from the thread's BufferPool
+    thread_local int framesOnThread = 0;
+    std::optional<AllocationAudit::Scope> audit;
+    if (auditAllocations && framesOnThread++ > 0)
+      audit.emplace("batch frame");
+
+    BeautyFrame frame;
+    const cv::Mat &input = image.getMat();
+    frame.source = image;
+    frame.image = ImageBuffer(input.cols, input.rows, image.format());
+    detectFaces(frame, models);
+    extractLandmarks(frame, models);
+    buildSkinMask(frame, models);
+    if (tileLimit > 0) {
+      renderTiled(frame, tileLimit);
+    } else {
+      retouch(frame);
+      stereo(frame);
+      liquify(frame);
+    }
+    image = frame.image; // Hand the result to the encoder without a copy
+    return true;
+  });
+
+  BatchStats stats = batch.run(jobs);
+  std::cout << "      线程数: " << pool.size() << ", 成功: " << stats.succeeded
+            << ", 失败: " << stats.failed << std::endl;
+  std::cout << "      耗时: " << stats.seconds << " s, 吞吐: "
+            << stats.imagesPerSecond << " images/s" << std::endl;
+  std::cout << "      单张延迟 p50/p95/p99: " << stats.p50Ms << " / "
+            << stats.p95Ms << " / " << stats.p99Ms << " ms" << std::endl;
+  return stats.failed == 0 ? 0 : 1;
+}
+
+static void printUsage(const char *argv0) {
+  std::cout << "Usage:\n"
+            << "  " << argv0 << "                      集成测试 (../../test.jpg)\n"
+            << "  " << argv0
+            << " --input-dir DIR --output-dir DIR [--jobs N] [--models DIR]\n"
+            << "  " << argv0
+            << " --file-list FILE --output-dir DIR [--jobs N] [--models DIR]\n"
+            << "  --api URL     集成测试所调用的生成 API (可指向本地桩服务)\n"
+            << "  --trace FILE  记录各阶段耗时并导出 Chrome trace JSON\n"
+            << "  --audit-alloc 批处理稳态下报告每帧的堆分配\n"
+            << "  --fp16        中性灰图层以半精度存储 (内存减半)\n"
+            << "  --tile-mb N   批处理按行带分块处理, 工作内存上限 N MB"
+            << std::endl;
+}
+
+static int runDemo(const std::string &modelDir,
+                   const std::string &apiEndpoint);
+
+int main(int argc, char **argv) {
+  std::string inputDir, fileList, outputDir, tracePath;
+  std::string modelDir = "../models/";
+  std::string apiEndpoint = "https://api.example.com/generate";
+  size_t numThreads = 0;
+  bool auditAllocations = false;
+  bool halfLayers = false;
+  size_t tileLimit = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--input-dir" && hasValue)
+      inputDir = argv[++i];
+    else if (arg == "--file-list" && hasValue)
+      fileList = argv[++i];
+    else if (arg == "--output-dir" && hasValue)
+      outputDir = argv[++i];
+    else if (arg == "--models" && hasValue)
+      modelDir = std::string(argv[++i]) + "/";
+    else if (arg == "--api" && hasValue)
+      apiEndpoint = argv[++i];
+    else if (arg == "--trace" && hasValue)
+      tracePath = argv[++i];
+    else if (arg == "--fp16")
+      halfLayers = true;
+    else if (arg == "--audit-alloc")
+      auditAllocations = true;
+    else if (arg == "--tile-mb" && hasValue)
+      tileLimit = std::strtoul(argv[++i], nullptr, 10) << 20;
+    else if (arg == "--jobs" && hasValue)
+      numThreads = std::strtoul(argv[++i], nullptr, 10);
+    else {
+      printUsage(argv[0]);
+      return arg == "--help" || arg == "-h" ? 0 : 1;
+    }
+  }
+
+  // --jobs 是整个进程的 CPU 预算 (线程池、OpenCV 与 ONNX Runtime 共享)
+  SchedulerConfig schedulerConfig;
+  schedulerConfig.maxThreads = numThreads;
+  TaskScheduler::configure(schedulerConfig);
+
+  if (!inputDir.empty() || !fileList.empty()) {
+    if (outputDir.empty()) {
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+
+  Trace::setEnabled(!tracePath.empty());
+  if (auditAllocations)
+    AllocationAudit::install();
+  if (halfLayers)
+    Processing::ColorEngine::setLayerPrecision(
+        Processing::LayerPrecision::Float16);
+
+  int ret = 0;
+  if (inputDir.empty() && fileList.empty()) {
+    ret = runDemo(modelDir, apiEndpoint);
+  } else {
+    auto jobs = inputDir.empty()
+                    ? BatchProcessor::jobsFromList(fileList, outputDir)
+                    : BatchProcessor::jobsFromDirectory(inputDir, outputDir);
+    ret = runBatch(jobs, modelDir, auditAllocations, tileLimit);
+  }
+
+  if (!tracePath.empty()) {
+    std::cout << "=== 阶段耗时统计 ===" << std::endl;
+    for (const auto &c : Trace::counters()) {
+      std::cout << "      " << c.name << ": " << c.calls << " 次, 总计 "
+                << c.totalNs / 1e6 << " ms, 最大 " << c.maxNs / 1e6
+                << " ms, 分配 " << c.bytes / (1024.0 * 1024.0) << " MB"
+                << std::endl;
+    }
+    if (Trace::exportChromeTrace(tracePath))
+      std::cout << "      Trace 已导出至 " << tracePath << std::endl;
+  }
+  return ret;
+}
+
+static int runDemo(const std::string &modelDir,
+                   const std::string &apiEndpoint) {
   std::cout << "=== 人像美颜插件集成测试 (关键点优化 & 中性灰版) ==="
             << std::endl;
 
@@ -25,103 +419,226 @@ int main() {
   std::string imagePath = "../../test.jpg";
   std::cout << "[1/7] 加载测试图像: " << imagePath << " ..." << std::endl;
 
-  cv::Mat rawImg = cv::imread(imagePath);
-  if (rawImg.empty()) {
+  auto encoded = ImageIO::readFile(imagePath);
+  if (!encoded) {
     std::cerr << "[错误] 无法加载图像: " << imagePath << std::endl;
     return 1;
   }
-
-  int width = rawImg.cols;
-  int height = rawImg.rows;
-  ImageBuffer mainImage(width, height, 3);
-  rawImg.copyTo(mainImage.getMat());
+  // 分析模型只需小图：大尺寸 JPEG 在 DCT 域按 1/2~1/8 缩放解码，与全分辨率
+  // 解码并行执行，人脸检测与语义分割无需等待全图解码完成
+  const int analysisScale = ImageIO::reducedScale(*encoded, kAnalysisMinSide);
 
   // 2. AI 模型推理
   std::cout << "[2/7] 加载 AI 模型并运行推理..." << std::endl;
+  BeautyModels models;
+  models.load(modelDir);
 
-  AI::FaceDetector faceDetector;
-  AI::ParsingModel parsingModel;
-  AI::FaceLandmarkModel landmarkModel;
+  // 分析阶段读取只读的原图 source，编辑阶段写 image，
+  // 因此人脸检测/关键点与语义分割、色彩调整可以并行执行。
+  Pipeline pipeline(TaskScheduler::instance().pool());
 
-  std::string modelDir = "../models/";
+  pipeline.addStage("decode", [&](PipelineFrame &f) {
+    auto &frame = f.get<BeautyFrame>();
+    frame.source = ImageIO::decode(*encoded);
+    const cv::Mat &src = frame.source.getMat();
+    // 模拟宿主程序：输出像素由宿主持有，插件直接包装而不拷贝
+    cv::Mat hostOutput(src.size(), src.type());
+    frame.image = ImageBuffer::wrap(hostOutput.data, hostOutput.cols,
+                                    hostOutput.rows, hostOutput.step,
+                                    PixelFormat::BGR8, [hostOutput]() {});
+  });
+  // The detector and the parsing model wait only for the reduced decode
+  std::string analysisDecode = "decode";
+  if (analysisScale > 1) {
+    analysisDecode = "decodeAnalysis";
+    pipeline.addStage(analysisDecode, [&](PipelineFrame &f) {
+      f.get<BeautyFrame>().analysis =
+          ImageIO::decodeReduced(*encoded, analysisScale);
+    });
+  }
+  std::chrono::steady_clock::time_point decodeStart;
+  // Edits skip a frame whose full decode failed
+  auto decoded = [](BeautyFrame &frame) {
+    return !frame.source.getMat().empty();
+  };
 
-  // Face Detector
-  std::vector<AI::FaceBox> faces;
-  if (faceDetector.load(modelDir + "face_detector.onnx")) {
-    faces = faceDetector.detect(mainImage);
-    std::cout << "      [人脸检测] 检测到 " << faces.size() << " 张人脸。"
-              << std::endl;
-  }
-
-  // Face Landmarks & Debug visualization
-  cv::Mat landmarkDebugImg = rawImg.clone();
-  if (landmarkModel.load(modelDir + "face_landmark.onnx")) {
-    std::cout << "      [关键点检测] 提取人脸关键点..." << std::endl;
-    for (const auto &face : faces) {
-      auto points = landmarkModel.getLandmarks(mainImage, face);
-      if (!points.empty()) {
-        for (const auto &p : points) {
-          cv::circle(landmarkDebugImg, cv::Point((int)p.x, (int)p.y), 2,
-                     cv::Scalar(0, 0, 255), -1); // RGB -> BGR(Red)
+  pipeline.addStage(
+      "detect",
+      [&](PipelineFrame &f) {
+        auto &frame = f.get<BeautyFrame>();
+        if (!models.hasDetector)
+          return;
+        detectFaces(frame, models);
+        std::cout << "      [人脸检测] 检测到 " << frame.faces.size()
+                  << " 张人脸，自开始解码起 "
+                  << std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - decodeStart)
+                         .count()
+                  << " ms (缩放解码 1/" << analysisScale << ")" << std::endl;
+      },
+      {analysisDecode});
+
+  pipeline.addStage(
+      "landmarks",
+      [&](PipelineFrame &f) {
+        auto &frame = f.get<BeautyFrame>();
+        if (!models.hasLandmarks || !decoded(frame))
+          return;
+        std::cout << "      [关键点检测] 提取人脸关键点..." << std::endl;
+        extractLandmarks(frame, models);
+
+        // Debug visualization
+        cv::Mat landmarkDebugImg = frame.source.getMat().clone();
+        for (const auto &points : frame.landmarks) {
+          for (const auto &p : points) {
+            cv::circle(landmarkDebugImg, cv::Point((int)p.x, (int)p.y), 2,
+                       cv::Scalar(0, 0, 255), -1); // RGB -> BGR(Red)
+          }
         }
-      }
-    }
-    cv::imwrite("../../test_landmarks_debug.jpg", landmarkDebugImg);
-    std::cout << "      [调试] 可视化已保存至 test_landmarks_debug.jpg"
-              << std::endl;
-  }
-
-  // Skin Mask
-  ImageBuffer skinMask(width, height, 1);
-  skinMask.getMat() = cv::Scalar(0);
-  if (parsingModel.load(modelDir + "face_parsing.onnx")) {
-    auto parsingResult = parsingModel.process(mainImage);
-    if (parsingResult) {
-      const cv::Mat &segMap = parsingResult->getMat();
-      cv::Mat segResized;
-      cv::resize(segMap, segResized, cv::Size(width, height), 0, 0,
-                 cv::INTER_NEAREST);
-      cv::Mat skinMaskBinary =
-          (segResized == 1) | (segResized == 10) | (segResized == 14);
-      skinMaskBinary.convertTo(skinMask.getMat(), CV_8UC1, 255.0);
-      Processing::MaskProcessor::feather(skinMask, 10);
-      std::cout << "      [语义分割] 皮肤蒙版生成完毕。" << std::endl;
-    }
-  }
+        cv::imwrite("../../test_landmarks_debug.jpg", landmarkDebugImg);
+        std::cout << "      [调试] 可视化已保存至 test_landmarks_debug.jpg"
+                  << std::endl;
+      },
+      {"detect", "decode"});
+
+  pipeline.addStage(
+      "parsing",
+      [&](PipelineFrame &f) {
+        if (buildSkinMask(f.get<BeautyFrame>(), models))
+          std::cout << "      [语义分割] 皮肤蒙版生成完毕。" << std::endl;
+      },
+      {analysisDecode});
 
   // 3. 中性灰磨皮
-  std::cout << "[3/7] 执行色彩调整与中性灰磨皮..." << std::endl;
-  Processing::ColorEngine::adjust(mainImage, skinMask, 0.1f, 1.05f, 1.0f, 0.0f);
-  Processing::ColorEngine::applyNeutralGrayRetouch(mainImage, skinMask, 0.7f);
+  pipeline.addStage(
+      "retouch",
+      [&](PipelineFrame &f) {
+        if (!decoded(f.get<BeautyFrame>()))
+          return;
+        std::cout << "[3/7] 执行色彩调整与中性灰磨皮..." << std::endl;
+        retouch(f.get<BeautyFrame>());
+      },
+      {"parsing", "decode"});
 
   // 4. 自动瘦脸与中性灰立体增强
-  std::cout << "[4/7] 执行关键点驱动特性 (瘦脸 & 立体型)..." << std::endl;
-  Processing::LiquifyEngine liquify(width, height);
-  for (const auto &face : faces) {
-    auto pts = landmarkModel.getLandmarks(mainImage, face);
-    if (!pts.empty()) {
-      // 瘦脸
-      liquify.slimFace(pts, 0.45f);
-      // 立体增强
-      Processing::ColorEngine::applyNeutralGrayStereo(mainImage, pts, 0.7f);
+  pipeline.addStage(
+      "stereo",
+      [&](PipelineFrame &f) {
+        std::cout << "[4/7] 执行关键点驱动特性 (瘦脸 & 立体型)..."
+                  << std::endl;
+        stereo(f.get<BeautyFrame>());
+      },
+      {"retouch", "landmarks"});
+
+  pipeline.addStage(
+      "liquify",
+      [&](PipelineFrame &f) {
+        if (decoded(f.get<BeautyFrame>()))
+          liquify(f.get<BeautyFrame>());
+      },
+      {"stereo"});
+
+  PipelineFrame pipelineFrame;
+  pipelineFrame.data = BeautyFrame();
+  auto &beautyFrame = pipelineFrame.get<BeautyFrame>();
+  decodeStart = std::chrono::steady_clock::now();
+  pipeline.run(pipelineFrame);
+  if (!decoded(beautyFrame)) {
+    std::cerr << "[错误] 无法解码图像: " << imagePath << std::endl;
+    return 1;
+  }
+
+  ImageBuffer &mainImage = beautyFrame.image;
+  ImageBuffer &skinMask = beautyFrame.skinMask;
+
+  // 5. 保存结果：编码在线程池后台执行，与后续的预览和网络调用重叠
+  EncodeOptions encodeOptions;
+  encodeOptions.jpegQuality = 92;
+  std::future<bool> outputSaved =
+      ImageIO::saveAsync("../../test_output.jpg", mainImage, encodeOptions);
+  std::cout << "[5/7] 结果后台保存至 test_output.jpg" << std::endl;
+
+  // 交互预览：复用已有的分析结果，在视口大小的代理图上渲染，
+  // 停止操作后于后台以原图分辨率精修
+  {
+    Processing::BeautyAnalysis analysis{beautyFrame.skinMask,
+                                        beautyFrame.landmarks};
+    // 先于 preview 声明：preview 析构时等待精修任务结束，
+    // 回调不会访问已销毁的 promise
+    std::promise<void> refined;
+    Processing::PreviewRenderer preview(beautyFrame.source, analysis);
+    preview.setViewport(1280, 720);
+    Processing::BeautyParams params;
+    auto t0 = std::chrono::steady_clock::now();
+    ImageBuffer proxy = preview.renderPreview(params);
+    auto t1 = std::chrono::steady_clock::now();
+    std::cout << "      [预览] 代理图 " << proxy.getMat().cols << "x"
+              << proxy.getMat().rows << "，耗时 "
+              << std::chrono::duration<double, std::milli>(t1 - t0).count()
+              << " ms" << std::endl;
+
+    // 精修失败或被取消时回调不会被调用，因此限时等待
+    preview.refine(params, [&](const ImageBuffer &) { refined.set_value(); });
+    if (refined.get_future().wait_for(std::chrono::seconds(30)) ==
+        std::future_status::ready) {
+      auto t2 = std::chrono::steady_clock::now();
+      std::cout << "      [预览] 全分辨率精修耗时 "
+                << std::chrono::duration<double, std::milli>(t2 - t1).count()
+                << " ms" << std::endl;
+    } else {
+      preview.cancel();
+      std::cout << "      [预览] 全分辨率精修未完成，已取消" << std::endl;
     }
   }
-  liquify.process(mainImage, mainImage);
 
-  // 5. 保存结果
-  cv::imwrite("../../test_output.jpg", mainImage.getMat());
-  std::cout << "[5/7] 结果已保存至 test_output.jpg" << std::endl;
+  // 增量重渲染：只修改磨皮强度时，分析结果与调色均取自缓存
+  {
+    Processing::BeautyParams params;
+    RenderGraph graph;
+    buildBeautyGraph(graph, models, params);
+    graph.setInput("source", beautyFrame.source, 1);
+    graph.evaluate<ImageBuffer>("liquify");
+
+    params.retouchStrength = 0.5f;
+    setBeautyParams(graph, params);
+    auto t0 = std::chrono::steady_clock::now();
+    graph.evaluate<ImageBuffer>("liquify");
+    auto t1 = std::chrono::steady_clock::now();
+    std::cout << "      [增量渲染] 调整磨皮强度后重渲染耗时 "
+              << std::chrono::duration<double, std::milli>(t1 - t0).count()
+              << " ms, 人脸检测 " << graph.runs("faces") << " 次, 语义分割 "
+              << graph.runs("skinMask") << " 次, 磨皮 "
+              << graph.runs("retouch") << " 次" << std::endl;
+  }
 
   // 6. 网络调用测试
   std::cout << "[6/7] 调用外部 API (模拟)..." << std::endl;
-  Network::GenAPIClient genClient("https://api.example.com/generate", "key");
-  genClient.generate(
-      mainImage, skinMask, "Vogue style", [](bool s, const ImageBuffer &r) {
-        std::cout << "      [API 回调] " << (s ? "成功" : "失败 (模拟环境)")
-                  << std::endl;
-      });
+  // 只上传蒙版外接框内的区域，返回结果按羽化蒙版贴回原图
+  Network::GenAPIConfig genConfig;
+  genConfig.cropToMask = true;
+  // 相同的图像/蒙版/提示词直接命中本地磁盘缓存, 不再请求服务
+  genConfig.cacheDir =
+      (std::filesystem::temp_directory_path() / "person_beauty_gen_cache")
+          .string();
+  Network::GenAPIClient genClient(apiEndpoint, "key", genConfig);
+  Network::GenHandle genJob = genClient.submit(
+      mainImage, skinMask, "Vogue style", std::chrono::seconds(10));
+  const Network::GenResult genResult = genJob.result().get();
+  std::cout << "      [API 结果] "
+            << (genResult.status == Network::GenStatus::Ok
+                    ? "成功"
+                    : "失败 (模拟环境)")
+            << ", 尝试 " << genResult.attempts << " 次, 上传区域 "
+            << genResult.region.width << "x" << genResult.region.height
+            << ", 请求体 " << genResult.uploadBytes / 1024 << " KB"
+            << std::endl;
+  const Network::ResultCacheStats cacheStats = genClient.cacheStats();
+  std::cout << "      [结果缓存] 命中 " << cacheStats.hits << " 次, 未命中 "
+            << cacheStats.misses << " 次, 已缓存 " << cacheStats.entries
+            << " 项" << std::endl;
 
-  std::this_thread::sleep_for(std::chrono::seconds(1));
+  if (!outputSaved.get())
+    std::cerr << "[错误] 结果保存失败" << std::endl;
   std::cout << "=== 集成测试完成 ===" << std::endl;
   return 0;
 }
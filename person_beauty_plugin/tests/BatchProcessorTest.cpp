@@ -0,0 +1,73 @@
+#include "Check.h"
+#include "Core/BatchProcessor.h"
+#include <filesystem>
+#include <fstream>
+#include <unistd.h>
+
+using namespace PersonBeauty;
+namespace fs = std::filesystem;
+
+namespace {
+
+struct TempDir {
+  fs::path path;
+
+  explicit TempDir(const std::string &name)
+      : path(fs::temp_directory_path() /
+             ("pb_batch_" + std::to_string(::getpid()) + "_" + name)) {
+    fs::remove_all(path);
+    fs::create_directories(path);
+  }
+  ~TempDir() {
+    std::error_code ec;
+    fs::remove_all(path, ec);
+  }
+};
+
+std::vector<BatchJob> fromList(const TempDir &dir,
+                               const std::vector<fs::path> &inputs) {
+  const fs::path list = dir.path / "list.txt";
+  {
+    std::ofstream out(list);
+    out << "# comment\n";
+    for (const auto &input : inputs)
+      out << input.string() << "\n";
+  }
+  return BatchProcessor::jobsFromList(list.string(),
+                                      (dir.path / "out").string());
+}
+
+// Equal file names from different directories get different outputs
+void testNamesCollide() {
+  TempDir dir("collide");
+  const fs::path in = dir.path / "in";
+  auto jobs = fromList(dir, {in / "a" / "x.jpg", in / "b" / "x.jpg",
+                             in / "b" / "deep" / "x.jpg", in / "a" / "x.jpg"});
+  if (!PB_CHECK(jobs.size() == 3))
+    return;
+  const fs::path out = dir.path / "out";
+  PB_CHECK(fs::path(jobs[0].outputPath) == out / "a" / "x.jpg");
+  PB_CHECK(fs::path(jobs[1].outputPath) == out / "b" / "x.jpg");
+  PB_CHECK(fs::path(jobs[2].outputPath) == out / "b" / "deep" / "x.jpg");
+  PB_CHECK(fs::is_directory(out / "b" / "deep"));
+}
+
+// Inputs from one directory are written straight into the output directory
+void testOneDirectory() {
+  TempDir dir("flat");
+  const fs::path in = dir.path / "in";
+  auto jobs = fromList(dir, {in / "x.jpg", in / "y.png"});
+  if (!PB_CHECK(jobs.size() == 2))
+    return;
+  PB_CHECK(jobs[0].inputPath == (in / "x.jpg").string());
+  PB_CHECK(fs::path(jobs[0].outputPath) == dir.path / "out" / "x.jpg");
+  PB_CHECK(fs::path(jobs[1].outputPath) == dir.path / "out" / "y.png");
+}
+
+} // namespace
+
+int main() {
+  testNamesCollide();
+  testOneDirectory();
+  return Test::report("BatchProcessorTest");
+}
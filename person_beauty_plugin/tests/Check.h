@@ -0,0 +1,39 @@
+#pragma once
+#include <iostream>
+
+// Minimal assertions for the behaviour tests: a failed check is reported
+// and counted, the test keeps going, and main() returns report() so that
+// ctest sees the failure.
+namespace PersonBeauty {
+namespace Test {
+
+inline int &failures() {
+  static int count = 0;
+  return count;
+}
+
+inline bool check(bool ok, const char *expr, const char *file, int line) {
+  if (!ok) {
+    ++failures();
+    std::cerr << "[FAIL] " << file << ":" << line << ": " << expr
+              << std::endl;
+  }
+  return ok;
+}
+
+inline int report(const char *name) {
+  if (failures() == 0) {
+    std::cout << "[PASS] " << name << std::endl;
+    return 0;
+  }
+  std::cout << "[FAIL] " << name << ": " << failures() << " check(s) failed"
+            << std::endl;
+  return 1;
+}
+
+} // namespace Test
+} // namespace PersonBeauty
+
+#define PB_CHECK(expr)                                                         \
+  ::PersonBeauty::Test::check(static_cast<bool>(expr), #expr, __FILE__,        \
+                              __LINE__)
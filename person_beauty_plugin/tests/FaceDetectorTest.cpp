@@ -0,0 +1,135 @@
+#include "AI/FaceDetector.h"
+#include "Check.h"
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace PersonBeauty;
+using namespace PersonBeauty::AI;
+
+namespace {
+
+float iou(const FaceBox &a, const FaceBox &b) {
+  const float w = std::max(0.0f, std::min(a.x2, b.x2) - std::max(a.x1, b.x1));
+  const float h = std::max(0.0f, std::min(a.y2, b.y2) - std::max(a.y1, b.y1));
+  const float inter = w * h;
+  const float area1 = (a.x2 - a.x1) * (a.y2 - a.y1);
+  const float area2 = (b.x2 - b.x1) * (b.y2 - b.y1);
+  return inter / (area1 + area2 - inter);
+}
+
+// The plain O(n^2) greedy pass the grid version must reproduce
+std::vector<FaceBox> referenceNms(std::vector<FaceBox> input,
+                                  float iouThreshold, size_t topK) {
+  std::sort(input.begin(), input.end(),
+            [](const FaceBox &a, const FaceBox &b) {
+              return a.score > b.score;
+            });
+  if (topK > 0 && input.size() > topK)
+    input.resize(topK);
+  std::vector<FaceBox> kept;
+  for (const FaceBox &box : input) {
+    bool suppressed = false;
+    for (const FaceBox &k : kept)
+      suppressed = suppressed || iou(k, box) > iouThreshold;
+    if (!suppressed)
+      kept.push_back(box);
+  }
+  return kept;
+}
+
+bool sameBoxes(const std::vector<FaceBox> &a, const std::vector<FaceBox> &b) {
+  return a.size() == b.size() &&
+         std::equal(a.begin(), a.end(), b.begin(),
+                    [](const FaceBox &p, const FaceBox &q) {
+                      return p.x1 == q.x1 && p.y1 == q.y1 && p.x2 == q.x2 &&
+                             p.y2 == q.y2 && p.score == q.score;
+                    });
+}
+
+// Detector-like candidates: jittered copies around `faces` centers of
+// mixed sizes, plus scattered noise boxes. Scores are distinct, so the
+// order after sorting is unique.
+std::vector<FaceBox> candidates(std::mt19937 &rng, int faces, int copies,
+                                float extent) {
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  std::vector<FaceBox> boxes;
+  auto add = [&](float cx, float cy, float side) {
+    FaceBox box;
+    box.x1 = cx - side / 2;
+    box.y1 = cy - side / 2;
+    box.x2 = cx + side / 2;
+    box.y2 = cy + side / 2;
+    box.score = 0.0f;
+    boxes.push_back(box);
+  };
+  for (int f = 0; f < faces; ++f) {
+    const float cx = unit(rng) * extent, cy = unit(rng) * extent;
+    const float side = 8.0f + unit(rng) * extent * 0.2f;
+    for (int c = 0; c < copies; ++c)
+      add(cx + (unit(rng) - 0.5f) * side * 0.3f,
+          cy + (unit(rng) - 0.5f) * side * 0.3f,
+          side * (0.8f + 0.4f * unit(rng)));
+  }
+  for (int i = 0; i < faces; ++i)
+    add(unit(rng) * extent, unit(rng) * extent, 2.0f + unit(rng) * 40.0f);
+  std::vector<int> order(boxes.size());
+  for (size_t i = 0; i < order.size(); ++i)
+    order[i] = static_cast<int>(i);
+  std::shuffle(order.begin(), order.end(), rng);
+  for (size_t i = 0; i < boxes.size(); ++i)
+    boxes[i].score = 0.5f + 0.5f * order[i] / boxes.size();
+  return boxes;
+}
+
+void testMatchesReference() {
+  std::mt19937 rng(5);
+  for (int round = 0; round < 200; ++round) {
+    const int faces = 1 + round % 40;
+    const int copies = 1 + round % 7;
+    // Small scenes use box-sized cells, large ones hit the grid side cap
+    const float extent = round % 3 == 0 ? 100000.0f : 2000.0f;
+    for (float threshold : {0.0f, 0.3f, 0.5f, 0.9f}) {
+      for (size_t topK : {size_t(0), size_t(10), size_t(1000)}) {
+        std::vector<FaceBox> input = candidates(rng, faces, copies, extent);
+        const std::vector<FaceBox> expected =
+            referenceNms(input, threshold, topK);
+        std::vector<FaceBox> result;
+        FaceDetector::nonMaximumSuppression(input, result, threshold, topK);
+        if (!PB_CHECK(sameBoxes(result, expected))) {
+          std::cerr << "  round " << round << " threshold " << threshold
+                    << " topK " << topK << ": " << result.size() << " vs "
+                    << expected.size() << " kept" << std::endl;
+          return;
+        }
+      }
+    }
+  }
+}
+
+void testEdgeCases() {
+  std::vector<FaceBox> none, result;
+  FaceDetector::nonMaximumSuppression(none, result, 0.3f, 0);
+  PB_CHECK(result.empty());
+
+  // Identical boxes: only the best survives
+  std::vector<FaceBox> same(5, FaceBox{10, 10, 50, 50, 0.0f});
+  for (size_t i = 0; i < same.size(); ++i)
+    same[i].score = 0.1f * (i + 1);
+  FaceDetector::nonMaximumSuppression(same, result, 0.3f, 0);
+  PB_CHECK(result.size() == 1 && result[0].score == 0.5f);
+
+  // Touching but disjoint boxes both stay, whatever the threshold
+  std::vector<FaceBox> apart = {{0, 0, 10, 10, 0.9f}, {10, 0, 20, 10, 0.8f}};
+  result.clear();
+  FaceDetector::nonMaximumSuppression(apart, result, 0.0f, 0);
+  PB_CHECK(result.size() == 2);
+}
+
+} // namespace
+
+int main() {
+  testMatchesReference();
+  testEdgeCases();
+  return Test::report("FaceDetectorTest");
+}
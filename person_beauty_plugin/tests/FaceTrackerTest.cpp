@@ -0,0 +1,107 @@
+#include "AI/FaceTracker.h"
+#include "Check.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace PersonBeauty;
+using namespace PersonBeauty::AI;
+
+namespace {
+
+const int kWidth = 160, kHeight = 120;
+const int kFaceSide = 48;
+const cv::Point2f kStart(30, 25), kStep(3, 2); // Pixels per frame
+
+// A textured square on a flat background stands in for the face; its
+// "landmarks" are fixed points inside it
+struct Scene {
+  cv::Mat face;
+
+  Scene() : face(kFaceSide, kFaceSide, CV_8UC1) {
+    cv::setRNGSeed(3);
+    cv::randu(face, cv::Scalar::all(0), cv::Scalar::all(255));
+    cv::GaussianBlur(face, face, cv::Size(5, 5), 1.5);
+  }
+
+  static cv::Point2f origin(int frame) { return kStart + kStep * frame; }
+
+  static FaceBox box(int frame) {
+    const cv::Point2f o = origin(frame);
+    return {o.x, o.y, o.x + kFaceSide, o.y + kFaceSide, 0.9f};
+  }
+
+  static std::vector<cv::Point2f> landmarks(int frame) {
+    const cv::Point2f o = origin(frame);
+    return {o + cv::Point2f(14, 16), o + cv::Point2f(34, 16),
+            o + cv::Point2f(24, 26), o + cv::Point2f(17, 34),
+            o + cv::Point2f(31, 34)};
+  }
+
+  // Draws the frame into the host's buffer, reused across frames
+  void draw(int frame, cv::Mat &pixels) const {
+    pixels = cv::Scalar(128);
+    const cv::Point2f o = origin(frame);
+    face.copyTo(pixels(cv::Rect(static_cast<int>(o.x), static_cast<int>(o.y),
+                                kFaceSide, kFaceSide)));
+  }
+};
+
+float overlap(const FaceBox &a, const FaceBox &b) {
+  const float w = std::max(0.0f, std::min(a.x2, b.x2) - std::max(a.x1, b.x1));
+  const float h = std::max(0.0f, std::min(a.y2, b.y2) - std::max(a.y1, b.y1));
+  return w * h / ((a.x2 - a.x1) * (a.y2 - a.y1));
+}
+
+// Between detections the box follows the face by optical flow, also when
+// the host hands over its Gray8 frame in the same buffer every time
+void testFollowsMovingFace() {
+  const Scene scene;
+  int frame = 0, detections = 0;
+  std::vector<FaceBox> predicted;
+  FaceTracker tracker(
+      [&](const ImageBuffer &) {
+        ++detections;
+        return std::vector<FaceBox>{Scene::box(frame)};
+      },
+      [&](const ImageBuffer &, const FaceBox &box) {
+        predicted.push_back(box);
+        // The landmark model only finds a face under the box
+        if (overlap(box, Scene::box(frame)) < 0.5f)
+          return std::vector<cv::Point2f>();
+        return Scene::landmarks(frame);
+      });
+  tracker.setDetectionInterval(100);
+
+  ImageBuffer host(kWidth, kHeight, 1);
+  const int frames = 15;
+  for (frame = 0; frame < frames; ++frame) {
+    scene.draw(frame, host.getMat());
+    predicted.clear();
+    const std::vector<TrackedFace> faces = tracker.track(host);
+    if (!PB_CHECK(faces.size() == 1 && predicted.size() == 1))
+      return;
+    PB_CHECK(faces[0].id == 1);
+    PB_CHECK(tracker.lastFrameDetected() == (frame == 0));
+    if (frame == 0)
+      continue;
+
+    // The box handed to the landmark model sits on this frame's face, not
+    // on the last one: a stale previous frame would predict no motion
+    const FaceBox &box = predicted[0];
+    const FaceBox truth = Scene::box(frame);
+    const float dx = (box.x1 + box.x2 - truth.x1 - truth.x2) / 2;
+    const float dy = (box.y1 + box.y2 - truth.y1 - truth.y2) / 2;
+    if (!PB_CHECK(std::abs(dx) < 1.0f && std::abs(dy) < 1.0f))
+      std::cerr << "  frame " << frame << ": off by (" << dx << ", " << dy
+                << ")" << std::endl;
+  }
+  PB_CHECK(detections == 1);
+}
+
+} // namespace
+
+int main() {
+  testFollowsMovingFace();
+  return Test::report("FaceTrackerTest");
+}
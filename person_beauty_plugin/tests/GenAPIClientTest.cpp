@@ -0,0 +1,312 @@
+#include "Check.h"
+#include "Network/GenAPIClient.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <netinet/in.h>
+#include <opencv2/opencv.hpp>
+#include <poll.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace PersonBeauty;
+using namespace PersonBeauty::Network;
+using namespace std::chrono;
+
+namespace {
+
+// Scripted HTTP/1.1 endpoint on 127.0.0.1. Each request gets the next
+// reply of the script (the last one repeats), on its own connection.
+class StubServer {
+public:
+  struct Reply {
+    int status;
+    std::string contentType;
+    std::string body;
+    int delayMs = 0; // Before answering
+  };
+
+  explicit StubServer(std::vector<Reply> script)
+      : script_(std::move(script)) {
+    listen_ = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t size = sizeof(addr);
+    ::bind(listen_, reinterpret_cast<sockaddr *>(&addr), size);
+    ::listen(listen_, 16);
+    ::getsockname(listen_, reinterpret_cast<sockaddr *>(&addr), &size);
+    port_ = ntohs(addr.sin_port);
+    thread_ = std::thread([this]() { serve(); });
+  }
+
+  ~StubServer() {
+    stop_ = true;
+    thread_.join();
+    ::close(listen_);
+  }
+
+  std::string url() const {
+    return "http://127.0.0.1:" + std::to_string(port_) + "/generate";
+  }
+  int requests() const { return requests_; }
+
+private:
+  void serve() {
+    while (!stop_) {
+      pollfd p{listen_, POLLIN, 0};
+      if (::poll(&p, 1, 20) <= 0)
+        continue;
+      const int fd = ::accept(listen_, nullptr, nullptr);
+      if (fd < 0)
+        continue;
+      handle(fd);
+      ::close(fd);
+    }
+  }
+
+  void handle(int fd) {
+    // Headers, then Content-Length bytes of body
+    std::string request;
+    size_t headerEnd = std::string::npos;
+    size_t length = 0;
+    char buffer[16384];
+    for (;;) {
+      if (headerEnd != std::string::npos &&
+          request.size() >= headerEnd + 4 + length)
+        break;
+      pollfd p{fd, POLLIN, 0};
+      if (stop_ || ::poll(&p, 1, 20) < 0)
+        return;
+      if (!(p.revents & (POLLIN | POLLHUP)))
+        continue;
+      const ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+      if (n <= 0)
+        return;
+      request.append(buffer, static_cast<size_t>(n));
+      if (headerEnd == std::string::npos) {
+        headerEnd = request.find("\r\n\r\n");
+        if (headerEnd == std::string::npos)
+          continue;
+        std::string headers = request.substr(0, headerEnd);
+        for (char &c : headers)
+          c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        const size_t at = headers.find("content-length:");
+        if (at != std::string::npos)
+          length = std::stoul(headers.substr(at + 15));
+        if (headers.find("100-continue") != std::string::npos)
+          sendAll(fd, "HTTP/1.1 100 Continue\r\n\r\n");
+      }
+    }
+
+    const int index = requests_++;
+    const Reply &reply =
+        script_[std::min<size_t>(index, script_.size() - 1)];
+    const auto until = steady_clock::now() + milliseconds(reply.delayMs);
+    while (steady_clock::now() < until && !stop_)
+      std::this_thread::sleep_for(milliseconds(5));
+    sendAll(fd, "HTTP/1.1 " + std::to_string(reply.status) +
+                    " Stub\r\nContent-Type: " + reply.contentType +
+                    "\r\nContent-Length: " +
+                    std::to_string(reply.body.size()) +
+                    "\r\nConnection: close\r\n\r\n" + reply.body);
+  }
+
+  static void sendAll(int fd, const std::string &data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+      // The client may have hung up (cancel, timeout): no SIGPIPE
+      const ssize_t n = ::send(fd, data.data() + sent, data.size() - sent,
+                               MSG_NOSIGNAL);
+      if (n <= 0)
+        return;
+      sent += static_cast<size_t>(n);
+    }
+  }
+
+  std::vector<Reply> script_;
+  int listen_ = -1;
+  int port_ = 0;
+  std::atomic<bool> stop_{false};
+  std::atomic<int> requests_{0};
+  std::thread thread_;
+};
+
+const cv::Size kSize(32, 24);
+
+ImageBuffer testImage() {
+  ImageBuffer image(kSize.width, kSize.height, 3);
+  cv::randu(image.getMat(), cv::Scalar::all(0), cv::Scalar::all(255));
+  return image;
+}
+
+ImageBuffer fullMask() {
+  ImageBuffer mask(kSize.width, kSize.height, 1);
+  mask.getMat() = cv::Scalar(255);
+  return mask;
+}
+
+StubServer::Reply imageReply(int delayMs = 0) {
+  std::vector<uint8_t> png;
+  cv::imencode(".png", cv::Mat(kSize, CV_8UC3, cv::Scalar(10, 200, 30)),
+               png);
+  return {200, "image/png", std::string(png.begin(), png.end()), delayMs};
+}
+
+GenAPIConfig fastRetries() {
+  GenAPIConfig config;
+  config.maxAttempts = 3;
+  config.retryBase = milliseconds(5);
+  config.retryMax = milliseconds(20);
+  config.deadline = milliseconds(10000);
+  return config;
+}
+
+// Waits for the job, failing the check instead of hanging the test
+bool finished(const GenHandle &handle) {
+  return PB_CHECK(handle.result().wait_for(seconds(10)) ==
+                  std::future_status::ready);
+}
+
+void testRetriesUntilOk() {
+  StubServer server({{503, "text/plain", "busy"},
+                     {429, "text/plain", "slow down"},
+                     imageReply()});
+  GenAPIClient client(server.url(), "key", fastRetries());
+  GenHandle handle = client.submit(testImage(), fullMask(), "retouch");
+  if (!finished(handle))
+    return;
+  const GenResult &result = handle.result().get();
+  PB_CHECK(result.status == GenStatus::Ok);
+  PB_CHECK(result.attempts == 3);
+  PB_CHECK(result.httpStatus == 200);
+  PB_CHECK(server.requests() == 3);
+  PB_CHECK(result.image.getMat().size() == kSize);
+  const cv::Vec3b pixel = result.image.getMat().at<cv::Vec3b>(0, 0);
+  PB_CHECK(pixel == cv::Vec3b(10, 200, 30));
+}
+
+void testGivesUpAfterMaxAttempts() {
+  StubServer server({{500, "text/plain", "down"}});
+  GenAPIConfig config = fastRetries();
+  config.maxAttempts = 2;
+  GenAPIClient client(server.url(), "key", config);
+  GenHandle handle = client.submit(testImage(), fullMask(), "retouch");
+  if (!finished(handle))
+    return;
+  const GenResult &result = handle.result().get();
+  PB_CHECK(result.status == GenStatus::Failed);
+  PB_CHECK(result.attempts == 2);
+  PB_CHECK(result.httpStatus == 500);
+  PB_CHECK(server.requests() == 2);
+}
+
+void testClientErrorIsNotRetried() {
+  StubServer server({{400, "application/json", "{\"error\": \"prompt\"}"},
+                     imageReply()});
+  GenAPIClient client(server.url(), "key", fastRetries());
+  GenHandle handle = client.submit(testImage(), fullMask(), "retouch");
+  if (!finished(handle))
+    return;
+  const GenResult &result = handle.result().get();
+  PB_CHECK(result.status == GenStatus::Failed);
+  PB_CHECK(result.attempts == 1);
+  PB_CHECK(result.error.find("400") != std::string::npos);
+  PB_CHECK(server.requests() == 1);
+}
+
+void testOkWithoutImageFails() {
+  StubServer server({{200, "application/json", "{\"status\": \"queued\"}"}});
+  GenAPIClient client(server.url(), "key", fastRetries());
+  GenHandle handle = client.submit(testImage(), fullMask(), "retouch");
+  if (!finished(handle))
+    return;
+  const GenResult &result = handle.result().get();
+  PB_CHECK(result.status == GenStatus::Failed);
+  PB_CHECK(result.error == "response carried no image");
+}
+
+void testDeadline() {
+  StubServer server({imageReply(3000)});
+  GenAPIClient client(server.url(), "key", fastRetries());
+  const auto start = steady_clock::now();
+  GenHandle handle = client.submit(testImage(), fullMask(), "retouch",
+                                   milliseconds(300));
+  if (!finished(handle))
+    return;
+  const GenResult &result = handle.result().get();
+  PB_CHECK(result.status == GenStatus::TimedOut);
+  PB_CHECK(steady_clock::now() - start < milliseconds(2000));
+}
+
+void testCancel() {
+  StubServer server({imageReply(3000)});
+  GenAPIClient client(server.url(), "key", fastRetries());
+  const auto start = steady_clock::now();
+  GenHandle handle = client.submit(testImage(), fullMask(), "retouch");
+  // Let the transfer start, then abort it mid-flight
+  while (server.requests() == 0 && steady_clock::now() - start < seconds(5))
+    std::this_thread::sleep_for(milliseconds(5));
+  handle.cancel();
+  if (!finished(handle))
+    return;
+  PB_CHECK(handle.result().get().status == GenStatus::Cancelled);
+  PB_CHECK(steady_clock::now() - start < milliseconds(2000));
+  PB_CHECK(client.pending() == 0);
+}
+
+void testCacheHitSkipsTheService() {
+  namespace fs = std::filesystem;
+  const fs::path dir =
+      fs::temp_directory_path() /
+      ("pb_cache_test_" + std::to_string(::getpid()));
+  {
+    StubServer server({imageReply()});
+    GenAPIConfig config = fastRetries();
+    config.cacheDir = dir.string();
+    GenAPIClient client(server.url(), "key", config);
+    const ImageBuffer image = testImage();
+    const ImageBuffer mask = fullMask();
+    GenHandle first = client.submit(image, mask, "retouch");
+    if (!finished(first))
+      return;
+    PB_CHECK(!first.result().get().cached);
+    // The entry is written after the result is out
+    for (int i = 0; i < 200 && client.cacheStats().stores == 0; ++i)
+      std::this_thread::sleep_for(milliseconds(5));
+
+    GenHandle second = client.submit(image, mask, "retouch");
+    if (!finished(second))
+      return;
+    const GenResult &result = second.result().get();
+    PB_CHECK(result.status == GenStatus::Ok);
+    PB_CHECK(result.cached);
+    PB_CHECK(result.uploadBytes == 0);
+    PB_CHECK(server.requests() == 1);
+
+    // Another prompt is another key
+    GenHandle third = client.submit(image, mask, "relight");
+    if (finished(third))
+      PB_CHECK(!third.result().get().cached);
+    PB_CHECK(server.requests() == 2);
+  }
+  std::error_code ec;
+  fs::remove_all(dir, ec);
+}
+
+} // namespace
+
+int main() {
+  testRetriesUntilOk();
+  testGivesUpAfterMaxAttempts();
+  testClientErrorIsNotRetried();
+  testOkWithoutImageFails();
+  testDeadline();
+  testCancel();
+  testCacheHitSkipsTheService();
+  return Test::report("GenAPIClientTest");
+}
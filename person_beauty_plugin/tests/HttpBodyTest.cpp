@@ -0,0 +1,109 @@
+#include "Check.h"
+#include "Network/HttpBody.h"
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace PersonBeauty;
+using namespace PersonBeauty::Network;
+
+namespace {
+
+// Plain RFC 4648 encoder the chunked one is compared against
+std::string referenceBase64(const std::vector<uint8_t> &bytes) {
+  static const char alphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  for (size_t i = 0; i < bytes.size(); i += 3) {
+    uint32_t group = bytes[i] << 16;
+    if (i + 1 < bytes.size())
+      group |= bytes[i + 1] << 8;
+    if (i + 2 < bytes.size())
+      group |= bytes[i + 2];
+    out += alphabet[(group >> 18) & 63];
+    out += alphabet[(group >> 12) & 63];
+    out += i + 1 < bytes.size() ? alphabet[(group >> 6) & 63] : '=';
+    out += i + 2 < bytes.size() ? alphabet[group & 63] : '=';
+  }
+  return out;
+}
+
+SegmentedBody::Bytes randomBytes(size_t size, std::mt19937 &rng) {
+  auto bytes = std::make_shared<std::vector<uint8_t>>(size);
+  for (uint8_t &b : *bytes)
+    b = static_cast<uint8_t>(rng());
+  return bytes;
+}
+
+std::string readAll(const HttpBody &body, size_t chunk) {
+  std::string out;
+  std::vector<char> buffer(chunk);
+  for (;;) {
+    const size_t n = body.read(out.size(), buffer.data(), chunk);
+    if (n == 0)
+      break;
+    out.append(buffer.data(), n);
+  }
+  return out;
+}
+
+void testKnownVectors() {
+  const std::pair<const char *, const char *> vectors[] = {
+      {"", ""},         {"f", "Zg=="},         {"fo", "Zm8="},
+      {"foo", "Zm9v"},  {"foob", "Zm9vYg=="},  {"fooba", "Zm9vYmE="},
+      {"foobar", "Zm9vYmFy"}};
+  for (const auto &v : vectors) {
+    const std::string text = v.first;
+    SegmentedBody body;
+    body.addBytes(std::make_shared<std::vector<uint8_t>>(text.begin(),
+                                                         text.end()),
+                  true);
+    PB_CHECK(body.size() == std::string(v.second).size());
+    PB_CHECK(readAll(body, 64) == v.second);
+  }
+}
+
+// The JSON upload layout: text around base64 and raw segments. Every chunk
+// size curl might ask for, so groups are cut at every position.
+void testChunkedReads() {
+  std::mt19937 rng(42);
+  for (size_t size : {0, 1, 2, 3, 4, 5, 7, 8, 31, 32, 33, 100, 1001, 4099}) {
+    auto image = randomBytes(size, rng);
+    auto raw = randomBytes(size / 2 + 1, rng);
+    SegmentedBody body;
+    body.addText("{\"prompt\": \"x\", \"image\": \"");
+    body.addBytes(image, true);
+    body.addText("\", \"raw\": \"");
+    body.addBytes(raw);
+    body.addBytes(image, true);
+    body.addText("\"}");
+    const std::string expected =
+        "{\"prompt\": \"x\", \"image\": \"" + referenceBase64(*image) +
+        "\", \"raw\": \"" + std::string(raw->begin(), raw->end()) +
+        referenceBase64(*image) + "\"}";
+    PB_CHECK(body.size() == expected.size());
+    for (size_t chunk = 1; chunk <= 67; ++chunk)
+      PB_CHECK(readAll(body, chunk) == expected);
+    PB_CHECK(readAll(body, 16384) == expected);
+
+    // Random access, as a resend after a redirect or rewind does
+    for (int i = 0; i < 200; ++i) {
+      const size_t offset = rng() % (expected.size() + 1);
+      const size_t max = rng() % 50 + 1;
+      std::vector<char> buffer(max);
+      const size_t n = body.read(offset, buffer.data(), max);
+      PB_CHECK(n == std::min(max, expected.size() - offset));
+      PB_CHECK(std::string(buffer.data(), n) == expected.substr(offset, n));
+    }
+    char past;
+    PB_CHECK(body.read(expected.size(), &past, 1) == 0);
+  }
+}
+
+} // namespace
+
+int main() {
+  testKnownVectors();
+  testChunkedReads();
+  return Test::report("HttpBodyTest");
+}
@@ -0,0 +1,54 @@
+#include "Check.h"
+#include "Core/ImageIO.h"
+#include <filesystem>
+#include <unistd.h>
+
+using namespace PersonBeauty;
+
+namespace {
+
+std::string tempPath(const std::string &name) {
+  return (std::filesystem::temp_directory_path() /
+          ("pb_imageio_" + std::to_string(::getpid()) + "_" + name))
+      .string();
+}
+
+// RGB(A) images are converted for the encoder without touching the
+// caller's pixels, and come back with red and blue where they were
+void testSaveKeepsSource(PixelFormat format, const std::string &ext) {
+  const int cn = channelCount(format);
+  ImageBuffer image(16, 8, format);
+  cv::Mat &pixels = image.getMat();
+  for (int y = 0; y < pixels.rows; ++y) {
+    uint8_t *row = pixels.ptr<uint8_t>(y);
+    for (int x = 0; x < pixels.cols; ++x) {
+      row[x * cn + 0] = 200; // R
+      row[x * cn + 1] = static_cast<uint8_t>(x * 10);
+      row[x * cn + 2] = 20; // B
+      if (cn == 4)
+        row[x * cn + 3] = 255;
+    }
+  }
+  const cv::Mat before = pixels.clone();
+
+  const std::string path = tempPath("rgb" + ext);
+  PB_CHECK(ImageIO::saveAsync(path, image).get());
+  PB_CHECK(image.format() == format);
+  PB_CHECK(cv::norm(pixels, before, cv::NORM_INF) == 0);
+
+  // Decodes are BGR: blue first
+  ImageBuffer loaded = ImageIO::read(path);
+  if (PB_CHECK(loaded.getMat().size() == pixels.size())) {
+    const cv::Vec3b bgr = loaded.getMat().at<cv::Vec3b>(0, 5);
+    PB_CHECK(bgr == cv::Vec3b(20, 50, 200));
+  }
+  std::filesystem::remove(path);
+}
+
+} // namespace
+
+int main() {
+  testSaveKeepsSource(PixelFormat::RGB8, ".png");
+  testSaveKeepsSource(PixelFormat::RGBA8, ".png");
+  return Test::report("ImageIOTest");
+}
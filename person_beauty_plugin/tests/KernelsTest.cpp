@@ -0,0 +1,169 @@
+#include "Check.h"
+#include "Core/CpuFeatures.h"
+#include "Core/KernelTable.h"
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace PersonBeauty;
+using namespace PersonBeauty::Kernels;
+
+namespace {
+
+struct Build {
+  const char *name;
+  const KernelTable *table;
+};
+
+// Every ISA build this machine can run, not only the one dispatched to
+std::vector<Build> builds() {
+  std::vector<Build> result = {{"baseline", &baselineKernels()}};
+#ifdef PERSON_BEAUTY_KERNELS_X86
+  if (CpuFeatures::detected() >= CpuLevel::AVX2)
+    result.push_back({"avx2", &avx2Kernels()});
+  if (CpuFeatures::detected() >= CpuLevel::AVX512)
+    result.push_back({"avx512", &avx512Kernels()});
+#endif
+  return result;
+}
+
+std::vector<uint32_t> referenceSelect(const std::vector<float> &src,
+                                      size_t n, size_t stride,
+                                      float threshold) {
+  std::vector<uint32_t> indices;
+  for (size_t i = 0; i < n; ++i)
+    if (src[i * stride] > threshold)
+      indices.push_back(static_cast<uint32_t>(i));
+  return indices;
+}
+
+void testSelectAbove(const Build &build) {
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> score(0.0f, 1.0f);
+  // Odd lengths leave a scalar tail after every vector width; stride 2 is
+  // the detector's interleaved (background, face) layout
+  for (size_t stride : {1, 2, 3}) {
+    for (size_t n : {0, 1, 7, 8, 9, 15, 16, 17, 63, 64, 65, 1000, 4420}) {
+      for (float threshold : {-1.0f, 0.5f, 0.7f, 0.99f, 2.0f}) {
+        std::vector<float> src(n * stride + 1);
+        for (float &v : src)
+          v = score(rng);
+        // Exact ties are not above the threshold
+        if (n > 3)
+          src[3 * stride] = threshold;
+        const std::vector<uint32_t> expected =
+            referenceSelect(src, n, stride, threshold);
+        std::vector<uint32_t> indices(n + 1, 0xffffffffu);
+        const size_t count = build.table->selectAbove(src.data(), n, stride,
+                                                      threshold,
+                                                      indices.data());
+        if (!PB_CHECK(count == expected.size())) {
+          std::cerr << "  " << build.name << " stride " << stride << " n "
+                    << n << " threshold " << threshold << std::endl;
+          continue;
+        }
+        PB_CHECK(std::equal(expected.begin(), expected.end(),
+                            indices.begin()));
+        PB_CHECK(indices[n] == 0xffffffffu); // Nothing past n entries
+      }
+    }
+  }
+}
+
+void testDecodeBoxes(const Build &build) {
+  std::mt19937 rng(11);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  std::uniform_real_distribution<float> delta(-4.0f, 4.0f);
+  const size_t n = 997;
+  std::vector<float> deltas(n * 4);
+  for (float &d : deltas)
+    d = delta(rng);
+  std::vector<float> planes[4];
+  for (auto &plane : planes)
+    plane.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    planes[0][i] = unit(rng);
+    planes[1][i] = unit(rng);
+    planes[2][i] = 0.01f + 0.5f * unit(rng);
+    planes[3][i] = 0.01f + 0.5f * unit(rng);
+  }
+  const float *anchors[4] = {planes[0].data(), planes[1].data(),
+                             planes[2].data(), planes[3].data()};
+  const float variance[2] = {0.1f, 0.2f};
+  // Every third anchor, plus the extremes of exp()'s argument
+  std::vector<uint32_t> indices;
+  for (uint32_t i = 0; i < n; i += 3)
+    indices.push_back(i);
+  deltas[0 * 4 + 2] = -60.0f;
+  deltas[3 * 4 + 3] = 60.0f;
+
+  std::vector<float> boxes(indices.size() * 4);
+  build.table->decodeBoxes(deltas.data(), anchors, indices.data(),
+                           indices.size(), variance, boxes.data());
+  for (size_t k = 0; k < indices.size(); ++k) {
+    const uint32_t i = indices[k];
+    const float *d = &deltas[i * 4];
+    const double cx = planes[0][i] + d[0] * variance[0] * planes[2][i];
+    const double cy = planes[1][i] + d[1] * variance[0] * planes[3][i];
+    const double hw = planes[2][i] * std::exp(double(d[2]) * variance[1]) / 2;
+    const double hh = planes[3][i] * std::exp(double(d[3]) * variance[1]) / 2;
+    const double expected[4] = {cx - hw, cy - hh, cx + hw, cy + hh};
+    const double scale[4] = {std::abs(cx) + hw, std::abs(cy) + hh,
+                             std::abs(cx) + hw, std::abs(cy) + hh};
+    for (int c = 0; c < 4; ++c) {
+      // A few float ulps of the operands: exp() itself is within 2 ulp
+      if (!PB_CHECK(std::abs(boxes[k * 4 + c] - expected[c]) <=
+                    1e-6 * scale[c] + 1e-30)) {
+        std::cerr << "  " << build.name << " anchor " << i << " coord " << c
+                  << ": " << boxes[k * 4 + c] << " vs " << expected[c]
+                  << std::endl;
+        return;
+      }
+    }
+  }
+}
+
+// "All variants produce identical results": bit for bit, against baseline
+void testBuildsAgree(const Build &build) {
+  const KernelTable &base = baselineKernels();
+  std::mt19937 rng(3);
+  std::uniform_real_distribution<float> delta(-8.0f, 8.0f);
+  const size_t n = 4420;
+  std::vector<float> scores(n * 2), deltas(n * 4), plane(n, 0.25f);
+  for (float &s : scores)
+    s = delta(rng);
+  for (float &d : deltas)
+    d = delta(rng);
+  std::vector<uint32_t> a(n), b(n);
+  const size_t countA = base.selectAbove(scores.data() + 1, n, 2, 0.0f,
+                                         a.data());
+  const size_t countB = build.table->selectAbove(scores.data() + 1, n, 2,
+                                                 0.0f, b.data());
+  PB_CHECK(countA == countB);
+  PB_CHECK(std::equal(a.begin(), a.begin() + countA, b.begin()));
+
+  const float *anchors[4] = {plane.data(), plane.data(), plane.data(),
+                             plane.data()};
+  const float variance[2] = {0.1f, 0.2f};
+  std::vector<float> boxesA(countA * 4), boxesB(countA * 4);
+  base.decodeBoxes(deltas.data(), anchors, a.data(), countA, variance,
+                   boxesA.data());
+  build.table->decodeBoxes(deltas.data(), anchors, a.data(), countA,
+                           variance, boxesB.data());
+  PB_CHECK(std::memcmp(boxesA.data(), boxesB.data(),
+                       boxesA.size() * sizeof(float)) == 0);
+}
+
+} // namespace
+
+int main() {
+  for (const Build &build : builds()) {
+    std::cout << "Kernels: " << build.name << std::endl;
+    testSelectAbove(build);
+    testDecodeBoxes(build);
+    testBuildsAgree(build);
+  }
+  return Test::report("KernelsTest");
+}
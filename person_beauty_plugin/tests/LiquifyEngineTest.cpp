@@ -0,0 +1,127 @@
+#include "Check.h"
+#include "Processing/LiquifyEngine.h"
+#include <algorithm>
+#include <vector>
+
+using namespace PersonBeauty;
+using namespace PersonBeauty::Processing;
+
+namespace {
+
+const int kWidth = 64, kHeight = 48;
+
+ImageBuffer testImage() {
+  ImageBuffer image(kWidth, kHeight, 3);
+  cv::Mat &pixels = image.getMat();
+  for (int y = 0; y < kHeight; ++y)
+    for (int x = 0; x < kWidth; ++x)
+      pixels.at<cv::Vec3b>(y, x) =
+          cv::Vec3b(static_cast<uint8_t>(x * 4), static_cast<uint8_t>(y * 5),
+                    static_cast<uint8_t>((x * y) & 255));
+  return image;
+}
+
+// The warped frame identifies the mesh: equal meshes give equal bytes
+cv::Mat render(LiquifyEngine &engine, const ImageBuffer &image) {
+  ImageBuffer output;
+  engine.process(image, output);
+  return output.getMat().clone();
+}
+
+bool same(const cv::Mat &a, const cv::Mat &b) {
+  return a.size() == b.size() && a.type() == b.type() &&
+         cv::norm(a, b, cv::NORM_INF) == 0;
+}
+
+// A different stroke each time, alternating the tools
+void stroke(LiquifyEngine &engine, int i) {
+  const float x = 0.2f + 0.6f * ((i * 37) % 100) / 100.0f;
+  const float y = 0.2f + 0.6f * ((i * 61) % 100) / 100.0f;
+  if (i % 2 == 0)
+    engine.push(x, y, x + 0.05f, y - 0.03f, 0.2f, 0.5f);
+  else
+    engine.expand(x, y, 0.15f, i % 4 == 1 ? 0.4f : -0.4f);
+}
+
+// Undo and redo land on the exact mesh of every step, across keyframes
+void testUndoRedo() {
+  const ImageBuffer image = testImage();
+  LiquifyEngine engine(kWidth, kHeight);
+  PB_CHECK(!engine.canUndo() && !engine.canRedo());
+  const int strokes = 40;
+  std::vector<cv::Mat> steps = {render(engine, image)};
+  for (int i = 0; i < strokes; ++i) {
+    stroke(engine, i);
+    steps.push_back(render(engine, image));
+  }
+  PB_CHECK(engine.historySize() == static_cast<size_t>(strokes));
+
+  for (int i = strokes - 1; i >= 0; --i) {
+    PB_CHECK(engine.undo());
+    PB_CHECK(same(render(engine, image), steps[i]));
+  }
+  PB_CHECK(!engine.canUndo() && !engine.undo());
+  for (int i = 1; i <= strokes; ++i) {
+    PB_CHECK(engine.redo());
+    PB_CHECK(same(render(engine, image), steps[i]));
+  }
+  PB_CHECK(!engine.canRedo() && !engine.redo());
+
+  // A new stroke after undoing drops the redo tail
+  for (int i = 0; i < 5; ++i)
+    engine.undo();
+  stroke(engine, 1000);
+  PB_CHECK(!engine.canRedo());
+  PB_CHECK(engine.historySize() == static_cast<size_t>(strokes - 4));
+  PB_CHECK(engine.undo());
+  PB_CHECK(same(render(engine, image), steps[strokes - 5]));
+
+  engine.reset();
+  PB_CHECK(!engine.canUndo() && !engine.canRedo());
+  PB_CHECK(same(render(engine, image), steps[0]));
+}
+
+// The limit is a floor on what stays undoable, and the history never
+// holds a whole keyframe interval more than it
+void testHistoryLimit() {
+  const ImageBuffer image = testImage();
+  for (size_t limit : {1, 5, 15, 16, 17, 40}) {
+    LiquifyEngine engine(kWidth, kHeight);
+    engine.setHistoryLimit(limit);
+    std::vector<cv::Mat> steps = {render(engine, image)};
+    const int strokes = 100;
+    for (int i = 0; i < strokes; ++i) {
+      stroke(engine, i);
+      steps.push_back(render(engine, image));
+      const size_t done = static_cast<size_t>(i + 1);
+      PB_CHECK(engine.historySize() >= std::min(done, limit));
+      PB_CHECK(engine.historySize() < limit + 16);
+      PB_CHECK(engine.canUndo());
+    }
+
+    // Everything kept undoes to the exact earlier meshes
+    size_t undone = 0;
+    while (engine.undo()) {
+      ++undone;
+      PB_CHECK(same(render(engine, image), steps[strokes - undone]));
+    }
+    PB_CHECK(undone == engine.historySize());
+    PB_CHECK(undone >= limit);
+  }
+
+  // Lowering the limit trims at once, by whole intervals
+  LiquifyEngine engine(kWidth, kHeight);
+  for (int i = 0; i < 50; ++i)
+    stroke(engine, i);
+  engine.setHistoryLimit(10);
+  PB_CHECK(engine.historySize() >= 10 && engine.historySize() < 26);
+  PB_CHECK(engine.historySize() % 16 == 50 % 16);
+}
+
+} // namespace
+
+int main() {
+  testUndoRedo();
+  testHistoryLimit();
+  return Test::report("LiquifyEngineTest");
+}
@@ -0,0 +1,129 @@
+#include "Check.h"
+#include "Processing/MaskProcessor.h"
+
+using namespace PersonBeauty;
+using namespace PersonBeauty::Processing;
+
+namespace {
+
+const int kWidth = 256, kHeight = 192, kScale = 4;
+const int kRadius = 4;
+const float kEps = 1e-3f;
+
+// A bright disk on a darker ramp, the model's soft view of it at a
+// quarter of the size, and the disk's exact mask
+struct Scene {
+  ImageBuffer guide{kWidth, kHeight, 3};
+  ImageBuffer mask{kWidth / kScale, kHeight / kScale, 1};
+  cv::Mat truth{kHeight, kWidth, CV_8UC1, cv::Scalar(0)};
+
+  Scene() {
+    cv::Mat &img = guide.getMat();
+    for (int x = 0; x < kWidth; ++x)
+      img.col(x) = cv::Scalar(40 + x / 16, 50, 60);
+    const cv::Point center(kWidth / 2, kHeight / 2);
+    cv::circle(img, center, 60, cv::Scalar(180, 200, 220), -1);
+    cv::circle(truth, center, 60, cv::Scalar(255), -1);
+    cv::resize(truth, mask.getMat(), mask.getMat().size(), 0, 0,
+               cv::INTER_AREA);
+  }
+};
+
+cv::Mat grayOf(const ImageBuffer &guide) {
+  cv::Mat gray;
+  cv::cvtColor(guide.getMat(), gray, cv::COLOR_BGR2GRAY);
+  return gray;
+}
+
+// Guided filter of mask ~ a * gray + b over `window`, all at one size.
+// Returns a and b (b in 0..255 units).
+void fitCoefficients(const cv::Mat &gray8, const cv::Mat &mask8, int radius,
+                     cv::Mat &a, cv::Mat &b) {
+  cv::Mat I, p;
+  gray8.convertTo(I, CV_32F, 1.0 / 255.0);
+  mask8.convertTo(p, CV_32F, 1.0 / 255.0);
+  const cv::Size window(2 * radius + 1, 2 * radius + 1);
+  cv::Mat meanI, meanP, corrI, corrIp;
+  cv::boxFilter(I, meanI, CV_32F, window);
+  cv::boxFilter(p, meanP, CV_32F, window);
+  cv::boxFilter(I.mul(I), corrI, CV_32F, window);
+  cv::boxFilter(I.mul(p), corrIp, CV_32F, window);
+  cv::Mat varI = corrI - meanI.mul(meanI);
+  cv::Mat covIp = corrIp - meanI.mul(meanP);
+  a = covIp / (varI + kEps);
+  b = (meanP - a.mul(meanI)) * 255.0f;
+  cv::boxFilter(a, a, CV_32F, window);
+  cv::boxFilter(b, b, CV_32F, window);
+}
+
+cv::Mat apply(const cv::Mat &a, const cv::Mat &b, const cv::Mat &gray8) {
+  cv::Mat I, out;
+  gray8.convertTo(I, CV_32F);
+  cv::Mat(a.mul(I) + b).convertTo(out, CV_8U);
+  return out;
+}
+
+// The classic guided filter at full resolution, on the bilinearly
+// upsampled mask, with the radius scaled to match
+cv::Mat referenceGuided(const Scene &scene) {
+  const cv::Mat gray = grayOf(scene.guide);
+  cv::Mat up, a, b;
+  cv::resize(scene.mask.getMat(), up, gray.size(), 0, 0, cv::INTER_LINEAR);
+  fitCoefficients(gray, up, kRadius * kScale, a, b);
+  return apply(a, b, gray);
+}
+
+// The same fast filter with whole-frame coefficient maps
+cv::Mat referenceFast(const Scene &scene) {
+  const cv::Mat gray = grayOf(scene.guide);
+  cv::Mat low, a, b, A, B;
+  cv::resize(gray, low, scene.mask.getMat().size(), 0, 0, cv::INTER_AREA);
+  fitCoefficients(low, scene.mask.getMat(), kRadius, a, b);
+  cv::resize(a, A, gray.size(), 0, 0, cv::INTER_LINEAR);
+  cv::resize(b, B, gray.size(), 0, 0, cv::INTER_LINEAR);
+  return apply(A, B, gray);
+}
+
+double meanError(const cv::Mat &a, const cv::Mat &b) {
+  return cv::norm(a, b, cv::NORM_L1) / static_cast<double>(a.total());
+}
+
+void testMatte() {
+  const Scene scene;
+  ImageBuffer matte;
+  MaskProcessor::guidedUpsample(scene.mask, scene.guide, matte, kRadius,
+                                kEps);
+  if (!PB_CHECK(matte.getMat().size() == scene.guide.getMat().size() &&
+                matte.getMat().type() == CV_8UC1))
+    return;
+
+  // Banded interpolation of a, b is cv::resize's, up to float rounding
+  PB_CHECK(cv::norm(matte.getMat(), referenceFast(scene), cv::NORM_INF) <=
+           1);
+  // Close to the full-resolution filter it approximates...
+  const double fromReference =
+      meanError(matte.getMat(), referenceGuided(scene));
+  if (!PB_CHECK(fromReference < 4.0))
+    std::cerr << "  mean error vs full-res guided filter " << fromReference
+              << std::endl;
+  // ...and its edge follows the image's, unlike a plain upsample
+  cv::Mat bilinear;
+  cv::resize(scene.mask.getMat(), bilinear, scene.truth.size(), 0, 0,
+             cv::INTER_LINEAR);
+  PB_CHECK(meanError(matte.getMat(), scene.truth) <
+           meanError(bilinear, scene.truth) / 2);
+
+  // A gray guide gives what the color guide's gray does
+  ImageBuffer grayGuide(grayOf(scene.guide), PixelFormat::Gray8);
+  ImageBuffer grayMatte;
+  MaskProcessor::guidedUpsample(scene.mask, grayGuide, grayMatte, kRadius,
+                                kEps);
+  PB_CHECK(cv::norm(grayMatte.getMat(), matte.getMat(), cv::NORM_INF) == 0);
+}
+
+} // namespace
+
+int main() {
+  testMatte();
+  return Test::report("MaskProcessorTest");
+}
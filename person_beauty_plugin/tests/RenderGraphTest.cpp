@@ -0,0 +1,138 @@
+#include "Check.h"
+#include "Core/RenderGraph.h"
+
+using namespace PersonBeauty;
+
+namespace {
+
+int value(const std::any *v) { return std::any_cast<int>(*v); }
+
+// a, b -> scaled = (a + b) * factor -> offset = scaled + delta, and b ->
+// square: an analysis branch next to a chain of edits
+void build(RenderGraph &graph) {
+  graph.addInput("a");
+  graph.addInput("b");
+  graph.addNode(
+      "scaled",
+      [](const RenderGraph::Inputs &in, const std::any &p) {
+        return std::any((value(in[0]) + value(in[1])) * std::any_cast<int>(p));
+      },
+      {"a", "b"});
+  graph.addNode(
+      "offset",
+      [](const RenderGraph::Inputs &in, const std::any &p) {
+        return std::any(value(in[0]) + std::any_cast<int>(p));
+      },
+      {"scaled"});
+  graph.addNode(
+      "square",
+      [](const RenderGraph::Inputs &in, const std::any &) {
+        return std::any(value(in[0]) * value(in[0]));
+      },
+      {"b"});
+  graph.setParams("scaled", 2);
+  graph.setParams("offset", 1);
+}
+
+bool runs(const RenderGraph &graph, int scaled, int offset, int square) {
+  return graph.runs("scaled") == scaled && graph.runs("offset") == offset &&
+         graph.runs("square") == square;
+}
+
+void testReuse() {
+  RenderGraph graph;
+  build(graph);
+  graph.setInput("a", 3, 1);
+  graph.setInput("b", 4, 1);
+
+  const int *offset = graph.evaluate<int>("offset");
+  PB_CHECK(offset && *offset == 15);
+  // Only the target's ancestors run
+  PB_CHECK(runs(graph, 1, 1, 0));
+
+  // Nothing changed: everything comes from the cache
+  offset = graph.evaluate<int>("offset");
+  PB_CHECK(offset && *offset == 15);
+  PB_CHECK(runs(graph, 1, 1, 0));
+
+  // The same parameters again, or an input with the same key, keep it
+  graph.setParams("scaled", 2);
+  graph.setInput("a", 3, 1);
+  graph.evaluate<int>("offset");
+  PB_CHECK(runs(graph, 1, 1, 0));
+}
+
+void testInvalidation() {
+  RenderGraph graph;
+  build(graph);
+  graph.setInput("a", 3, 1);
+  graph.setInput("b", 4, 1);
+  graph.evaluate<int>("offset");
+  graph.evaluate<int>("square");
+  PB_CHECK(runs(graph, 1, 1, 1));
+
+  // A downstream slider reruns that node only
+  graph.setParams("offset", 5);
+  const int *offset = graph.evaluate<int>("offset");
+  PB_CHECK(offset && *offset == 19);
+  PB_CHECK(runs(graph, 1, 2, 1));
+
+  // An upstream slider reruns the node and everything downstream of it
+  graph.setParams("scaled", 3);
+  offset = graph.evaluate<int>("offset");
+  PB_CHECK(offset && *offset == 26);
+  PB_CHECK(runs(graph, 2, 3, 1));
+
+  // A new input reruns its dependents, not the other branch
+  graph.setInput("a", 10, 2);
+  graph.evaluate<int>("offset");
+  graph.evaluate<int>("square");
+  PB_CHECK(runs(graph, 3, 4, 1));
+  graph.setInput("b", 1, 2);
+  const int *square = graph.evaluate<int>("square");
+  PB_CHECK(square && *square == 1);
+  PB_CHECK(runs(graph, 3, 4, 2));
+  offset = graph.evaluate<int>("offset");
+  PB_CHECK(offset && *offset == 38);
+  PB_CHECK(runs(graph, 4, 5, 2));
+
+  // Going back to earlier values recomputes: only the last key is cached
+  graph.setParams("scaled", 2);
+  graph.evaluate<int>("offset");
+  PB_CHECK(runs(graph, 5, 6, 2));
+
+  graph.clearCache();
+  graph.evaluate<int>("offset");
+  PB_CHECK(runs(graph, 6, 7, 2));
+}
+
+void testErrors() {
+  RenderGraph graph;
+  build(graph);
+  graph.setInput("a", 3, 1);
+  // b is unset
+  PB_CHECK(graph.evaluate<int>("offset") == nullptr);
+  PB_CHECK(runs(graph, 0, 0, 0));
+  graph.setInput("b", 4, 1);
+  PB_CHECK(graph.evaluate<float>("offset") == nullptr); // Wrong type
+  PB_CHECK(graph.evaluate<int>("missing") == nullptr);
+  PB_CHECK(!graph.addNode(
+      "scaled", [](const RenderGraph::Inputs &, const std::any &) {
+        return std::any();
+      }));
+  PB_CHECK(!graph.addNode(
+      "late", [](const RenderGraph::Inputs &, const std::any &) {
+        return std::any();
+      },
+      {"undeclared"}));
+  PB_CHECK(!graph.setInput("scaled", 1, 1));
+}
+
+} // namespace
+
+int main() {
+  testReuse();
+  testInvalidation();
+  testErrors();
+  return Test::report("RenderGraphTest");
+}
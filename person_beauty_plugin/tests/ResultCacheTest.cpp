@@ -0,0 +1,133 @@
+#include "Check.h"
+#include "Network/ResultCache.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <unistd.h>
+
+using namespace PersonBeauty;
+using namespace PersonBeauty::Network;
+namespace fs = std::filesystem;
+
+namespace {
+
+// A fresh cache directory per test, removed afterwards
+struct TempDir {
+  fs::path path;
+
+  explicit TempDir(const std::string &name)
+      : path(fs::temp_directory_path() /
+             ("pb_result_cache_" + std::to_string(::getpid()) + "_" + name)) {
+    fs::remove_all(path);
+  }
+  ~TempDir() {
+    std::error_code ec;
+    fs::remove_all(path, ec);
+  }
+  std::string str() const { return path.string(); }
+};
+
+std::string key(const std::string &name) {
+  return ContentHash().add(name).hex();
+}
+
+std::vector<uint8_t> body(char fill, size_t size = 30) {
+  return std::vector<uint8_t>(size, static_cast<uint8_t>(fill));
+}
+
+bool holds(ResultCache &cache, const std::string &name, char fill) {
+  std::vector<uint8_t> bytes;
+  return cache.load(key(name), bytes) && bytes == body(fill);
+}
+
+// The least recently used entry goes first, and a hit counts as a use
+void testEvictionOrder() {
+  TempDir dir("order");
+  ResultCache cache(dir.str(), 100);
+  PB_CHECK(cache.valid());
+  PB_CHECK(cache.store(key("a"), body('a')));
+  PB_CHECK(cache.store(key("b"), body('b')));
+  PB_CHECK(cache.store(key("c"), body('c')));
+  PB_CHECK(holds(cache, "a", 'a'));
+
+  PB_CHECK(cache.store(key("d"), body('d')));
+  PB_CHECK(!holds(cache, "b", 'b'));
+  PB_CHECK(!fs::exists(dir.path / key("b")));
+  PB_CHECK(holds(cache, "a", 'a'));
+  PB_CHECK(holds(cache, "c", 'c'));
+  PB_CHECK(holds(cache, "d", 'd'));
+  const ResultCacheStats stats = cache.stats();
+  PB_CHECK(stats.evictions == 1);
+  PB_CHECK(stats.entries == 3 && stats.bytes == 90);
+  PB_CHECK(stats.misses == 1);
+}
+
+// Entries never take more than maxBytes, on disk as in the stats
+void testSizeCap() {
+  TempDir dir("cap");
+  ResultCache cache(dir.str(), 100);
+  PB_CHECK(!cache.store(key("huge"), body('h', 101)));
+  for (int i = 0; i < 20; ++i) {
+    const std::string name = "entry" + std::to_string(i);
+    PB_CHECK(cache.store(key(name), body('x', 10 + i % 25)));
+    size_t onDisk = 0;
+    for (const auto &item : fs::directory_iterator(dir.path))
+      onDisk += static_cast<size_t>(item.file_size());
+    PB_CHECK(onDisk == cache.stats().bytes);
+    PB_CHECK(onDisk <= 100);
+  }
+  // Replacing an entry accounts for the new size only
+  PB_CHECK(cache.store(key("entry19"), body('y', 5)));
+  std::vector<uint8_t> bytes;
+  PB_CHECK(cache.load(key("entry19"), bytes) && bytes == body('y', 5));
+  PB_CHECK(cache.store(key("entry19"), body('z', 40)));
+  PB_CHECK(cache.load(key("entry19"), bytes) && bytes == body('z', 40));
+  PB_CHECK(cache.stats().bytes <= 100);
+}
+
+// A new instance on the same directory finds the entries in the same LRU
+// order, and leaves alone temporary files another process may be writing
+void testRestart() {
+  TempDir dir("restart");
+  {
+    ResultCache cache(dir.str(), 100);
+    cache.store(key("a"), body('a'));
+    cache.store(key("b"), body('b'));
+    cache.store(key("c"), body('c'));
+    PB_CHECK(holds(cache, "a", 'a'));
+  }
+  const fs::path fresh = dir.path / "in_flight.tmp";
+  const fs::path stale = dir.path / "crashed.tmp";
+  std::ofstream(fresh) << "partial";
+  std::ofstream(stale) << "partial";
+  fs::last_write_time(stale, fs::file_time_type::clock::now() -
+                                 std::chrono::hours(2));
+
+  {
+    ResultCache cache(dir.str(), 100);
+    PB_CHECK(fs::exists(fresh));
+    PB_CHECK(!fs::exists(stale));
+    const ResultCacheStats stats = cache.stats();
+    PB_CHECK(stats.entries == 3 && stats.bytes == 90);
+    PB_CHECK(cache.store(key("d"), body('d')));
+    PB_CHECK(!holds(cache, "b", 'b'));
+    PB_CHECK(holds(cache, "a", 'a'));
+    PB_CHECK(holds(cache, "c", 'c'));
+  }
+
+  // A smaller budget evicts the oldest entries while indexing
+  ResultCache cache(dir.str(), 60);
+  PB_CHECK(cache.stats().entries == 2);
+  PB_CHECK(holds(cache, "a", 'a'));
+  PB_CHECK(holds(cache, "c", 'c'));
+  PB_CHECK(!holds(cache, "d", 'd'));
+}
+
+} // namespace
+
+int main() {
+  testEvictionOrder();
+  testSizeCap();
+  testRestart();
+  return Test::report("ResultCacheTest");
+}
@@ -0,0 +1,131 @@
+#include "Check.h"
+#include "Core/StripProcessor.h"
+#include "Processing/ColorEngine.h"
+#include "Processing/LiquifyEngine.h"
+#include <cmath>
+#include <vector>
+
+using namespace PersonBeauty;
+using namespace PersonBeauty::Processing;
+
+namespace {
+
+const int kWidth = 320, kHeight = 240;
+const float kBrightness = 0.1f, kContrast = 1.05f, kSaturation = 1.1f;
+const float kRetouch = 0.7f, kStereo = 0.7f, kSlim = 0.45f;
+
+// 68 points in the iBUG layout the effects index: jaw 0-16, brows 17-26,
+// nose 27-35, eyes 36-47, mouth 48-67
+std::vector<cv::Point2f> face(cv::Point2f c, float s) {
+  const float pi = static_cast<float>(CV_PI);
+  std::vector<cv::Point2f> p;
+  for (int i = 0; i <= 16; ++i)
+    p.push_back(c + cv::Point2f(-0.5f * s * std::cos(pi * i / 16),
+                                0.1f * s + 0.6f * s * std::sin(pi * i / 16)));
+  for (int i = 0; i < 10; ++i)
+    p.push_back(c + cv::Point2f((-0.4f + 0.8f * i / 9) * s, -0.35f * s));
+  for (int i = 0; i < 4; ++i)
+    p.push_back(c + cv::Point2f(0.0f, (-0.25f + 0.1f * i) * s));
+  for (int i = 0; i < 5; ++i)
+    p.push_back(c + cv::Point2f((-0.1f + 0.05f * i) * s, 0.12f * s));
+  for (float side : {-1.0f, 1.0f})
+    for (int i = 0; i < 6; ++i)
+      p.push_back(c + cv::Point2f(side * 0.2f * s, -0.18f * s) +
+                  cv::Point2f(0.06f * s * std::cos(pi * i / 3),
+                              0.03f * s * std::sin(pi * i / 3)));
+  for (int i = 0; i < 20; ++i)
+    p.push_back(c + cv::Point2f(0.0f, 0.3f * s) +
+                cv::Point2f(0.15f * s * std::cos(pi * i / 10),
+                            0.06f * s * std::sin(pi * i / 10)));
+  return p;
+}
+
+struct Scene {
+  ImageBuffer image;
+  ImageBuffer mask{kWidth, kHeight, 1};
+  std::vector<std::vector<cv::Point2f>> faces;
+
+  explicit Scene(PixelFormat format) : image(kWidth, kHeight, format) {
+    cv::Mat &img = image.getMat();
+    cv::setRNGSeed(9);
+    cv::randu(img, cv::Scalar::all(0), cv::Scalar::all(255));
+    cv::GaussianBlur(img, img, cv::Size(7, 7), 2.0);
+    cv::Mat &m = mask.getMat();
+    m = cv::Scalar(0);
+    cv::ellipse(m, cv::Point(160, 120), cv::Size(90, 110), 0, 0, 360,
+                cv::Scalar(255), -1);
+    cv::GaussianBlur(m, m, cv::Size(21, 21), 0);
+    // One face across the middle, one cut by the top edge
+    faces = {face(cv::Point2f(160, 115), 140), face(cv::Point2f(60, 20), 80)};
+  }
+};
+
+void slim(LiquifyEngine &liquify, const Scene &scene) {
+  for (const auto &pts : scene.faces)
+    liquify.slimFace(pts, kSlim);
+}
+
+cv::Mat wholeFrame(const Scene &scene) {
+  ImageBuffer image;
+  ColorEngine::adjust(scene.image, image, scene.mask, kBrightness, kContrast,
+                      kSaturation, 0.0f);
+  ColorEngine::applyNeutralGrayRetouch(image, scene.mask, kRetouch);
+  for (const auto &pts : scene.faces)
+    ColorEngine::applyNeutralGrayStereo(image, pts, kStereo);
+  LiquifyEngine liquify(kWidth, kHeight);
+  slim(liquify, scene);
+  ImageBuffer output;
+  liquify.process(image, output);
+  return output.getMat();
+}
+
+// Banded runs write the same bytes as the whole-frame chain, whatever the
+// band height the memory limit leads to
+void testMatchesWholeFrame(PixelFormat format, LayerPrecision precision) {
+  ColorEngine::setLayerPrecision(precision);
+  const Scene scene(format);
+  const cv::Mat expected = wholeFrame(scene);
+
+  LiquifyEngine liquify(kWidth, kHeight);
+  slim(liquify, scene);
+  StripProcessor tiler;
+  tiler.addStage(ColorEngine::adjustStage(scene.mask, kBrightness, kContrast,
+                                          kSaturation, 0.0f));
+  tiler.addStage(ColorEngine::retouchStage(scene.mask, kRetouch));
+  tiler.addStage(ColorEngine::stereoStage(scene.faces, kStereo));
+  tiler.addStage(liquify.stripStage());
+
+  const size_t frameBytes = size_t(kWidth) * kHeight * channelCount(format);
+  for (size_t limit : {size_t(0), frameBytes * 8, frameBytes, frameBytes / 4,
+                       frameBytes / 16, size_t(1)}) {
+    tiler.setMemoryLimit(limit);
+    ImageBuffer output;
+    if (!PB_CHECK(tiler.run(scene.image, output)))
+      continue;
+    if (!PB_CHECK(cv::norm(output.getMat(), expected, cv::NORM_INF) == 0))
+      std::cerr << "  " << channelCount(format) << " channels, limit "
+                << limit << ", " << tiler.stripsRun() << " strips"
+                << std::endl;
+    if (limit == 0)
+      PB_CHECK(tiler.stripsRun() == 1);
+    if (limit > 0 && limit <= frameBytes)
+      PB_CHECK(tiler.stripsRun() > 1);
+    // Bands fit a limit that leaves room for more than the halos (below
+    // that they go down to single rows, whatever those take)
+    if (limit >= frameBytes * 8)
+      PB_CHECK(tiler.peakBytes() <= limit);
+    if (limit == 1)
+      PB_CHECK(tiler.stripsRun() == kHeight);
+  }
+  ColorEngine::setLayerPrecision(LayerPrecision::Float32);
+}
+
+} // namespace
+
+int main() {
+  for (PixelFormat format : {PixelFormat::BGR8, PixelFormat::BGRA8})
+    for (LayerPrecision precision :
+         {LayerPrecision::Float32, LayerPrecision::Float16})
+      testMatchesWholeFrame(format, precision);
+  return Test::report("StripProcessorTest");
+}